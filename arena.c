@@ -0,0 +1,102 @@
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+#define ARENA_DEFAULT_CHUNK (1024 * 1024)
+#define ALIGN_UP(x) (((x) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static ArenaChunk *newChunk(Arena *a, size_t need) {
+    size_t cap = a->chunkSize ? a->chunkSize : ARENA_DEFAULT_CHUNK;
+    if (cap < need) cap = need;
+    ArenaChunk *c = malloc(sizeof(ArenaChunk) + cap);
+    if (!c) { perror("malloc"); exit(1); }
+    c->used = 0;
+    c->cap = cap;
+    c->next = a->head;
+    a->head = c;
+    return c;
+}
+
+void *arenaAlloc(Arena *a, size_t size) {
+    size = ALIGN_UP(size ? size : 1);
+    ArenaChunk *c = a->head;
+    if (!c || c->cap - c->used < size) c = newChunk(a, size);
+    void *p = c->data + c->used;
+    c->used += size;
+    a->bytes += size;
+    return p;
+}
+
+/* Resize p (the caller knows its old size). The most recent allocation is
+   extended in place; anything else is copied and the old space abandoned. */
+void *arenaGrow(Arena *a, void *p, size_t oldSize, size_t newSize) {
+    ArenaChunk *c = a->head;
+    size_t oldA = ALIGN_UP(oldSize ? oldSize : 1), newA = ALIGN_UP(newSize);
+    if (p && c && (unsigned char *)p + oldA == c->data + c->used
+        && c->cap - c->used >= newA - oldA) {
+        c->used += newA - oldA;
+        a->bytes += newA - oldA;
+        return p;
+    }
+    void *q = arenaAlloc(a, newSize);
+    if (p) memcpy(q, p, oldSize < newSize ? oldSize : newSize);
+    return q;
+}
+
+const char *arenaStrdup(Arena *a, const char *str, size_t len) {
+    char *dst = arenaAlloc(a, len + 1);
+    memcpy(dst, str, len);
+    dst[len] = '\0';
+    return dst;
+}
+
+/* Forget every allocation but keep the memory: if the arena spilled into
+   several chunks, they are replaced by one chunk big enough for all of
+   them, so a workload that repeats stops calling malloc after warm-up. */
+void arenaReset(Arena *a) {
+    if (a->head && a->head->next) {
+        size_t total = arenaCapacity(a);
+        freeArena(a);
+        if (a->chunkSize < total) a->chunkSize = total;
+        newChunk(a, total);
+    } else if (a->head) {
+        a->head->used = 0;
+    }
+    a->bytes = 0;
+}
+
+/* Take ownership of src's chunks; pointers into them stay valid. */
+void arenaAbsorb(Arena *dst, Arena *src) {
+    if (!src->head) return;
+    ArenaChunk *last = src->head;
+    while (last->next) last = last->next;
+    /* keep dst's partially filled head in front so it keeps filling up */
+    if (dst->head) {
+        last->next = dst->head->next;
+        dst->head->next = src->head;
+    } else {
+        dst->head = src->head;
+    }
+    dst->bytes += src->bytes;
+    src->head = NULL;
+    src->bytes = 0;
+}
+
+size_t arenaCapacity(const Arena *a) {
+    size_t total = 0;
+    for (const ArenaChunk *c = a->head; c; c = c->next) total += c->cap;
+    return total;
+}
+
+void freeArena(Arena *a) {
+    ArenaChunk *c = a->head;
+    while (c) {
+        ArenaChunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    a->head = NULL;
+    a->bytes = 0;
+}
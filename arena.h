@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Region allocator: allocations are bump-pointer carved out of large
+   chunks and are never freed one by one. A whole arena is released (or
+   reset for reuse) at once, and related objects end up next to each other. */
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t used;
+    size_t cap;
+    _Alignas(16) unsigned char data[];
+} ArenaChunk;
+
+typedef struct Arena {
+    ArenaChunk *head;
+    size_t chunkSize;       /* minimum chunk size; 0 = default */
+    size_t bytes;           /* bytes handed out since the last reset */
+} Arena;
+
+void *arenaAlloc(Arena *a, size_t size);
+void *arenaGrow(Arena *a, void *p, size_t oldSize, size_t newSize);
+const char *arenaStrdup(Arena *a, const char *str, size_t len);
+void arenaReset(Arena *a);
+void arenaAbsorb(Arena *dst, Arena *src);
+size_t arenaCapacity(const Arena *a);
+void freeArena(Arena *a);
+
+#endif
@@ -0,0 +1,133 @@
+#include "batch.h"
+#include "search.h"
+#include "textbuf.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define BATCH_CHUNK 4096        /* queries read, run and written per round */
+
+typedef struct BatchItem {
+    long id;
+    char *query;
+    TextBuf out;
+} BatchItem;
+
+typedef struct BatchRound {
+    BatchItem *items;
+    int count;
+    atomic_int next;
+    int json;
+} BatchRound;
+
+/* snips: one per hit for JSON with snippets, else NULL */
+static void formatHits(BatchItem *it, const SearchHit *hits, Snippet *snips, int k, int json) {
+    char num[96];
+    if (!json) {
+        for (int i = 0; i < k; i++) {
+            snprintf(num, sizeof(num), "%ld\t%d\t", it->id, hits[i].docId);
+            textStr(&it->out, num);
+            textStr(&it->out, hits[i].name);
+            snprintf(num, sizeof(num), "\t%.6f\n", hits[i].score);
+            textStr(&it->out, num);
+        }
+        return;
+    }
+    snprintf(num, sizeof(num), "{\"id\":%ld,\"query\":", it->id);
+    textStr(&it->out, num);
+    textJsonString(&it->out, it->query);
+    textStr(&it->out, ",\"hits\":[");
+    for (int i = 0; i < k; i++) {
+        snprintf(num, sizeof(num), "%s{\"docId\":%d,\"doc\":", i ? "," : "", hits[i].docId);
+        textStr(&it->out, num);
+        textJsonString(&it->out, hits[i].name);
+        snprintf(num, sizeof(num), ",\"score\":%.6f", hits[i].score);
+        textStr(&it->out, num);
+        if (snips && snips[i].text) {
+            textStr(&it->out, ",\"snippet\":");
+            snippetJson(&it->out, &snips[i]);
+        }
+        textStr(&it->out, "}");
+    }
+    textStr(&it->out, "]}\n");
+}
+
+static void runItems(BatchRound *r) {
+    SearchHit hits[TOP_K];
+    Snippet snips[TOP_K];
+    int i, snippets = r->json && resultSnippets();
+    while ((i = atomic_fetch_add(&r->next, 1)) < r->count) {
+        BatchItem *it = &r->items[i];
+        const IndexView *v = acquireView();
+        int k = searchQuery(v, it->query, hits);
+        if (snippets) searchSnippets(v, hits, k, snips);
+        formatHits(it, hits, snippets ? snips : NULL, k, r->json);     /* names live as long as the view */
+        releaseView(v);
+    }
+}
+
+static void *batchWorker(void *arg) {
+    runItems(arg);
+    freeQueryScratch();
+    return NULL;
+}
+
+/* Workers for the round's spare threads; the calling thread is one too. */
+static void runRound(BatchRound *r, int threads) {
+    pthread_t *tids = malloc(sizeof(pthread_t) * (threads > 1 ? threads - 1 : 1));
+    if (!tids) { perror("malloc"); exit(1); }
+    int started = 0;
+    for (; started < threads - 1 && started < r->count - 1; started++) {
+        if (pthread_create(&tids[started], NULL, batchWorker, r) != 0) break;
+    }
+    runItems(r);
+    for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+    free(tids);
+}
+
+int runBatch(const BatchConfig *cfg) {
+    FILE *in = strcmp(cfg->input, "-") == 0 ? stdin : fopen(cfg->input, "r");
+    if (!in) { perror(cfg->input); return -1; }
+    setvbuf(cfg->out, NULL, _IOFBF, 1 << 20);
+
+    BatchItem *items = calloc(BATCH_CHUNK, sizeof(BatchItem));
+    if (!items) { perror("calloc"); exit(1); }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    long lineNo = 0, total = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    int eof = 0;
+    while (!eof) {
+        BatchRound r = { items, 0, 0, cfg->json };
+        while (r.count < BATCH_CHUNK) {
+            ssize_t len = getline(&line, &cap, in);
+            if (len < 0) { eof = 1; break; }
+            lineNo++;
+            while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+            if (len == 0) continue;
+            BatchItem *it = &items[r.count++];
+            it->id = lineNo;
+            it->query = strdup(line);
+            if (!it->query) { perror("strdup"); exit(1); }
+        }
+        if (r.count == 0) break;
+        runRound(&r, cfg->threads);
+        for (int i = 0; i < r.count; i++) {
+            fwrite(items[i].out.s, 1, items[i].out.len, cfg->out);
+            free(items[i].out.s);
+            free(items[i].query);
+            memset(&items[i], 0, sizeof(BatchItem));
+        }
+        total += r.count;
+    }
+    fflush(cfg->out);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "Batch: %ld queries in %.2f s (%.0f queries/s) on %d thread(s)\n",
+            total, secs, secs > 0 ? total / secs : 0.0, cfg->threads);
+    free(line);
+    free(items);
+    if (in != stdin) fclose(in);
+    return 0;
+}
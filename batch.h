@@ -0,0 +1,27 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+
+/* ---------------- Batch queries ----------------
+   Runs every line of a query file (or stdin) against the current view on
+   several threads and writes the results in input order, whatever the
+   thread count. A query's id is its line number. Either format has one
+   record per hit, best first:
+
+     tsv:   id <TAB> docId <TAB> filename <TAB> score
+     json:  {"id":3,"query":"...","hits":[{"docId":7,"doc":"...","score":0.5}]}
+            (one line per query, so queries without hits still appear; with
+            snippets on, each hit also has a "snippet", as in server replies) */
+
+typedef struct BatchConfig {
+    const char *input;      /* path, or "-" for stdin */
+    FILE *out;
+    int threads;
+    int json;
+} BatchConfig;
+
+/* 0 on success, -1 if the input can't be read */
+int runBatch(const BatchConfig *cfg);
+
+#endif
@@ -0,0 +1,156 @@
+/* Microbenchmark: the open-addressed TermTable against the fixed-size
+   chained table it replaced (reproduced below as it was).
+
+   usage: bench_dict [maxTerms]        (default 4000000) */
+#include "../indexer.h"
+#include <time.h>
+
+/* ---------------- previous dictionary ---------------- */
+
+#define OLD_HASH_SIZE 20011
+#define OLD_MAX_WORD_LEN 100
+
+typedef struct OldDocNode {
+    int docId;
+    int frequency;
+    int *positions;
+    int posCount;
+    int posCap;
+    struct OldDocNode *next;
+} OldDocNode;
+
+typedef struct OldEntry {
+    char word[OLD_MAX_WORD_LEN];
+    OldDocNode *docList;
+    int docFrequency;
+    struct OldEntry *next;
+} OldEntry;
+
+static unsigned long oldHash(const char *str) {
+    unsigned long hash = 5381;
+    int c;
+    while ((c = (unsigned char)*str++))
+        hash = ((hash << 5) + hash) + c;
+    return hash % OLD_HASH_SIZE;
+}
+
+static OldEntry *oldFind(OldEntry **table, const char *word) {
+    for (OldEntry *cur = table[oldHash(word)]; cur; cur = cur->next)
+        if (strcmp(cur->word, word) == 0) return cur;
+    return NULL;
+}
+
+static void oldInsert(OldEntry **table, const char *word, int docId, int position) {
+    unsigned long h = oldHash(word);
+    OldEntry *e = oldFind(table, word);
+    if (!e) {
+        e = malloc(sizeof(OldEntry));
+        strncpy(e->word, word, OLD_MAX_WORD_LEN - 1);
+        e->word[OLD_MAX_WORD_LEN - 1] = '\0';
+        e->docList = NULL;
+        e->docFrequency = 0;
+        e->next = table[h];
+        table[h] = e;
+    }
+    OldDocNode *d = malloc(sizeof(OldDocNode));
+    d->docId = docId;
+    d->posCap = 8;
+    d->positions = malloc(d->posCap * sizeof(int));
+    d->positions[0] = position;
+    d->posCount = d->frequency = 1;
+    d->next = e->docList;
+    e->docList = d;
+    e->docFrequency++;
+}
+
+static void oldFree(OldEntry **table) {
+    for (int i = 0; i < OLD_HASH_SIZE; i++) {
+        OldEntry *e = table[i];
+        while (e) {
+            OldEntry *next = e->next;
+            OldDocNode *d = e->docList;
+            while (d) { OldDocNode *dn = d->next; free(d->positions); free(d); d = dn; }
+            free(e);
+            e = next;
+        }
+    }
+    free(table);
+}
+
+/* ---------------- harness ---------------- */
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t rng = 88172645463325252ULL;
+static uint64_t nextRand(void) {
+    rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+    return rng;
+}
+
+/* distinct lowercase terms of 3..12 letters (suffix keeps them unique) */
+static char **makeTerms(int n, const char *tag) {
+    char **t = malloc(sizeof(char *) * n);
+    for (int i = 0; i < n; i++) {
+        char buf[48];
+        int len = 3 + (int)(nextRand() % 10), k = 0;
+        for (; k < len; k++) buf[k] = (char)('a' + nextRand() % 26);
+        snprintf(buf + k, sizeof(buf) - k, "%s%d", tag, i);
+        t[i] = strdup(buf);
+    }
+    return t;
+}
+
+#define LOOKUPS 2000000
+
+int main(int argc, char **argv) {
+    int maxTerms = argc > 1 ? atoi(argv[1]) : 4000000;
+    printf("%10s %8s %12s %12s %12s\n", "terms", "table", "insert ns", "hit ns", "miss ns");
+    static const int sizes[] = { 10000, 100000, 1000000, 4000000 };
+    for (size_t si = 0; si < sizeof(sizes) / sizeof(sizes[0]) && sizes[si] <= maxTerms; si++) {
+        int n = sizes[si];
+        char **terms = makeTerms(n, "x");
+        char **absent = makeTerms(n < LOOKUPS ? n : LOOKUPS, "y");
+        int *probe = malloc(sizeof(int) * LOOKUPS);
+        for (int i = 0; i < LOOKUPS; i++) probe[i] = (int)(nextRand() % n);
+        volatile size_t sink = 0;
+
+        OldEntry **old = calloc(OLD_HASH_SIZE, sizeof(OldEntry *));
+        double t0 = nowNs();
+        for (int i = 0; i < n; i++) oldInsert(old, terms[i], 0, i);
+        double t1 = nowNs();
+        for (int i = 0; i < LOOKUPS; i++) sink += oldFind(old, terms[probe[i]]) != NULL;
+        double t2 = nowNs();
+        for (int i = 0; i < LOOKUPS; i++) sink += oldFind(old, absent[i % n]) != NULL;
+        double t3 = nowNs();
+        printf("%10d %8s %12.1f %12.1f %12.1f\n", n, "chained",
+               (t1 - t0) / n, (t2 - t1) / LOOKUPS, (t3 - t2) / LOOKUPS);
+        oldFree(old);
+
+        TermTable *table = createTermTable();
+        size_t *lens = malloc(sizeof(size_t) * n);
+        for (int i = 0; i < n; i++) lens[i] = strlen(terms[i]);
+        t0 = nowNs();
+        for (int i = 0; i < n; i++) insertWordHash(table, terms[i], lens[i], 0, i, 0);
+        t1 = nowNs();
+        for (int i = 0; i < LOOKUPS; i++)
+            sink += findWordEntry(table, terms[probe[i]], lens[probe[i]]) != NULL;
+        t2 = nowNs();
+        for (int i = 0; i < LOOKUPS; i++) {
+            const char *w = absent[i % n];
+            sink += findWordEntry(table, w, strlen(w)) != NULL;
+        }
+        t3 = nowNs();
+        printf("%10d %8s %12.1f %12.1f %12.1f\n", n, "robin",
+               (t1 - t0) / n, (t2 - t1) / LOOKUPS, (t3 - t2) / LOOKUPS);
+        freeTermTable(table);
+
+        for (int i = 0; i < n; i++) free(terms[i]);
+        for (int i = 0; i < (n < LOOKUPS ? n : LOOKUPS); i++) free(absent[i]);
+        free(terms); free(absent); free(probe); free(lens);
+    }
+    return 0;
+}
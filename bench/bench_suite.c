@@ -0,0 +1,273 @@
+/* Benchmark suite: index a corpus, then replay a query log against it and
+   write the numbers to a JSON file that can be kept and compared across
+   commits (`make bench` runs it on a generated Zipf corpus).
+
+     index    corpus MB/s for tokenizing + inserting, image build time,
+              image size, terms, and peak RSS after the build
+     queries  overall throughput, and per class (the log's first column)
+              count, mean, p50, p90, p99 and max latency of searchQuery(),
+              and mean hits
+     quality  per class, the same queries scored exactly in floating point
+              (--exact-scores): their mean latency, how many of the exact
+              top 10 the quantized impacts also return, and how often the
+              two agree on the best hit
+
+   The result cache is off so every query does its full work. Each query
+   runs once to warm up, then -r times measured.
+
+   usage: bench_suite [-j jobs] [-r rounds] [-o results.json] [--label text]
+                      [--scoring tfidf|bm25] [--impact-bits 8|16] corpus_dir queries.tsv */
+#include "../search.h"
+#include "../textbuf.h"
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define MAX_CLASSES 16
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef struct QueryClass {
+    char name[32];
+    double *lat;            /* ns, one per measured run */
+    long n, cap;
+    long hits;
+    double exactNs;         /* summed over one round */
+    double overlap;         /* summed |impact top K ∩ exact top K| / |exact top K| */
+    long top1Agree;
+} QueryClass;
+
+typedef struct LogEntry {
+    int cls;
+    char *text;
+} LogEntry;
+
+static QueryClass classes[MAX_CLASSES];
+static int classCount;
+
+static int classOf(const char *name, size_t len) {
+    for (int i = 0; i < classCount; i++)
+        if (strlen(classes[i].name) == len && memcmp(classes[i].name, name, len) == 0) return i;
+    if (classCount == MAX_CLASSES || len >= sizeof(classes[0].name)) return -1;
+    memcpy(classes[classCount].name, name, len);
+    return classCount++;
+}
+
+static LogEntry *loadLog(const char *path, long *n) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); exit(1); }
+    LogEntry *log = NULL;
+    long cap = 0;
+    *n = 0;
+    char *line = NULL;
+    size_t lineCap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &lineCap, f)) >= 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *tab = strchr(line, '\t');
+        if (!tab || tab[1] == '\0') continue;
+        int cls = classOf(line, (size_t)(tab - line));
+        if (cls < 0) { fprintf(stderr, "%s: too many query classes\n", path); exit(1); }
+        if (*n == cap) {
+            cap = cap ? cap * 2 : 1024;
+            log = realloc(log, sizeof(LogEntry) * cap);
+            if (!log) { perror("realloc"); exit(1); }
+        }
+        log[*n].cls = cls;
+        log[*n].text = strdup(tab + 1);
+        (*n)++;
+    }
+    free(line);
+    fclose(f);
+    if (*n == 0) { fprintf(stderr, "%s: no \"class<TAB>query\" lines\n", path); exit(1); }
+    return log;
+}
+
+static void record(QueryClass *c, double ns) {
+    if (c->n == c->cap) {
+        c->cap = c->cap ? c->cap * 2 : 1024;
+        c->lat = realloc(c->lat, sizeof(double) * c->cap);
+        if (!c->lat) { perror("realloc"); exit(1); }
+    }
+    c->lat[c->n++] = ns;
+}
+
+static int cmpDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double *sorted, long n, double p) {
+    long i = (long)(p * (double)(n - 1) + 0.5);
+    return sorted[i < n ? i : n - 1];
+}
+
+static size_t corpusBytes(const char *dir, int *nFiles) {
+    char **files = listDocumentFiles(dir, nFiles);
+    size_t bytes = 0;
+    struct stat st;
+    for (int i = 0; i < *nFiles; i++) {
+        if (stat(files[i], &st) == 0) bytes += (size_t)st.st_size;
+        free(files[i]);
+    }
+    free(files);
+    return bytes;
+}
+
+int main(int argc, char **argv) {
+    const char *corpus = NULL, *logPath = NULL, *outPath = "bench/results.json", *label = "";
+    int jobs = 1, rounds = 3, impactBits = 8;
+    ScoringModel scoring = SCORE_TFIDF;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) jobs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) rounds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) outPath = argv[++i];
+        else if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) label = argv[++i];
+        else if (strcmp(argv[i], "--scoring") == 0 && i + 1 < argc)
+            scoring = strcmp(argv[++i], "bm25") == 0 ? SCORE_BM25 : SCORE_TFIDF;
+        else if (strcmp(argv[i], "--impact-bits") == 0 && i + 1 < argc) impactBits = atoi(argv[++i]);
+        else if (argv[i][0] != '-' && !corpus) corpus = argv[i];
+        else if (argv[i][0] != '-' && !logPath) logPath = argv[i];
+        else corpus = NULL, i = argc;
+    }
+    if (!corpus || !logPath || jobs < 1 || rounds < 1 || setIndexScoring(scoring, impactBits) != 0) {
+        fprintf(stderr, "usage: %s [-j jobs] [-r rounds] [-o results.json] [--label text] "
+                "[--scoring tfidf|bm25] [--impact-bits 8|16] corpus_dir queries.tsv\n", argv[0]);
+        return 1;
+    }
+
+    long nQueries;
+    LogEntry *log = loadLog(logPath, &nQueries);
+    int nFiles;
+    size_t bytes = corpusBytes(corpus, &nFiles);
+    if (nFiles == 0) { fprintf(stderr, "%s: no .txt files\n", corpus); return 1; }
+
+    /* ---- indexing ---- */
+    double t0 = nowNs();
+    TermTable *table = createTermTable();
+    indexDocumentsParallel(table, corpus, jobs);
+    double t1 = nowNs();
+    Index *idx = buildIndexImage(table);
+    double t2 = nowNs();
+    freeTermTable(table);
+    freeDocuments();
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    long peakRssKb = ru.ru_maxrss;
+    size_t imageBytes = idx->size;
+    uint32_t terms = idx->hdr->termCount;
+    double indexSecs = (t1 - t0) / 1e9, imageSecs = (t2 - t1) / 1e9;
+    initSegments(&idx, 1, NULL, NULL, 0);
+
+    /* ---- queries ---- */
+    SearchHit hits[TOP_K];
+    int *top = malloc(sizeof(int) * TOP_K * nQueries), *topCount = malloc(sizeof(int) * nQueries);
+    if (!top || !topCount) { perror("malloc"); return 1; }
+    double q0 = nowNs();
+    for (int r = 0; r <= rounds; r++) {
+        for (long i = 0; i < nQueries; i++) {
+            const IndexView *v = acquireView();
+            double s = nowNs();
+            int k = searchQuery(v, log[i].text, hits);
+            double e = nowNs();
+            releaseView(v);
+            if (r > 0) { record(&classes[log[i].cls], e - s); continue; }
+            classes[log[i].cls].hits += k;
+            topCount[i] = k;
+            for (int j = 0; j < k; j++) top[i * TOP_K + j] = hits[j].docId;
+        }
+        if (r == 0) q0 = nowNs();
+    }
+    double querySecs = (nowNs() - q0) / 1e9;
+
+    /* ---- quality against exact floating-point scores ---- */
+    setExactScores(1);
+    for (long i = 0; i < nQueries; i++) {
+        QueryClass *qc = &classes[log[i].cls];
+        const IndexView *v = acquireView();
+        double s = nowNs();
+        int k = searchQuery(v, log[i].text, hits);
+        qc->exactNs += nowNs() - s;
+        releaseView(v);
+        if (k == 0) {
+            qc->overlap += topCount[i] == 0;
+            qc->top1Agree += topCount[i] == 0;
+            continue;
+        }
+        int same = 0;
+        for (int j = 0; j < k; j++)
+            for (int m = 0; m < topCount[i]; m++)
+                if (top[i * TOP_K + m] == hits[j].docId) { same++; break; }
+        qc->overlap += (double)same / k;
+        qc->top1Agree += topCount[i] > 0 && top[i * TOP_K] == hits[0].docId;
+    }
+    setExactScores(0);
+
+    /* ---- report ---- */
+    TextBuf out = { 0 };
+    char num[512];
+    textStr(&out, "{\n  \"label\": ");
+    textJsonString(&out, label);
+    textStr(&out, ",\n  \"scoring\": ");
+    textJsonString(&out, scoring == SCORE_BM25 ? "bm25" : "tfidf");
+    snprintf(num, sizeof(num), ",\n  \"impact_bits\": %d", impactBits);
+    textStr(&out, num);
+    textStr(&out, ",\n  \"corpus\": ");
+    textJsonString(&out, corpus);
+    snprintf(num, sizeof(num),
+             ",\n  \"docs\": %d,\n  \"corpus_bytes\": %zu,\n  \"index\": {\"jobs\": %d, \"seconds\": %.3f, "
+             "\"mb_per_s\": %.2f, \"image_seconds\": %.3f, \"image_bytes\": %zu, \"bytes_per_doc\": %.1f, "
+             "\"terms\": %u, \"peak_rss_kb\": %ld},\n  \"queries\": {\"rounds\": %d, \"count\": %ld, "
+             "\"queries_per_s\": %.1f},\n  \"classes\": {",
+             nFiles, bytes, jobs, indexSecs, bytes / 1e6 / indexSecs, imageSecs, imageBytes,
+             (double)imageBytes / nFiles, terms, peakRssKb, rounds, nQueries,
+             nQueries * rounds / querySecs);
+    textStr(&out, num);
+    fprintf(stderr, "\nIndexed %d docs (%.1f MB) in %.2f s: %.1f MB/s, image %.2f s, %zu bytes, peak RSS %ld KB\n",
+            nFiles, bytes / 1e6, indexSecs, bytes / 1e6 / indexSecs, imageSecs, imageBytes, peakRssKb);
+    fprintf(stderr, "%-8s %8s %10s %10s %10s %10s %10s %8s %10s %8s %8s\n",
+            "class", "queries", "mean_us", "p50_us", "p90_us", "p99_us", "max_us", "hits",
+            "exact_us", "overlap", "top1");
+    for (int c = 0; c < classCount; c++) {
+        QueryClass *qc = &classes[c];
+        qsort(qc->lat, qc->n, sizeof(double), cmpDouble);
+        double sum = 0;
+        for (long i = 0; i < qc->n; i++) sum += qc->lat[i];
+        long perRound = qc->n / rounds;
+        double mean = sum / qc->n / 1e3, p50 = percentile(qc->lat, qc->n, 0.50) / 1e3,
+               p90 = percentile(qc->lat, qc->n, 0.90) / 1e3, p99 = percentile(qc->lat, qc->n, 0.99) / 1e3,
+               max = qc->lat[qc->n - 1] / 1e3, meanHits = (double)qc->hits / perRound,
+               exact = qc->exactNs / perRound / 1e3, overlap = qc->overlap / perRound,
+               top1 = (double)qc->top1Agree / perRound;
+        textStr(&out, c ? ",\n    " : "\n    ");
+        textJsonString(&out, qc->name);
+        snprintf(num, sizeof(num),
+                 ": {\"count\": %ld, \"mean_us\": %.2f, \"p50_us\": %.2f, \"p90_us\": %.2f, "
+                 "\"p99_us\": %.2f, \"max_us\": %.2f, \"mean_hits\": %.2f, \"exact_mean_us\": %.2f, "
+                 "\"overlap_at_10\": %.4f, \"top1_agree\": %.4f}",
+                 perRound, mean, p50, p90, p99, max, meanHits, exact, overlap, top1);
+        textStr(&out, num);
+        fprintf(stderr, "%-8s %8ld %10.1f %10.1f %10.1f %10.1f %10.1f %8.2f %10.1f %8.4f %8.4f\n",
+                qc->name, perRound, mean, p50, p90, p99, max, meanHits, exact, overlap, top1);
+    }
+    textStr(&out, "}\n}\n");
+
+    FILE *f = fopen(outPath, "w");
+    if (!f || fwrite(out.s, 1, out.len, f) != out.len || fclose(f) != 0) { perror(outPath); return 1; }
+    fprintf(stderr, "Wrote %s\n", outPath);
+
+    free(out.s);
+    free(top);
+    free(topCount);
+    for (int c = 0; c < classCount; c++) free(classes[c].lat);
+    for (long i = 0; i < nQueries; i++) free(log[i].text);
+    free(log);
+    freeSegments();
+    freeQueryScratch();
+    freeStopWords();
+    return 0;
+}
@@ -0,0 +1,127 @@
+/* Microbenchmark: the mmap/SIMD tokenizer against the fgets + toLowerCase +
+   removePunctuation + strtok loop it replaced.
+
+   usage: bench_tokenize [file ...]    (default: 64 MB of synthetic text) */
+#include "../indexer.h"
+#include "../tokenizer.h"
+#include <time.h>
+#include <unistd.h>
+
+static double nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint64_t rng = 88172645463325252ULL;
+static uint64_t nextRand(void) {
+    rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+    return rng;
+}
+
+/* English-ish prose: mostly lowercase words, some capitalised or
+   punctuated, wrapped into lines of ~80 columns */
+static char *makeCorpus(size_t bytes) {
+    static const char *suffix[] = { "", "", "", "", ",", ".", "'s", ";", "!" };
+    char path[] = "/tmp/bench_tokenizeXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) { perror("mkstemp"); exit(1); }
+    FILE *f = fdopen(fd, "w");
+    size_t written = 0, col = 0;
+    while (written < bytes) {
+        char w[32];
+        int len = 2 + (int)(nextRand() % 9);
+        for (int k = 0; k < len; k++) w[k] = (char)('a' + nextRand() % 26);
+        if (nextRand() % 8 == 0) w[0] = (char)(w[0] - 'a' + 'A');
+        w[len] = '\0';
+        const char *sfx = suffix[nextRand() % 9];
+        int n = fprintf(f, "%s%s", w, sfx);
+        col += n;
+        if (col > 80) { fputc('\n', f); col = 0; } else fputc(' ', f);
+        written += n + 1;
+    }
+    fclose(f);
+    return strdup(path);
+}
+
+typedef struct Tally { size_t tokens, chars; } Tally;
+
+static void countToken(const char *tok, size_t len, size_t offset, void *ctx) {
+    (void)tok;
+    (void)offset;
+    Tally *t = ctx;
+    t->tokens++;
+    t->chars += len;
+}
+
+static Tally oldTokenize(const char *path) {
+    Tally t = { 0, 0 };
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return t; }
+    char buf[4096];
+    while (fgets(buf, sizeof(buf), f)) {
+        toLowerCase(buf);
+        removePunctuation(buf);
+        char *save = NULL;
+        for (char *tok = strtok_r(buf, " \t\r\n", &save); tok; tok = strtok_r(NULL, " \t\r\n", &save))
+            countToken(tok, strlen(tok), 0, &t);
+    }
+    fclose(f);
+    return t;
+}
+
+static size_t fileSize(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fclose(f);
+    return n > 0 ? (size_t)n : 0;
+}
+
+#define ROUNDS 5
+
+int main(int argc, char **argv) {
+    char *tmp = NULL;
+    const char **files = (const char **)argv + 1;
+    int nFiles = argc - 1;
+    if (nFiles == 0) {
+        tmp = makeCorpus((size_t)64 << 20);
+        files = (const char **)&tmp;
+        nFiles = 1;
+    }
+    size_t bytes = 0;
+    for (int i = 0; i < nFiles; i++) bytes += fileSize(files[i]);
+
+    /* warm the page cache so both sides measure CPU, not I/O */
+    for (int i = 0; i < nFiles; i++) oldTokenize(files[i]);
+
+    double bestOld = 1e300, bestNew = 1e300;
+    Tally old = { 0, 0 }, cur = { 0, 0 };
+    for (int r = 0; r < ROUNDS; r++) {
+        Tally a = { 0, 0 }, b = { 0, 0 };
+        double t0 = nowNs();
+        for (int i = 0; i < nFiles; i++) {
+            Tally t = oldTokenize(files[i]);
+            a.tokens += t.tokens; a.chars += t.chars;
+        }
+        double t1 = nowNs();
+        for (int i = 0; i < nFiles; i++) tokenizeFile(files[i], countToken, &b);
+        double t2 = nowNs();
+        if (t1 - t0 < bestOld) bestOld = t1 - t0;
+        if (t2 - t1 < bestNew) bestNew = t2 - t1;
+        old = a; cur = b;
+    }
+
+    printf("%zu bytes in %d file(s), best of %d\n", bytes, nFiles, ROUNDS);
+    printf("%10s %12s %12s %10s\n", "tokenizer", "tokens", "MB/s", "ns/token");
+    printf("%10s %12zu %12.1f %10.2f\n", "fgets", old.tokens,
+           bytes / (bestOld / 1e9) / 1e6, bestOld / (old.tokens ? old.tokens : 1));
+    printf("%10s %12zu %12.1f %10.2f\n", "mmap", cur.tokens,
+           bytes / (bestNew / 1e9) / 1e6, bestNew / (cur.tokens ? cur.tokens : 1));
+    if (old.tokens != cur.tokens || old.chars != cur.chars)
+        printf("note: token streams differ (%zu/%zu chars)\n", old.chars, cur.chars);
+
+    if (tmp) { unlink(tmp); free(tmp); }
+    return 0;
+}
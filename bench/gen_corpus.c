@@ -0,0 +1,120 @@
+/* Deterministic synthetic corpus: N documents whose words are drawn from a
+   Zipf-distributed vocabulary (rank r has weight 1/(r+1)^s), with lengths
+   uniform in [len/2, 3*len/2]. A few words are capitalised or carry
+   punctuation so the tokenizer has some work to do. The same flags and
+   seed always produce the same files. Documents go 1000 to a subfolder:
+   out/0000/d0000000.txt, out/0000/d0000001.txt, ...
+
+   usage: gen_corpus [-n docs] [-l avg_len] [-v vocab] [-s exponent] [--seed N] out_dir
+          (defaults: 100000 docs, 150 words, 50000 terms, s = 1.0, seed 1) */
+#include "../indexer.h"
+#include <errno.h>
+#include <sys/stat.h>
+
+static uint64_t rng;
+static uint64_t nextRand(void) {
+    rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+    return rng;
+}
+
+static double nextUnit(void) {
+    return (nextRand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Pronounceable words from consonant-vowel syllables, two or more per
+   word; numbers that spell a stop word are skipped so every term counts. */
+static char **makeVocabulary(int n) {
+    static const char cons[] = "bcdfghjklmnprstvwxyz", vowels[] = "aeiou";
+    char **words = malloc(sizeof(char *) * n);
+    if (!words) { perror("malloc"); exit(1); }
+    for (long c = 100, i = 0; i < n; c++) {
+        char w[32];
+        int len = 0;
+        for (long x = c; x > 0; x /= 100) {
+            w[len++] = cons[x % 100 / 5];
+            w[len++] = vowels[x % 5];
+        }
+        w[len] = '\0';
+        if (isStopWord(w)) continue;
+        words[i++] = strdup(w);
+    }
+    return words;
+}
+
+/* cumulative Zipf weights, normalised to end at 1 */
+static double *makeCdf(int n, double s) {
+    double *cdf = malloc(sizeof(double) * n);
+    if (!cdf) { perror("malloc"); exit(1); }
+    double sum = 0;
+    for (int r = 0; r < n; r++) cdf[r] = sum += 1.0 / pow(r + 1, s);
+    for (int r = 0; r < n; r++) cdf[r] /= sum;
+    return cdf;
+}
+
+static int sampleRank(const double *cdf, int n) {
+    double u = nextUnit();
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (cdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+int main(int argc, char **argv) {
+    long docs = 100000;
+    int avgLen = 150, vocab = 50000;
+    double s = 1.0;
+    const char *out = NULL;
+    rng = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) docs = atol(argv[++i]);
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) avgLen = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-v") == 0 && i + 1 < argc) vocab = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) s = atof(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) rng = strtoull(argv[++i], NULL, 10);
+        else if (argv[i][0] != '-' && !out) out = argv[i];
+        else out = NULL, i = argc;
+    }
+    if (!out || docs < 1 || avgLen < 2 || vocab < 1 || s <= 0) {
+        fprintf(stderr, "usage: %s [-n docs] [-l avg_len] [-v vocab] [-s exponent] [--seed N] out_dir\n", argv[0]);
+        return 1;
+    }
+    /* xorshift never leaves zero; spread small seeds over the state */
+    rng = rng * 0x9e3779b97f4a7c15ULL + 88172645463325252ULL;
+    if (rng == 0) rng = 88172645463325252ULL;
+
+    char **words = makeVocabulary(vocab);
+    double *cdf = makeCdf(vocab, s);
+    if (mkdir(out, 0755) != 0 && errno != EEXIST) { perror(out); return 1; }
+
+    size_t bytes = 0;
+    char path[4096];
+    for (long d = 0; d < docs; d++) {
+        if (d % 1000 == 0) {
+            snprintf(path, sizeof(path), "%s/%04ld", out, d / 1000);
+            if (mkdir(path, 0755) != 0 && errno != EEXIST) { perror(path); return 1; }
+        }
+        snprintf(path, sizeof(path), "%s/%04ld/d%07ld.txt", out, d / 1000, d);
+        FILE *f = fopen(path, "w");
+        if (!f) { perror(path); return 1; }
+        long len = avgLen / 2 + (long)(nextRand() % (uint64_t)(avgLen + 1));
+        for (long k = 0; k < len; k++) {
+            const char *w = words[sampleRank(cdf, vocab)];
+            uint64_t r = nextRand();
+            if (r % 20 == 0) bytes += fprintf(f, "%c%s", w[0] - 'a' + 'A', w + 1);
+            else bytes += fprintf(f, "%s", w);
+            if (r / 20 % 20 == 0) { fputc(",.;!?"[r / 400 % 5], f); bytes++; }
+            fputc(k % 12 == 11 || k == len - 1 ? '\n' : ' ', f);
+            bytes++;
+        }
+        fclose(f);
+    }
+    fprintf(stderr, "Wrote %ld docs, %.1f MB, to %s\n", docs, bytes / 1e6, out);
+
+    for (int i = 0; i < vocab; i++) free(words[i]);
+    free(words);
+    free(cdf);
+    return 0;
+}
@@ -0,0 +1,132 @@
+/* Query log for a corpus, one "class<TAB>query" line per query, in five
+   classes taken in turn:
+
+     term     w1
+     and      w1 AND w2 [AND w3]        all from one document
+     or       w1 OR w2 [OR w3]          from two documents
+     not      w1 AND w2 NOT w3          w3 from another document
+     phrase   "w1 w2 [w3]"              consecutive words of one document
+
+   Words are drawn from randomly chosen documents, so a query's terms
+   follow the corpus's own frequencies (a Zipf corpus gives a Zipf query
+   log) and most queries have hits. Deterministic for a given corpus and
+   seed.
+
+   usage: gen_queries [-n queries] [--seed N] corpus_dir > queries.tsv */
+#include "../indexer.h"
+#include "../tokenizer.h"
+
+static uint64_t rng;
+static uint64_t nextRand(void) {
+    rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+    return rng;
+}
+
+typedef struct Words {
+    char **w;
+    int n, cap;
+} Words;
+
+static void keepToken(const char *tok, size_t len, size_t offset, void *ctx) {
+    (void)offset;
+    Words *ws = ctx;
+    if (ws->n == ws->cap) {
+        ws->cap = ws->cap ? ws->cap * 2 : 256;
+        ws->w = realloc(ws->w, sizeof(char *) * ws->cap);
+        if (!ws->w) { perror("realloc"); exit(1); }
+    }
+    ws->w[ws->n++] = strndup(tok, len);
+}
+
+static void clearWords(Words *ws) {
+    for (int i = 0; i < ws->n; i++) free(ws->w[i]);
+    ws->n = 0;
+}
+
+/* the words of a random document that has at least min of them */
+static void randomDoc(char **files, int nFiles, Words *ws, int min) {
+    for (int tries = 0; tries < 100; tries++) {
+        clearWords(ws);
+        tokenizeFile(files[nextRand() % (uint64_t)nFiles], keepToken, ws);
+        if (ws->n >= min) return;
+    }
+    fprintf(stderr, "corpus documents are too short for phrase queries\n");
+    exit(1);
+}
+
+/* a random word of the document that is not a stop word (those would be
+   dropped from the query) */
+static const char *pick(const Words *ws) {
+    for (int tries = 0; tries < 32; tries++) {
+        const char *w = ws->w[nextRand() % (uint64_t)ws->n];
+        if (!isStopWord(w)) return w;
+    }
+    return ws->w[nextRand() % (uint64_t)ws->n];
+}
+
+int main(int argc, char **argv) {
+    long count = 5000;
+    const char *corpus = NULL;
+    rng = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) count = atol(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) rng = strtoull(argv[++i], NULL, 10);
+        else if (argv[i][0] != '-' && !corpus) corpus = argv[i];
+        else corpus = NULL, i = argc;
+    }
+    if (!corpus || count < 1) {
+        fprintf(stderr, "usage: %s [-n queries] [--seed N] corpus_dir > queries.tsv\n", argv[0]);
+        return 1;
+    }
+    rng = rng * 0x9e3779b97f4a7c15ULL + 88172645463325252ULL;
+    if (rng == 0) rng = 88172645463325252ULL;
+
+    int nFiles = 0;
+    char **files = listDocumentFiles(corpus, &nFiles);
+    if (nFiles == 0) { fprintf(stderr, "%s: no .txt files\n", corpus); return 1; }
+
+    Words a = { 0 }, b = { 0 };
+    for (long q = 0; q < count; q++) {
+        int extra = (int)(nextRand() % 2);          /* two or three words */
+        switch (q % 5) {
+        case 0:
+            randomDoc(files, nFiles, &a, 1);
+            printf("term\t%s\n", pick(&a));
+            break;
+        case 1:
+            randomDoc(files, nFiles, &a, 1);
+            printf("and\t%s AND %s", pick(&a), pick(&a));
+            if (extra) printf(" AND %s", pick(&a));
+            putchar('\n');
+            break;
+        case 2:
+            randomDoc(files, nFiles, &a, 1);
+            randomDoc(files, nFiles, &b, 1);
+            printf("or\t%s OR %s", pick(&a), pick(&b));
+            if (extra) printf(" OR %s", pick(&b));
+            putchar('\n');
+            break;
+        case 3:
+            randomDoc(files, nFiles, &a, 1);
+            randomDoc(files, nFiles, &b, 1);
+            printf("not\t%s AND %s NOT %s\n", pick(&a), pick(&a), pick(&b));
+            break;
+        default: {
+            randomDoc(files, nFiles, &a, 3);
+            int at = (int)(nextRand() % (uint64_t)(a.n - 2 - extra + 1));
+            printf("phrase\t\"%s %s", a.w[at], a.w[at + 1]);
+            if (extra) printf(" %s", a.w[at + 2]);
+            printf("\"\n");
+            break;
+        }
+        }
+    }
+
+    clearWords(&a);
+    clearWords(&b);
+    free(a.w);
+    free(b.w);
+    for (int i = 0; i < nFiles; i++) free(files[i]);
+    free(files);
+    return 0;
+}
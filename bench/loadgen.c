@@ -0,0 +1,197 @@
+/* Load generator for the query server: C connections each keep one query
+   in flight (send a line, wait for the reply line, send the next), drawing
+   queries round-robin from a file. Reports throughput and latency
+   percentiles over all replies.
+
+   usage: loadgen (-u socket_path | -p port) [-c connections] [-n requests] queries.txt */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef struct Client {
+    int fd;
+    double sentAt;
+    char *out;              /* rest of the request being sent */
+    size_t outLen;
+    char in[65536];         /* a reply line is well under this, even with snippets */
+    size_t inLen;
+} Client;
+
+static char **queries;
+static int queryCount;
+static long nextQuery;
+
+static double nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void loadQueries(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); exit(1); }
+    char line[8192];
+    int cap = 0;
+    while (fgets(line, sizeof(line), f)) {
+        size_t len = strcspn(line, "\r\n");
+        if (len == 0) continue;
+        if (queryCount == cap) {
+            cap = cap ? cap * 2 : 1024;
+            queries = realloc(queries, sizeof(char *) * cap);
+            if (!queries) { perror("realloc"); exit(1); }
+        }
+        line[len] = '\n';
+        queries[queryCount] = strndup(line, len + 1);
+        queryCount++;
+    }
+    fclose(f);
+    if (queryCount == 0) { fprintf(stderr, "%s: no queries\n", path); exit(1); }
+}
+
+static int connectTo(const char *path, int port) {
+    int fd;
+    if (path) {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) { perror(path); exit(1); }
+    } else {
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) { perror("connect"); exit(1); }
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+/* Write as much of the pending request as the socket takes. */
+static int pump(Client *c) {
+    while (c->outLen > 0) {
+        ssize_t n = send(c->fd, c->out, c->outLen, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n < 0) { perror("send"); return -1; }
+        c->out += n;
+        c->outLen -= (size_t)n;
+    }
+    return 0;
+}
+
+static int sendNext(Client *c) {
+    const char *q = queries[nextQuery++ % queryCount];
+    c->out = (char *)q;
+    c->outLen = strlen(q);
+    c->sentAt = nowUs();
+    return pump(c);
+}
+
+static int cmpDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double *sorted, long n, double p) {
+    long i = (long)(p * (double)(n - 1) + 0.5);
+    return sorted[i < n ? i : n - 1];
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL, *queryFile = NULL;
+    int port = 0, nconns = 64;
+    long total = 100000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) path = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) port = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) nconns = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) total = atol(argv[++i]);
+        else if (argv[i][0] != '-' && !queryFile) queryFile = argv[i];
+        else queryFile = NULL, i = argc;
+    }
+    if ((!path && port <= 0) || !queryFile || nconns < 1 || total < 1) {
+        fprintf(stderr, "usage: %s (-u socket_path | -p port) [-c connections] [-n requests] queries.txt\n", argv[0]);
+        return 1;
+    }
+    loadQueries(queryFile);
+
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    Client *clients = calloc(nconns, sizeof(Client));
+    double *lat = malloc(sizeof(double) * total);
+    if (epfd < 0 || !clients || !lat) { perror("setup"); return 1; }
+    long sent = 0, done = 0, errors = 0;
+    double start = nowUs();
+    for (int i = 0; i < nconns; i++) {
+        Client *c = &clients[i];
+        c->fd = connectTo(path, port);
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLET, .data.ptr = c };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+        if (sent < total) {
+            sent++;
+            if (sendNext(c) != 0) return 1;
+        }
+    }
+
+    struct epoll_event events[256];
+    while (done < total) {
+        int n = epoll_wait(epfd, events, 256, -1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) { perror("epoll_wait"); return 1; }
+        for (int e = 0; e < n; e++) {
+            Client *c = events[e].data.ptr;
+            if ((events[e].events & EPOLLOUT) && pump(c) != 0) return 1;
+            if (!(events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) continue;
+            for (;;) {
+                ssize_t r = recv(c->fd, c->in + c->inLen, sizeof(c->in) - c->inLen, 0);
+                if (r < 0 && errno == EINTR) continue;
+                if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                if (r <= 0) { fprintf(stderr, "server closed a connection\n"); return 1; }
+                c->inLen += (size_t)r;
+                char *nl;
+                while ((nl = memchr(c->in, '\n', c->inLen)) != NULL) {
+                    size_t len = (size_t)(nl - c->in) + 1;
+                    if (done < total) lat[done++] = nowUs() - c->sentAt;
+                    if (memmem(c->in, len, "\"error\"", 7)) errors++;
+                    memmove(c->in, c->in + len, c->inLen - len);
+                    c->inLen -= len;
+                    if (sent < total) {
+                        sent++;
+                        if (sendNext(c) != 0) return 1;
+                    }
+                }
+                if (c->inLen == sizeof(c->in)) { fprintf(stderr, "reply line too long\n"); return 1; }
+            }
+        }
+    }
+    double elapsed = (nowUs() - start) / 1e6;
+
+    qsort(lat, done, sizeof(double), cmpDouble);
+    printf("requests   %ld over %d connection(s), %ld error(s)\n", done, nconns, errors);
+    printf("elapsed    %.2f s\n", elapsed);
+    printf("throughput %.0f queries/s\n", done / elapsed);
+    printf("latency    p50 %.0f us  p99 %.0f us  p999 %.0f us  max %.0f us\n",
+           percentile(lat, done, 0.50), percentile(lat, done, 0.99),
+           percentile(lat, done, 0.999), lat[done - 1]);
+    for (int i = 0; i < nconns; i++) close(clients[i].fd);
+    close(epfd);
+    free(clients);
+    free(lat);
+    for (int i = 0; i < queryCount; i++) free(queries[i]);
+    free(queries);
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_SKETCH_SIZE 4096      /* admission counters (power of two) */
+
+static uint64_t cacheHash(const unsigned char *key, size_t len) {
+    uint64_t h = 1469598103934665603ULL;    /* FNV-1a */
+    for (size_t i = 0; i < len; i++) {
+        h ^= key[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static size_t entrySize(size_t keyLen, size_t valLen) {
+    return sizeof(CacheEntry) + ((valLen + 15) & ~(size_t)15) + keyLen;
+}
+
+static const unsigned char *entryKey(const CacheEntry *e) {
+    return e->data + ((e->valLen + 15) & ~(size_t)15);
+}
+
+void initCache(LruCache *c, size_t capacity, int admitAfter) {
+    memset(c, 0, sizeof(*c));
+    pthread_mutex_init(&c->lock, NULL);
+    c->stats.capacity = capacity;
+    c->admitAfter = admitAfter;
+    if (capacity == 0) return;
+    c->bucketMask = 255;
+    c->buckets = calloc(c->bucketMask + 1, sizeof(CacheEntry *));
+    if (!c->buckets) { perror("calloc"); exit(1); }
+    if (admitAfter > 1) {
+        c->sketchMask = CACHE_SKETCH_SIZE - 1;
+        c->sketch = calloc(CACHE_SKETCH_SIZE, 1);
+        if (!c->sketch) { perror("calloc"); exit(1); }
+    }
+}
+
+static void unlinkLru(LruCache *c, CacheEntry *e) {
+    if (e->prev) e->prev->next = e->next; else c->head = e->next;
+    if (e->next) e->next->prev = e->prev; else c->tail = e->prev;
+}
+
+static void pushFront(LruCache *c, CacheEntry *e) {
+    e->prev = NULL;
+    e->next = c->head;
+    if (c->head) c->head->prev = e; else c->tail = e;
+    c->head = e;
+}
+
+static void removeEntry(LruCache *c, CacheEntry *e) {
+    CacheEntry **pp = &c->buckets[e->hash & c->bucketMask];
+    while (*pp != e) pp = &(*pp)->hnext;
+    *pp = e->hnext;
+    unlinkLru(c, e);
+    c->stats.bytes -= entrySize(e->keyLen, e->valLen);
+    c->stats.entries--;
+    free(e);
+}
+
+static CacheEntry *findEntry(LruCache *c, uint64_t h, const void *key, size_t keyLen) {
+    for (CacheEntry *e = c->buckets[h & c->bucketMask]; e; e = e->hnext)
+        if (e->hash == h && e->keyLen == keyLen && memcmp(entryKey(e), key, keyLen) == 0) return e;
+    return NULL;
+}
+
+static void growBuckets(LruCache *c) {
+    uint32_t mask = c->bucketMask * 2 + 1;
+    CacheEntry **b = calloc((size_t)mask + 1, sizeof(CacheEntry *));
+    if (!b) { perror("calloc"); exit(1); }
+    for (uint32_t i = 0; i <= c->bucketMask; i++) {
+        CacheEntry *e = c->buckets[i];
+        while (e) {
+            CacheEntry *next = e->hnext;
+            e->hnext = b[e->hash & mask];
+            b[e->hash & mask] = e;
+            e = next;
+        }
+    }
+    free(c->buckets);
+    c->buckets = b;
+    c->bucketMask = mask;
+}
+
+/* Count one more sighting of h; returns 1 once it has been seen admitAfter
+   times. Counters are halved every few thousand sightings so keys that
+   were popular long ago stop looking frequent. */
+static int admit(LruCache *c, uint64_t h) {
+    if (!c->sketch) return 1;
+    uint8_t *a = &c->sketch[h & c->sketchMask];
+    uint8_t *b = &c->sketch[(h >> 32) & c->sketchMask];
+    if (*a < 255) (*a)++;
+    if (*b < 255) (*b)++;
+    if (++c->sketchAdds >= (c->sketchMask + 1) * 4) {
+        for (uint32_t i = 0; i <= c->sketchMask; i++) c->sketch[i] >>= 1;
+        c->sketchAdds = 0;
+    }
+    return (*a < *b ? *a : *b) >= c->admitAfter;
+}
+
+void *cacheGet(LruCache *c, const void *key, size_t keyLen, uint64_t generation, Arena *arena, size_t *len) {
+    if (c->stats.capacity == 0) return NULL;    /* fixed at init, so no lock needed */
+    uint64_t h = cacheHash(key, keyLen);
+    void *out = NULL;
+    pthread_mutex_lock(&c->lock);
+    CacheEntry *e = findEntry(c, h, key, keyLen);
+    if (e && e->generation != generation) {
+        removeEntry(c, e);
+        c->stats.stale++;
+        e = NULL;
+    }
+    if (e) {
+        unlinkLru(c, e);
+        pushFront(c, e);
+        out = arenaAlloc(arena, e->valLen);
+        memcpy(out, e->data, e->valLen);
+        *len = e->valLen;
+        c->stats.hits++;
+    } else {
+        c->stats.misses++;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return out;
+}
+
+void cachePut(LruCache *c, const void *key, size_t keyLen, uint64_t generation, const void *val, size_t len) {
+    if (c->stats.capacity == 0) return;
+    uint64_t h = cacheHash(key, keyLen);
+    size_t size = entrySize(keyLen, len);
+    pthread_mutex_lock(&c->lock);
+    /* one entry may not take more than an eighth of the cache */
+    if (size > c->stats.capacity / 8 || !admit(c, h)) {
+        c->stats.rejected++;
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+    CacheEntry *old = findEntry(c, h, key, keyLen);
+    if (old) removeEntry(c, old);
+    while (c->tail && c->stats.bytes + size > c->stats.capacity) {
+        removeEntry(c, c->tail);
+        c->stats.evictions++;
+    }
+    CacheEntry *e = malloc(size);
+    if (!e) { perror("malloc"); exit(1); }
+    e->hash = h;
+    e->generation = generation;
+    e->keyLen = (uint32_t)keyLen;
+    e->valLen = len;
+    memcpy(e->data, val, len);
+    memcpy((unsigned char *)entryKey(e), key, keyLen);
+    if (c->stats.entries > c->bucketMask) growBuckets(c);
+    e->hnext = c->buckets[h & c->bucketMask];
+    c->buckets[h & c->bucketMask] = e;
+    pushFront(c, e);
+    c->stats.bytes += size;
+    c->stats.entries++;
+    pthread_mutex_unlock(&c->lock);
+}
+
+void cacheClear(LruCache *c) {
+    pthread_mutex_lock(&c->lock);
+    while (c->tail) removeEntry(c, c->tail);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void cacheStats(LruCache *c, CacheStats *out) {
+    pthread_mutex_lock(&c->lock);
+    *out = c->stats;
+    pthread_mutex_unlock(&c->lock);
+}
+
+void freeCache(LruCache *c) {
+    if (c->buckets) cacheClear(c);
+    free(c->buckets);
+    free(c->sketch);
+    pthread_mutex_destroy(&c->lock);
+    memset(c, 0, sizeof(*c));
+}
@@ -0,0 +1,63 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "arena.h"
+
+/* ---------------- Byte-bounded LRU cache ----------------
+   Keys are byte strings, values are opaque blobs copied in and out, and
+   every entry is tagged with the index generation it was computed against:
+   a lookup under a different generation drops the entry instead of
+   returning it. Entries are charged their full size (header, key, value)
+   against the byte budget; the least recently used go first.
+
+   With admitAfter > 1 a key is only stored once a small counting sketch
+   has seen it that many times, so one-off keys don't flush frequent ones.
+   All operations take the cache's mutex, so one cache can be shared by
+   query threads. */
+
+typedef struct CacheEntry {
+    struct CacheEntry *hnext;       /* hash chain */
+    struct CacheEntry *prev, *next; /* LRU list, most recent at head */
+    uint64_t hash;
+    uint64_t generation;
+    uint32_t keyLen;
+    size_t valLen;
+    _Alignas(16) unsigned char data[];  /* value, then key */
+} CacheEntry;
+
+typedef struct CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;     /* dropped to make room */
+    uint64_t stale;         /* dropped because the index generation changed */
+    uint64_t rejected;      /* puts refused by admission or size */
+    uint32_t entries;
+    size_t bytes;
+    size_t capacity;
+} CacheStats;
+
+typedef struct LruCache {
+    pthread_mutex_t lock;
+    CacheEntry **buckets;
+    uint32_t bucketMask;
+    CacheEntry *head, *tail;
+    int admitAfter;
+    uint8_t *sketch;        /* admission counts, halved as they age */
+    uint32_t sketchMask;
+    uint32_t sketchAdds;
+    CacheStats stats;
+} LruCache;
+
+/* capacity 0 leaves the cache disabled (every get misses, puts are dropped) */
+void initCache(LruCache *c, size_t capacity, int admitAfter);
+/* Copy of the value for key in arena (NULL on a miss); *len gets its size. */
+void *cacheGet(LruCache *c, const void *key, size_t keyLen, uint64_t generation, Arena *arena, size_t *len);
+void cachePut(LruCache *c, const void *key, size_t keyLen, uint64_t generation, const void *val, size_t len);
+void cacheClear(LruCache *c);
+void cacheStats(LruCache *c, CacheStats *out);
+void freeCache(LruCache *c);
+
+#endif
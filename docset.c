@@ -0,0 +1,443 @@
+#include "docset.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Build with -DDOCSET_SCALAR to force the portable kernels. */
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(DOCSET_SCALAR)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+#define BITMAP_BYTES (SET_BITMAP_WORDS * sizeof(uint64_t))
+
+/* ---------------- Bitmap kernels ----------------
+   out = a op b over a whole container, returning the popcount of out. */
+
+typedef uint64_t (*BitmapFn)(uint64_t *out, const uint64_t *a, const uint64_t *b);
+
+#define SCALAR_KERNEL(name, expr) \
+static uint64_t name(uint64_t *out, const uint64_t *a, const uint64_t *b) { \
+    uint64_t card = 0; \
+    for (int i = 0; i < SET_BITMAP_WORDS; i++) { \
+        uint64_t w = (expr); \
+        out[i] = w; \
+        card += (uint64_t)__builtin_popcountll(w); \
+    } \
+    return card; \
+}
+
+SCALAR_KERNEL(andScalar, a[i] & b[i])
+SCALAR_KERNEL(orScalar, a[i] | b[i])
+SCALAR_KERNEL(andNotScalar, a[i] & ~b[i])
+
+#ifdef HAVE_X86
+/* per-64-bit-lane popcounts: nibble lookup with pshufb, summed by psadbw */
+__attribute__((target("avx2")))
+static inline __m256i popcount256(__m256i v) {
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, nibble));
+    __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    return _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256());
+}
+
+#define AVX2_KERNEL(name, expr) \
+__attribute__((target("avx2"))) \
+static uint64_t name(uint64_t *out, const uint64_t *a, const uint64_t *b) { \
+    __m256i acc = _mm256_setzero_si256(); \
+    for (int i = 0; i < SET_BITMAP_WORDS; i += 4) { \
+        __m256i x = _mm256_loadu_si256((const __m256i *)(a + i)); \
+        __m256i y = _mm256_loadu_si256((const __m256i *)(b + i)); \
+        __m256i w = (expr); \
+        _mm256_storeu_si256((__m256i *)(out + i), w); \
+        acc = _mm256_add_epi64(acc, popcount256(w)); \
+    } \
+    return (uint64_t)_mm256_extract_epi64(acc, 0) + (uint64_t)_mm256_extract_epi64(acc, 1) \
+         + (uint64_t)_mm256_extract_epi64(acc, 2) + (uint64_t)_mm256_extract_epi64(acc, 3); \
+}
+
+AVX2_KERNEL(andAVX2, _mm256_and_si256(x, y))
+AVX2_KERNEL(orAVX2, _mm256_or_si256(x, y))
+AVX2_KERNEL(andNotAVX2, _mm256_andnot_si256(y, x))
+#endif
+
+static BitmapFn bitmapAnd = andScalar, bitmapOr = orScalar, bitmapAndNot = andNotScalar;
+
+static pthread_once_t kernelsOnce = PTHREAD_ONCE_INIT;
+
+static void pickKernels(void) {
+#ifdef HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        bitmapAnd = andAVX2;
+        bitmapOr = orAVX2;
+        bitmapAndNot = andNotAVX2;
+    }
+#endif
+}
+
+/* ---------------- Array kernels ---------------- */
+
+/* first i >= lo with A[i] >= target */
+static uint32_t lowerBound16(const uint16_t *A, uint32_t lo, uint32_t n, uint16_t target) {
+    while (lo < n) {
+        uint32_t mid = lo + (n - lo) / 2;
+        if (A[mid] < target) lo = mid + 1; else n = mid;
+    }
+    return lo;
+}
+
+/* a ∩ b into out (room for min(na, nb)). Each step compares a block of
+   eight from a with all eight rotations of a block from b, then advances
+   whichever block ends lower; the scalar merge finishes the tails. */
+static uint32_t intersect16(const uint16_t *a, uint32_t na, const uint16_t *b, uint32_t nb, uint16_t *out) {
+    uint32_t i = 0, j = 0, k = 0;
+    if (na > nb) { const uint16_t *t = a; a = b; b = t; uint32_t tn = na; na = nb; nb = tn; }
+    if ((uint64_t)na * 32 < nb) {
+        for (; i < na && j < nb; i++) {
+            j = lowerBound16(b, j, nb, a[i]);
+            if (j < nb && b[j] == a[i]) out[k++] = a[i];
+        }
+        return k;
+    }
+#ifdef HAVE_X86
+    while (i + 8 <= na && j + 8 <= nb) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + j));
+        __m128i eq = _mm_cmpeq_epi16(va, vb);
+        for (int r = 1; r < 8; r++) {
+            vb = _mm_or_si128(_mm_srli_si128(vb, 2), _mm_slli_si128(vb, 14));
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, vb));
+        }
+        unsigned m = (unsigned)_mm_movemask_epi8(eq);      /* two bits per lane */
+        while (m) {
+            int lane = __builtin_ctz(m) >> 1;
+            out[k++] = a[i + lane];
+            m &= ~(3u << (lane * 2));
+        }
+        uint16_t amax = a[i + 7], bmax = b[j + 7];
+        if (amax <= bmax) i += 8;
+        if (bmax <= amax) j += 8;
+    }
+#endif
+    while (i < na && j < nb) {
+        if (a[i] == b[j]) { out[k++] = a[i]; i++; j++; }
+        else if (a[i] < b[j]) i++; else j++;
+    }
+    return k;
+}
+
+static uint32_t union16(const uint16_t *a, uint32_t na, const uint16_t *b, uint32_t nb, uint16_t *out) {
+    uint32_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+        if (a[i] == b[j]) { out[k++] = a[i]; i++; j++; }
+        else if (a[i] < b[j]) out[k++] = a[i++]; else out[k++] = b[j++];
+    }
+    while (i < na) out[k++] = a[i++];
+    while (j < nb) out[k++] = b[j++];
+    return k;
+}
+
+static uint32_t difference16(const uint16_t *a, uint32_t na, const uint16_t *b, uint32_t nb, uint16_t *out) {
+    uint32_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+        if (a[i] == b[j]) { i++; j++; }
+        else if (a[i] < b[j]) out[k++] = a[i++];
+        else j++;
+    }
+    while (i < na) out[k++] = a[i++];
+    return k;
+}
+
+static inline int testBit(const uint64_t *bits, uint16_t v) {
+    return (int)((bits[v >> 6] >> (v & 63)) & 1);
+}
+
+/* the elements of a whose bit in bits is `keep` */
+static uint32_t filter16(const uint16_t *a, uint32_t na, const uint64_t *bits, int keep, uint16_t *out) {
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < na; i++) {
+        out[k] = a[i];
+        k += (uint32_t)(testBit(bits, a[i]) == keep);
+    }
+    return k;
+}
+
+static uint32_t extractBits(const uint64_t *bits, uint16_t *out) {
+    uint32_t k = 0;
+    for (int w = 0; w < SET_BITMAP_WORDS; w++) {
+        for (uint64_t x = bits[w]; x; x &= x - 1)
+            out[k++] = (uint16_t)(w * 64 + __builtin_ctzll(x));
+    }
+    return k;
+}
+
+/* ---------------- Containers ---------------- */
+
+static uint16_t *newArray(Arena *arena, uint32_t n) {
+    return arenaAlloc(arena, sizeof(uint16_t) * (n ? n : 1));
+}
+
+static SetContainer arrayContainer(uint32_t key, uint16_t *array, uint32_t card) {
+    SetContainer c = { key, card, array, NULL };
+    return c;
+}
+
+/* a bitmap result small enough for an array becomes one */
+static SetContainer fitContainer(Arena *arena, uint32_t key, uint64_t *bits, uint32_t card) {
+    SetContainer c = { key, card, NULL, bits };
+    if (card <= SET_ARRAY_MAX) {
+        c.array = newArray(arena, card);
+        extractBits(bits, c.array);
+        c.bits = NULL;
+    }
+    return c;
+}
+
+/* bits of src with the elements of a set (set = 1) or cleared (set = 0) */
+static SetContainer editBits(Arena *arena, uint32_t key, const SetContainer *src,
+                             const uint16_t *a, uint32_t na, int set) {
+    uint64_t *bits = arenaAlloc(arena, BITMAP_BYTES);
+    memcpy(bits, src->bits, BITMAP_BYTES);
+    int64_t card = src->card;
+    for (uint32_t i = 0; i < na; i++) {
+        uint64_t m = (uint64_t)1 << (a[i] & 63), *w = &bits[a[i] >> 6];
+        int had = (*w & m) != 0;
+        if (set) { card += !had; *w |= m; }
+        else { card -= had; *w &= ~m; }
+    }
+    return fitContainer(arena, key, bits, (uint32_t)card);
+}
+
+static SetContainer andContainers(Arena *arena, const SetContainer *a, const SetContainer *b) {
+    if (a->bits && b->bits) {
+        uint64_t *bits = arenaAlloc(arena, BITMAP_BYTES);
+        return fitContainer(arena, a->key, bits, (uint32_t)bitmapAnd(bits, a->bits, b->bits));
+    }
+    if (a->bits) { const SetContainer *t = a; a = b; b = t; }
+    uint16_t *out = newArray(arena, a->card < b->card ? a->card : b->card);
+    uint32_t n = b->bits ? filter16(a->array, a->card, b->bits, 1, out)
+                         : intersect16(a->array, a->card, b->array, b->card, out);
+    return arrayContainer(a->key, out, n);
+}
+
+static SetContainer orContainers(Arena *arena, const SetContainer *a, const SetContainer *b) {
+    if (a->bits && b->bits) {
+        uint64_t *bits = arenaAlloc(arena, BITMAP_BYTES);
+        SetContainer c = { a->key, (uint32_t)bitmapOr(bits, a->bits, b->bits), NULL, bits };
+        return c;
+    }
+    if (a->bits) return editBits(arena, a->key, a, b->array, b->card, 1);
+    if (b->bits) return editBits(arena, a->key, b, a->array, a->card, 1);
+    if (a->card + b->card <= SET_ARRAY_MAX) {
+        uint16_t *out = newArray(arena, a->card + b->card);
+        return arrayContainer(a->key, out, union16(a->array, a->card, b->array, b->card, out));
+    }
+    /* two arrays too big for one: a's bits, then b's */
+    SetContainer merged = { a->key, a->card, NULL, arenaAlloc(arena, BITMAP_BYTES) };
+    memset(merged.bits, 0, BITMAP_BYTES);
+    for (uint32_t i = 0; i < a->card; i++) merged.bits[a->array[i] >> 6] |= (uint64_t)1 << (a->array[i] & 63);
+    return editBits(arena, a->key, &merged, b->array, b->card, 1);
+}
+
+static SetContainer andNotContainers(Arena *arena, const SetContainer *a, const SetContainer *b) {
+    if (a->bits && b->bits) {
+        uint64_t *bits = arenaAlloc(arena, BITMAP_BYTES);
+        return fitContainer(arena, a->key, bits, (uint32_t)bitmapAndNot(bits, a->bits, b->bits));
+    }
+    if (a->bits) return editBits(arena, a->key, a, b->array, b->card, 0);
+    uint16_t *out = newArray(arena, a->card);
+    uint32_t n = b->bits ? filter16(a->array, a->card, b->bits, 0, out)
+                         : difference16(a->array, a->card, b->array, b->card, out);
+    return arrayContainer(a->key, out, n);
+}
+
+/* ---------------- Sets ---------------- */
+
+static DocSet *newSet(Arena *arena, uint32_t maxContainers) {
+    pthread_once(&kernelsOnce, pickKernels);
+    DocSet *s = arenaAlloc(arena, sizeof(DocSet));
+    s->c = arenaAlloc(arena, sizeof(SetContainer) * (maxContainers ? maxContainers : 1));
+    s->count = 0;
+    s->card = 0;
+    return s;
+}
+
+static void addContainer(DocSet *s, SetContainer c) {
+    if (c.card == 0) return;
+    s->c[s->count++] = c;
+    s->card += c.card;
+}
+
+DocSet *docSetRange(int docCount, Arena *arena) {
+    uint32_t n = docCount > 0 ? (uint32_t)(((uint64_t)docCount + 65535) >> 16) : 0;
+    DocSet *s = newSet(arena, n);
+    for (uint32_t key = 0; key < n; key++) {
+        uint32_t card = (uint32_t)docCount - (key << 16);
+        if (card > 65536) card = 65536;
+        if (card <= SET_ARRAY_MAX) {
+            uint16_t *array = newArray(arena, card);
+            for (uint32_t i = 0; i < card; i++) array[i] = (uint16_t)i;
+            addContainer(s, arrayContainer(key, array, card));
+            continue;
+        }
+        uint64_t *bits = arenaAlloc(arena, BITMAP_BYTES);
+        memset(bits, 0, BITMAP_BYTES);
+        memset(bits, 0xff, (card >> 6) * sizeof(uint64_t));
+        if (card & 63) bits[card >> 6] = ((uint64_t)1 << (card & 63)) - 1;
+        SetContainer c = { key, card, NULL, bits };
+        addContainer(s, c);
+    }
+    return s;
+}
+
+DocSet *docSetFromArray(const int *docs, int n, Arena *arena) {
+    uint32_t containers = n > 0 ? ((uint32_t)docs[n - 1] >> 16) - ((uint32_t)docs[0] >> 16) + 1 : 0;
+    DocSet *s = newSet(arena, containers);
+    for (int i = 0; i < n;) {
+        uint32_t key = (uint32_t)docs[i] >> 16;
+        int end = i;
+        while (end < n && (uint32_t)docs[end] >> 16 == key) end++;
+        uint32_t card = (uint32_t)(end - i);
+        if (card <= SET_ARRAY_MAX) {
+            uint16_t *array = newArray(arena, card);
+            for (uint32_t j = 0; j < card; j++) array[j] = (uint16_t)docs[i + j];
+            addContainer(s, arrayContainer(key, array, card));
+        } else {
+            SetContainer c = { key, card, NULL, arenaAlloc(arena, BITMAP_BYTES) };
+            memset(c.bits, 0, BITMAP_BYTES);
+            for (int j = i; j < end; j++) {
+                uint16_t v = (uint16_t)docs[j];
+                c.bits[v >> 6] |= (uint64_t)1 << (v & 63);
+            }
+            addContainer(s, c);
+        }
+        i = end;
+    }
+    return s;
+}
+
+DocSet *docSetAnd(const DocSet *a, const DocSet *b, Arena *arena) {
+    DocSet *s = newSet(arena, a->count < b->count ? a->count : b->count);
+    uint32_t i = 0, j = 0;
+    while (i < a->count && j < b->count) {
+        if (a->c[i].key < b->c[j].key) i++;
+        else if (a->c[i].key > b->c[j].key) j++;
+        else addContainer(s, andContainers(arena, &a->c[i++], &b->c[j++]));
+    }
+    return s;
+}
+
+DocSet *docSetOr(const DocSet *a, const DocSet *b, Arena *arena) {
+    DocSet *s = newSet(arena, a->count + b->count);
+    uint32_t i = 0, j = 0;
+    while (i < a->count && j < b->count) {
+        if (a->c[i].key < b->c[j].key) addContainer(s, a->c[i++]);
+        else if (a->c[i].key > b->c[j].key) addContainer(s, b->c[j++]);
+        else addContainer(s, orContainers(arena, &a->c[i++], &b->c[j++]));
+    }
+    while (i < a->count) addContainer(s, a->c[i++]);
+    while (j < b->count) addContainer(s, b->c[j++]);
+    return s;
+}
+
+DocSet *docSetAndNot(const DocSet *a, const DocSet *b, Arena *arena) {
+    DocSet *s = newSet(arena, a->count);
+    uint32_t j = 0;
+    for (uint32_t i = 0; i < a->count; i++) {
+        while (j < b->count && b->c[j].key < a->c[i].key) j++;
+        if (j < b->count && b->c[j].key == a->c[i].key) addContainer(s, andNotContainers(arena, &a->c[i], &b->c[j]));
+        else addContainer(s, a->c[i]);
+    }
+    return s;
+}
+
+int *docSetToArray(const DocSet *s, Arena *arena, int *n) {
+    int *out = arenaAlloc(arena, sizeof(int) * (s->card ? s->card : 1));
+    size_t k = 0;
+    for (uint32_t i = 0; i < s->count; i++) {
+        const SetContainer *c = &s->c[i];
+        int base = (int)(c->key << 16);
+        if (c->array) {
+            for (uint32_t j = 0; j < c->card; j++) out[k++] = base + c->array[j];
+            continue;
+        }
+        for (int w = 0; w < SET_BITMAP_WORDS; w++) {
+            for (uint64_t x = c->bits[w]; x; x &= x - 1)
+                out[k++] = base + w * 64 + __builtin_ctzll(x);
+        }
+    }
+    *n = (int)k;
+    return out;
+}
+
+/* ---------------- Term sets ---------------- */
+
+struct TermSets {
+    pthread_mutex_t lock;               /* serializes builds */
+    Arena arena;                        /* every built set */
+    int built;
+    _Atomic(const DocSet *) *sets;      /* by term; NULL until built */
+};
+
+struct TermSets *newTermSets(uint32_t termCount) {
+    struct TermSets *ts = calloc(1, sizeof(struct TermSets));
+    if (ts) ts->sets = calloc(termCount ? termCount : 1, sizeof(*ts->sets));
+    if (!ts || !ts->sets) { perror("calloc"); exit(1); }
+    pthread_mutex_init(&ts->lock, NULL);
+    return ts;
+}
+
+void freeTermSets(struct TermSets *ts) {
+    if (!ts) return;
+    pthread_mutex_destroy(&ts->lock);
+    freeArena(&ts->arena);
+    free(ts->sets);
+    free(ts);
+}
+
+int termIsDense(const Index *idx, const TermRecord *t) {
+    return t->docFrequency >= DENSE_MIN_DOCS
+        && (uint64_t)t->docFrequency * DENSE_FRACTION >= (uint64_t)indexDocCount(idx);
+}
+
+const DocSet *termDocSet(const Index *idx, const TermRecord *t, uint64_t *decoded) {
+    *decoded = 0;
+    if (!termIsDense(idx, t)) return NULL;
+    struct TermSets *ts = idx->termSets;
+    _Atomic(const DocSet *) *slot = &ts->sets[t - idx->terms];
+    const DocSet *s = atomic_load_explicit(slot, memory_order_acquire);
+    if (s) return s;
+
+    pthread_mutex_lock(&ts->lock);
+    s = atomic_load_explicit(slot, memory_order_relaxed);
+    if (!s) {
+        int *docs = malloc(sizeof(int) * t->docFrequency);
+        if (!docs) { perror("malloc"); exit(1); }
+        PostingCursor c;
+        openPostings(idx, t, &c);
+        int n = 0;
+        while (n < (int)t->docFrequency && nextPosting(&c)) docs[n++] = c.docId;
+        *decoded = c.decoded;
+        closePostings(&c);
+        s = docSetFromArray(docs, n, &ts->arena);
+        free(docs);
+        ts->built++;
+        atomic_store_explicit(slot, s, memory_order_release);
+    }
+    pthread_mutex_unlock(&ts->lock);
+    return s;
+}
+
+size_t termSetBytes(const Index *idx, int *sets) {
+    struct TermSets *ts = idx->termSets;
+    pthread_mutex_lock(&ts->lock);
+    size_t bytes = ts->arena.bytes;
+    *sets = ts->built;
+    pthread_mutex_unlock(&ts->lock);
+    return bytes;
+}
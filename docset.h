@@ -0,0 +1,68 @@
+#ifndef DOCSET_H
+#define DOCSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "store.h"
+
+/* ---------------- DocId sets ----------------
+   Compressed sets for the boolean operators over common terms. DocIds are
+   split by their high 16 bits into containers; a container holding up to
+   SET_ARRAY_MAX docs is a sorted array of the low halves, a fuller one is
+   a 65536-bit bitmap (8 KB), so a set never costs more than ~2 bytes per
+   doc and a dense one costs one bit. AND, OR and AND NOT go container by
+   container: two bitmaps combine 256 bits per AVX2 instruction (picked at
+   runtime, 64 per step otherwise), two arrays intersect eight against eight
+   with SSE2 compares, and an array against a bitmap tests bits.
+
+   Operations never modify their inputs and may share containers with them,
+   so results are read-only like the inputs. Everything but the per-index
+   term sets lives in the caller's arena. */
+
+#define SET_ARRAY_MAX 4096          /* beyond this a bitmap is smaller */
+#define SET_BITMAP_WORDS 1024       /* 65536 bits */
+
+typedef struct SetContainer {
+    uint32_t key;           /* docId >> 16 */
+    uint32_t card;
+    uint16_t *array;        /* card sorted low halves; NULL for a bitmap */
+    uint64_t *bits;         /* SET_BITMAP_WORDS words; NULL for an array */
+} SetContainer;
+
+typedef struct DocSet {
+    SetContainer *c;        /* ascending keys, none empty */
+    uint32_t count;
+    uint64_t card;
+} DocSet;
+
+DocSet *docSetRange(int docCount, Arena *arena);            /* 0 .. docCount-1 */
+DocSet *docSetFromArray(const int *docs, int n, Arena *arena);
+DocSet *docSetAnd(const DocSet *a, const DocSet *b, Arena *arena);
+DocSet *docSetOr(const DocSet *a, const DocSet *b, Arena *arena);
+DocSet *docSetAndNot(const DocSet *a, const DocSet *b, Arena *arena);
+int *docSetToArray(const DocSet *s, Arena *arena, int *n);
+
+/* ---------------- Term sets ----------------
+   Each index keeps the set of every dense term (in at least
+   DENSE_MIN_DOCS docs and 1/DENSE_FRACTION of the index) once a query has
+   asked for it. Building costs one pass over the postings; after that the
+   term is never decoded for a boolean operator again. Built sets are
+   published with a release store and never change, so readers take no
+   lock. */
+
+#define DENSE_MIN_DOCS 1024
+#define DENSE_FRACTION 64
+
+struct TermSets;
+
+struct TermSets *newTermSets(uint32_t termCount);
+void freeTermSets(struct TermSets *ts);
+int termIsDense(const Index *idx, const TermRecord *t);
+/* t's set, or NULL if t is not dense; *decoded gets the postings decoded
+   to build it (0 when it was already built) */
+const DocSet *termDocSet(const Index *idx, const TermRecord *t, uint64_t *decoded);
+/* sets built so far and their bytes */
+size_t termSetBytes(const Index *idx, int *sets);
+
+#endif
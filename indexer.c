@@ -1,25 +1,97 @@
 #include "indexer.h"
+#include "tokenizer.h"
+#include "stopwords.h"
+#include "stopwords_gen.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
 
-/* Stop words list */
-const char *STOP_WORDS[] = {
-    "the", "is", "at", "which", "on", "a", "an", "and", "or", "but",
-    "in", "with", "to", "for", "of", "as", "by", "that", "this",
-    "it", "from", "be", "are", "was", "were", "been", "have", "has",
-    NULL
-};
+/* Active stop words: the compiled-in set unless a custom list was loaded. */
+static const StopSet *stopSet = &defaultStopSet;
+static StopSet customStopSet;
 
-DocInfo documents[MAX_DOCS];
+DocInfo *documents = NULL;
 int docCount = 0;
+static int docCap = 0;
+static Arena namePool;
+
+/* Append a document to the growable table; returns its docId. */
+int addDocument(const char *filename) {
+    if (docCount == docCap) {
+        docCap = docCap ? docCap * 2 : 1024;
+        documents = realloc(documents, sizeof(DocInfo) * docCap);
+        if (!documents) { perror("realloc"); exit(1); }
+    }
+    documents[docCount].filename = arenaStrdup(&namePool, filename, strlen(filename));
+    documents[docCount].totalTerms = 0;
+    return docCount++;
+}
+
+void freeDocuments(void) {
+    free(documents);
+    documents = NULL;
+    docCount = docCap = 0;
+    freeArena(&namePool);
+}
 
 /* Check if a word is a stop word */
 int isStopWord(const char *word) {
-    if (!word || word[0] == '\0') return 1;
-    for (int i = 0; STOP_WORDS[i] != NULL; i++) {
-        if (strcmp(word, STOP_WORDS[i]) == 0) return 1;
+    if (!word) return 1;
+    return isStopWordLen(word, strlen(word));
+}
+
+/* Same check for a span that is not NUL-terminated (tokenizer output). */
+int isStopWordLen(const char *word, size_t len) {
+    return len == 0 || stopSetHas(stopSet, word, len);
+}
+
+/* Switch to the stop-word list in text (see buildStopSet for the format).
+   A list equal to the built-in one goes back to the compiled set. */
+int setStopWords(const char *text, size_t len) {
+    StopSet s;
+    if (buildStopSet(&s, text, len) != 0) return -1;
+    if (s.textLen == defaultStopSet.textLen && memcmp(s.text, defaultStopSet.text, s.textLen) == 0) {
+        freeStopSet(&s);
+        freeStopWords();
+        return 0;
     }
+    freeStopSet(&customStopSet);
+    customStopSet = s;
+    stopSet = &customStopSet;
     return 0;
 }
 
+int loadStopWords(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) { perror(path); return -1; }
+    size_t cap = 4096, len = 0, r;
+    char *text = malloc(cap);
+    if (!text) { perror("malloc"); exit(1); }
+    while ((r = fread(text + len, 1, cap - len, f)) > 0) {
+        len += r;
+        if (len == cap) {
+            text = realloc(text, cap *= 2);
+            if (!text) { perror("realloc"); exit(1); }
+        }
+    }
+    fclose(f);
+    int rc = setStopWords(text, len);
+    if (rc != 0) fprintf(stderr, "%s: could not build a stop-word table\n", path);
+    free(text);
+    return rc;
+}
+
+/* The active list, normalized and '\n'-separated (stored in index images). */
+const char *stopWordsText(size_t *len) {
+    *len = stopSet->textLen;
+    return stopSet->text;
+}
+
+void freeStopWords(void) {
+    stopSet = &defaultStopSet;
+    freeStopSet(&customStopSet);
+}
+
 void toLowerCase(char *str) {
     for (int i = 0; str[i]; i++) str[i] = (char)tolower((unsigned char)str[i]);
 }
@@ -34,164 +106,467 @@ void removePunctuation(char *str) {
     str[j] = '\0';
 }
 
-/* djb2 hash */
-unsigned long hashFunc(const char *str) {
-    unsigned long hash = 5381;
-    int c;
-    while ((c = (unsigned char)*str++))
-        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
-    return hash % HASH_SIZE;
+/* FNV-1a, folded to 32 bits; the table keeps it per slot */
+uint32_t hashWord(const char *str, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 1099511628211ULL;
+    }
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static int keepPos = 1;
+
+void setKeepPositions(int on) {
+    keepPos = on;
+}
+
+int keepPositions(void) {
+    return keepPos;
 }
 
-/* create DocNode */
-static DocNode *createDocNode(int docId, int position) {
-    DocNode *d = malloc(sizeof(DocNode));
-    if (!d) { perror("malloc"); exit(1); }
+static DocNode *createDocNode(Arena *arena, int docId) {
+    DocNode *d = arenaAlloc(arena, sizeof(DocNode));
     d->docId = docId;
     d->frequency = 0;
     d->positions = NULL;
     d->posCount = 0;
     d->posCap = 0;
     d->next = NULL;
-    if (position >= 0) {
-        d->posCap = 8;
-        d->positions = malloc(d->posCap * sizeof(int));
-        d->positions[0] = position;
-        d->posCount = 1;
-        d->frequency = 1;
-    }
     return d;
 }
 
-static void appendPosition(DocNode *d, int pos) {
+/* Count one occurrence. Most terms occur once or twice per doc, so
+   positions start small and double in place while they are the newest
+   allocation; the offsets share it, behind the positions, and move up
+   when it grows. Without positions only the count is kept. */
+static void addOccurrence(Arena *arena, DocNode *d, int pos, uint32_t offset) {
+    d->frequency++;
+    if (!keepPos) return;
     if (d->posCount + 1 > d->posCap) {
-        int nc = d->posCap == 0 ? 8 : d->posCap * 2;
-        d->positions = realloc(d->positions, nc * sizeof(int));
+        int nc = d->posCap == 0 ? 2 : d->posCap * 2;
+        size_t each = sizeof(int) + sizeof(uint32_t);
+        d->positions = arenaGrow(arena, d->positions, d->posCap * each, nc * each);
+        memmove(d->positions + nc, d->positions + d->posCap, d->posCount * sizeof(uint32_t));
         d->posCap = nc;
     }
+    docNodeOffsets(d)[d->posCount] = offset;
     d->positions[d->posCount++] = pos;
-    d->frequency++;
 }
 
-/* Add or update posting list for a word entry */
-static void addOrUpdateDocList(WordEntry *entry, int docId, int position) {
-    DocNode *cur = entry->docList;
-    while (cur) {
-        if (cur->docId == docId) {
-            appendPosition(cur, position);
-            return;
-        }
-        cur = cur->next;
+/* Add or update posting list for a word entry. Documents are indexed in
+   increasing docId order, so only the tail can already hold docId. */
+static void addOrUpdateDocList(Arena *arena, WordEntry *entry, int docId, int position, uint32_t offset) {
+    if (entry->lastDoc && entry->lastDoc->docId == docId) {
+        addOccurrence(arena, entry->lastDoc, position, offset);
+        return;
     }
-    /* not found -> create at head */
-    DocNode *newD = createDocNode(docId, position);
-    newD->next = entry->docList;
-    entry->docList = newD;
+    /* not found -> append at tail, keeping the list sorted */
+    DocNode *newD = createDocNode(arena, docId);
+    addOccurrence(arena, newD, position, offset);
+    if (entry->lastDoc) entry->lastDoc->next = newD;
+    else entry->docList = newD;
+    entry->lastDoc = newD;
     entry->docFrequency++;
 }
 
-/* Insert word into hash table (or update existing). */
-WordEntry *insertWordHash(WordEntry **hashTable, const char *word, int docId, int position) {
-    unsigned long h = hashFunc(word);
-    WordEntry *cur = hashTable[h];
-    while (cur) {
-        if (strcmp(cur->word, word) == 0) {
-            addOrUpdateDocList(cur, docId, position);
-            return cur;
+#define TABLE_INITIAL_SLOTS 1024
+
+TermTable *createTermTable(void) {
+    TermTable *t = calloc(1, sizeof(TermTable));
+    if (!t) { perror("calloc"); exit(1); }
+    t->slots = calloc(TABLE_INITIAL_SLOTS, sizeof(TermSlot));
+    if (!t->slots) { perror("calloc"); exit(1); }
+    t->slotMask = TABLE_INITIAL_SLOTS - 1;
+    return t;
+}
+
+const char *entryWord(const TermTable *table, const WordEntry *e) {
+    return table->words + e->wordOff;
+}
+
+/* how far slot i is from where its hash wants to be */
+static inline uint32_t probeDistance(const TermTable *t, uint32_t i, uint32_t hash) {
+    return (i - (hash & t->slotMask)) & t->slotMask;
+}
+
+/* Robin Hood placement: walk forward from the home slot, and whenever the
+   resident is closer to home than the slot we carry, swap and carry it on. */
+static void placeSlot(TermTable *t, TermSlot carry) {
+    uint32_t i = carry.hash & t->slotMask, d = 0;
+    for (;;) {
+        TermSlot *s = &t->slots[i];
+        if (!s->entry) { *s = carry; return; }
+        uint32_t sd = probeDistance(t, i, s->hash);
+        if (sd < d) {
+            TermSlot tmp = *s; *s = carry; carry = tmp;
+            d = sd;
         }
-        cur = cur->next;
-    }
-    /* not found -> create new entry and insert at head */
-    WordEntry *newEntry = malloc(sizeof(WordEntry));
-    if (!newEntry) { perror("malloc"); exit(1); }
-    strncpy(newEntry->word, word, MAX_WORD_LEN);
-    newEntry->word[MAX_WORD_LEN - 1] = '\0';
-    newEntry->docList = NULL;
-    newEntry->docFrequency = 0;
-    newEntry->next = hashTable[h];
-    hashTable[h] = newEntry;
-    addOrUpdateDocList(newEntry, docId, position);
-    return newEntry;
-}
-
-WordEntry *findWordEntry(WordEntry **hashTable, const char *word) {
-    unsigned long h = hashFunc(word);
-    WordEntry *cur = hashTable[h];
-    while (cur) {
-        if (strcmp(cur->word, word) == 0) return cur;
-        cur = cur->next;
+        i = (i + 1) & t->slotMask;
+        d++;
     }
-    return NULL;
 }
 
-void processFile(WordEntry **hashTable, const char *filepath, int docId) {
-    FILE *f = fopen(filepath, "r");
-    if (!f) { perror(filepath); return; }
-
-    char buf[4096];
-    int position = 0;
-    while (fgets(buf, sizeof(buf), f)) {
-        toLowerCase(buf);
-        removePunctuation(buf);
-        char *tok = strtok(buf, " \t\r\n");
-        while (tok) {
-            if (!isStopWord(tok) && strlen(tok) > 0) {
-                insertWordHash(hashTable, tok, docId, position);
-                documents[docId].totalTerms++;
-            }
-            position++;
-            tok = strtok(NULL, " \t\r\n");
+static void growSlots(TermTable *t) {
+    TermSlot *old = t->slots;
+    uint32_t oldCount = t->slotMask + 1;
+    t->slots = calloc((size_t)oldCount * 2, sizeof(TermSlot));
+    if (!t->slots) { perror("calloc"); exit(1); }
+    t->slotMask = oldCount * 2 - 1;
+    for (uint32_t i = 0; i < oldCount; i++)
+        if (old[i].entry) placeSlot(t, old[i]);
+    free(old);
+}
+
+static WordEntry *lookupHashed(const TermTable *t, const char *word, size_t len, uint32_t hash) {
+    uint32_t i = hash & t->slotMask, d = 0;
+    for (;;) {
+        const TermSlot *s = &t->slots[i];
+        /* an empty slot, or a resident closer to home than we are, ends the run */
+        if (!s->entry || probeDistance(t, i, s->hash) < d) return NULL;
+        if (s->hash == hash) {
+            WordEntry *e = &t->entries[s->entry - 1];
+            if (e->wordLen == len && memcmp(t->words + e->wordOff, word, len) == 0) return e;
         }
+        i = (i + 1) & t->slotMask;
+        d++;
     }
-    fclose(f);
 }
 
-void indexDocuments(WordEntry **hashTable, const char *folderPath) {
-    DIR *dir = opendir(folderPath);
-    if (!dir) { perror("opendir"); return; }
+/* Append a fresh entry for word (known to be absent). */
+static WordEntry *addEntry(TermTable *t, const char *word, size_t len, uint32_t hash) {
+    if ((uint64_t)(t->termCount + 1) * 8 > (uint64_t)(t->slotMask + 1) * 7) growSlots(t);
+    if (t->termCount == t->entryCap) {
+        t->entryCap = t->entryCap ? t->entryCap * 2 : 1024;
+        t->entries = realloc(t->entries, sizeof(WordEntry) * t->entryCap);
+        if (!t->entries) { perror("realloc"); exit(1); }
+    }
+    if (t->wordsLen + len + 1 > t->wordsCap) {
+        size_t nc = t->wordsCap ? t->wordsCap * 2 : 64 * 1024;
+        while (nc < t->wordsLen + len + 1) nc *= 2;
+        t->words = realloc(t->words, nc);
+        if (!t->words) { perror("realloc"); exit(1); }
+        t->wordsCap = nc;
+    }
+    WordEntry *e = &t->entries[t->termCount];
+    e->wordOff = (uint32_t)t->wordsLen;
+    e->wordLen = (uint32_t)len;
+    memcpy(t->words + t->wordsLen, word, len);
+    t->words[t->wordsLen + len] = '\0';
+    t->wordsLen += len + 1;
+    e->docList = NULL;
+    e->lastDoc = NULL;
+    e->docFrequency = 0;
+    TermSlot s = { hash, ++t->termCount };
+    placeSlot(t, s);
+    return e;
+}
+
+/* Insert word into the term table (or update existing). */
+WordEntry *insertWordHash(TermTable *table, const char *word, size_t len, int docId, int position, uint32_t offset) {
+    uint32_t h = hashWord(word, len);
+    WordEntry *e = lookupHashed(table, word, len, h);
+    if (!e) e = addEntry(table, word, len, h);
+    addOrUpdateDocList(&table->arena, e, docId, position, offset);
+    return e;
+}
+
+WordEntry *findWordEntry(const TermTable *table, const char *word, size_t len) {
+    return lookupHashed(table, word, len, hashWord(word, len));
+}
+
+typedef struct FileTokens {
+    TermTable *table;
+    int docId;
+    int position;
+} FileTokens;
+
+static void indexToken(const char *tok, size_t len, size_t offset, void *ctx) {
+    FileTokens *ft = ctx;
+    if (!isStopWordLen(tok, len)) {
+        insertWordHash(ft->table, tok, len, ft->docId, ft->position, (uint32_t)offset);
+        documents[ft->docId].totalTerms++;
+    }
+    ft->position++;
+}
+
+/* Positions count every token, stop words included, so phrase offsets
+   line up with the original text. Each occurrence also keeps its byte
+   offset in the file, for snippets. */
+void processFile(TermTable *table, const char *filepath, int docId) {
+    FileTokens ft = { table, docId, 0 };
+    tokenizeFile(filepath, indexToken, &ft);
+}
+
+/* The same for a file that may be being written meanwhile (a watched
+   folder): it is read, not mapped, so a truncation can't SIGBUS us. */
+void processChangingFile(TermTable *table, const char *filepath, int docId) {
+    FileTokens ft = { table, docId, 0 };
+    tokenizeFileCopy(filepath, indexToken, &ft);
+}
+
+static int cmpName(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+typedef struct PathList {
+    char **paths;
+    int n;
+    int cap;
+} PathList;
 
+/* Gather .txt files under dir, descending into subdirectories. Symlinked
+   directories are not followed, so cycles cannot occur. */
+static void walkFolder(const char *dir, PathList *out) {
+    DIR *d = opendir(dir);
+    if (!d) { perror(dir); return; }
     struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
+    while ((entry = readdir(d)) != NULL) {
         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        size_t len = strlen(dir) + strlen(entry->d_name) + 2;
+        char *path = malloc(len);
+        if (!path) { perror("malloc"); exit(1); }
+        snprintf(path, len, "%s/%s", dir, entry->d_name);
+
+        int isDir = entry->d_type == DT_DIR, isReg = entry->d_type == DT_REG;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(path, &st) == 0) { isDir = S_ISDIR(st.st_mode); isReg = S_ISREG(st.st_mode); }
+        }
         const char *ext = strrchr(entry->d_name, '.');
-        if (!ext || strcmp(ext, ".txt") != 0) continue;
-        if (docCount >= MAX_DOCS) break;
-
-        documents[docCount].id = docCount;
-        snprintf(documents[docCount].filename, sizeof(documents[docCount].filename),
-                 "%s/%s", folderPath, entry->d_name);
-        documents[docCount].searchCount = 0;
-        documents[docCount].totalTerms = 0;
-
-        char fullpath[1024];
-        snprintf(fullpath, sizeof(fullpath), "%s/%s", folderPath, entry->d_name);
-        processFile(hashTable, fullpath, docCount);
-        printf("Indexed: %s (terms=%d)\n", entry->d_name, documents[docCount].totalTerms);
-        docCount++;
-    }
-    closedir(dir);
-}
-
-/* Free posting list */
-void freeDocList(DocNode *head) {
-    while (head) {
-        DocNode *temp = head;
-        head = head->next;
-        free(temp->positions);
-        free(temp);
-    }
-}
-
-/* Free entire hash table */
-void freeHashTable(WordEntry **hashTable) {
-    for (int i = 0; i < HASH_SIZE; i++) {
-        WordEntry *cur = hashTable[i];
-        while (cur) {
-            WordEntry *temp = cur;
-            cur = cur->next;
-            freeDocList(temp->docList);
-            free(temp);
+        if (isDir) {
+            walkFolder(path, out);
+            free(path);
+        } else if ((isReg || entry->d_type == DT_LNK) && ext && strcmp(ext, ".txt") == 0) {
+            if (out->n == out->cap) {
+                out->cap = out->cap ? out->cap * 2 : 64;
+                out->paths = realloc(out->paths, sizeof(char *) * out->cap);
+                if (!out->paths) { perror("realloc"); exit(1); }
+            }
+            out->paths[out->n++] = path;
+        } else {
+            free(path);
+        }
+    }
+    closedir(d);
+}
+
+/* Every .txt file under folderPath, sorted by path. The caller frees each
+   path and the array. */
+char **listDocumentFiles(const char *folderPath, int *n) {
+    PathList list = {0};
+    walkFolder(folderPath, &list);
+    qsort(list.paths, list.n, sizeof(char *), cmpName);
+    *n = list.n;
+    return list.paths;
+}
+
+/* Register every .txt file under folderPath in documents[], in path order so
+   docIds do not depend on readdir order or on how many threads index them.
+   Returns the first docId assigned. */
+static int collectDocuments(const char *folderPath) {
+    int first = docCount, n;
+    char **paths = listDocumentFiles(folderPath, &n);
+    for (int i = 0; i < n; i++) {
+        addDocument(paths[i]);
+        free(paths[i]);
+    }
+    free(paths);
+    return first;
+}
+
+
+static void reportIndexed(int first) {
+    /* past a thousand documents a per-file line is just noise */
+    if (docCount - first > 1000) {
+        printf("Indexed: %d files\n", docCount - first);
+        return;
+    }
+    for (int d = first; d < docCount; d++) {
+        const char *slash = strrchr(documents[d].filename, '/');
+        printf("Indexed: %s (terms=%d)\n", slash ? slash + 1 : documents[d].filename,
+               documents[d].totalTerms);
+    }
+}
+
+void indexDocuments(TermTable *table, const char *folderPath) {
+    int first = collectDocuments(folderPath);
+    for (int d = first; d < docCount; d++)
+        processFile(table, documents[d].filename, d);
+    reportIndexed(first);
+}
+
+/* ---------------- Parallel indexing ----------------
+   Workers pull docIds from a shared counter and tokenize into private hash
+   tables, so there is no locking on the insert path. Each worker sees its
+   docIds in increasing order, so its posting lists are sorted; the merge
+   then splices them by docId, giving exactly the serial result. */
+
+typedef struct IndexWork {
+    atomic_int next;
+    int end;
+} IndexWork;
+
+typedef struct IndexWorker {
+    pthread_t thread;
+    IndexWork *work;
+    TermTable *table;
+} IndexWorker;
+
+static void *indexWorkerMain(void *arg) {
+    IndexWorker *w = arg;
+    for (;;) {
+        int d = atomic_fetch_add(&w->work->next, 1);
+        if (d >= w->work->end) break;
+        processFile(w->table, documents[d].filename, d);
+    }
+    return NULL;
+}
+
+/* Splice two docId-sorted, disjoint posting lists into dst. */
+static void mergeDocLists(WordEntry *dst, WordEntry *src) {
+    DocNode head = {0}, *tail = &head;
+    DocNode *a = dst->docList, *b = src->docList;
+    while (a && b) {
+        if (a->docId < b->docId) { tail->next = a; a = a->next; }
+        else { tail->next = b; b = b->next; }
+        tail = tail->next;
+    }
+    tail->next = a ? a : b;
+    while (tail->next) tail = tail->next;
+    dst->docList = head.next;
+    dst->lastDoc = tail;
+    dst->docFrequency += src->docFrequency;
+}
+
+/* Move every entry of src into dst, emptying src. Slots carry their
+   hashes, so nothing is rehashed. */
+void mergeTermTable(TermTable *dst, TermTable *src) {
+    for (uint32_t i = 0; i <= src->slotMask; i++) {
+        TermSlot s = src->slots[i];
+        if (!s.entry) continue;
+        WordEntry *from = &src->entries[s.entry - 1];
+        const char *word = src->words + from->wordOff;
+        WordEntry *existing = lookupHashed(dst, word, from->wordLen, s.hash);
+        if (existing) {
+            mergeDocLists(existing, from);
+        } else {
+            WordEntry *e = addEntry(dst, word, from->wordLen, s.hash);
+            e->docList = from->docList;
+            e->lastDoc = from->lastDoc;
+            e->docFrequency = from->docFrequency;
+        }
+    }
+    /* moved posting nodes still live in src's chunks */
+    arenaAbsorb(&dst->arena, &src->arena);
+    memset(src->slots, 0, sizeof(TermSlot) * (src->slotMask + 1));
+    src->termCount = 0;
+    src->wordsLen = 0;
+}
+
+/* Tokenize documents[first..end) into table on jobs threads. */
+static void tokenizeDocuments(TermTable *table, int first, int end, int jobs) {
+    if (jobs > end - first) jobs = end - first > 0 ? end - first : 1;
+
+    IndexWork work;
+    atomic_init(&work.next, first);
+    work.end = end;
+    IndexWorker *workers = calloc(jobs, sizeof(IndexWorker));
+    if (!workers) { perror("calloc"); exit(1); }
+    for (int t = 0; t < jobs; t++) {
+        workers[t].work = &work;
+        workers[t].table = createTermTable();
+        if (pthread_create(&workers[t].thread, NULL, indexWorkerMain, &workers[t]) != 0) {
+            perror("pthread_create"); exit(1);
         }
-        hashTable[i] = NULL;
     }
+    for (int t = 0; t < jobs; t++) {
+        pthread_join(workers[t].thread, NULL);
+        mergeTermTable(table, workers[t].table);
+        freeTermTable(workers[t].table);
+    }
+    free(workers);
+}
+
+void indexDocumentsParallel(TermTable *table, const char *folderPath, int jobs) {
+    if (jobs <= 1) { indexDocuments(table, folderPath); return; }
+    int first = collectDocuments(folderPath);
+    tokenizeDocuments(table, first, docCount, jobs);
+    reportIndexed(first);
+}
+
+/* Like indexDocumentsParallel, for a given list of files in docId order. */
+void indexFileList(TermTable *table, char *const *paths, int n, int jobs) {
+    int first = docCount;
+    for (int i = 0; i < n; i++) addDocument(paths[i]);
+    if (jobs <= 1) {
+        for (int d = first; d < docCount; d++) processFile(table, documents[d].filename, d);
+    } else {
+        tokenizeDocuments(table, first, docCount, jobs);
+    }
+    reportIndexed(first);
+}
+
+/* Memory held by the table: posting chunks, slots, entries and words. */
+size_t termTableBytes(const TermTable *table) {
+    return arenaCapacity(&table->arena) + sizeof(TermSlot) * ((size_t)table->slotMask + 1)
+           + sizeof(WordEntry) * table->entryCap + table->wordsCap;
+}
+
+/* Drop every term and posting and give the memory back, leaving the
+   table as createTermTable() made it. */
+void clearTermTable(TermTable *table) {
+    free(table->entries);
+    free(table->words);
+    freeArena(&table->arena);
+    table->entries = NULL;
+    table->entryCap = table->termCount = 0;
+    table->words = NULL;
+    table->wordsCap = table->wordsLen = 0;
+    table->slots = realloc(table->slots, sizeof(TermSlot) * TABLE_INITIAL_SLOTS);
+    if (!table->slots) { perror("realloc"); exit(1); }
+    memset(table->slots, 0, sizeof(TermSlot) * TABLE_INITIAL_SLOTS);
+    table->slotMask = TABLE_INITIAL_SLOTS - 1;
+}
+
+/* Like indexFileList, but once the table holds limit bytes, flush is
+   handed it to write out and clear. Checks fall between documents (or
+   between rounds of 256 per thread), so a document never straddles two
+   flushes. Stops with -1 as soon as a flush fails. */
+int indexFileListBounded(TermTable *table, char *const *paths, int n, int jobs, size_t limit,
+                         int (*flush)(TermTable *table, void *ctx), void *ctx) {
+    int first = docCount;
+    for (int i = 0; i < n; i++) addDocument(paths[i]);
+    int step = jobs <= 1 ? 1 : jobs * 256;
+    for (int d = first; d < docCount; d += step) {
+        int end = docCount - d > step ? d + step : docCount;
+        if (jobs <= 1) processFile(table, documents[d].filename, d);
+        else tokenizeDocuments(table, d, end, jobs);
+        if (termTableBytes(table) >= limit && flush(table, ctx) != 0) return -1;
+    }
+    reportIndexed(first);
+    return 0;
+}
+
+static void countToken(const char *tok, size_t len, size_t offset, void *ctx) {
+    (void)offset;
+    if (!isStopWordLen(tok, len)) (*(uint64_t *)ctx)++;
+}
+
+/* Average indexed tokens per file, from a counting pass over them. */
+double averageDocTerms(char *const *paths, int n) {
+    uint64_t tokens = 0;
+    for (int i = 0; i < n; i++) tokenizeFile(paths[i], countToken, &tokens);
+    return n ? (double)tokens / n : 0.0;
+}
+
+/* Free the table: slots, entries, the word pool and the posting arena */
+void freeTermTable(TermTable *table) {
+    if (!table) return;
+    free(table->slots);
+    free(table->entries);
+    free(table->words);
+    freeArena(&table->arena);
+    free(table);
 }
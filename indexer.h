@@ -7,11 +7,9 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <math.h>
+#include <stdint.h>
+#include "arena.h"
 
-#define MAX_WORD_LEN 100
-#define MAX_DOCS 100
-#define MAX_FILENAME_LEN 500
-#define HASH_SIZE 20011   /* larger prime for hash table */
 #define TOP_K 10
 
 /* ---------------- Struct Definitions ---------------- */
@@ -19,48 +17,98 @@
 typedef struct DocNode {
     int docId;
     int frequency;          /* term frequency in this doc */
-    int *positions;         /* dynamic array of positions (word offsets) */
+    int *positions;         /* growable array of positions (word offsets), arena-backed; NULL without positions */
     int posCount;
-    int posCap;
+    int posCap;             /* posCap positions, then posCap byte offsets (docNodeOffsets) */
     struct DocNode *next;
 } DocNode;
 
-/* Word entry stored in a bucket's linked list */
+/* byte offset in the source file of each position's token */
+static inline uint32_t *docNodeOffsets(const DocNode *d) {
+    return (uint32_t *)(d->positions + d->posCap);
+}
+
+/* Word entry: one per distinct term, kept densely in TermTable.entries.
+   Pointers to entries are invalidated by the next insert of a new term. */
 typedef struct WordEntry {
-    char word[MAX_WORD_LEN];
-    DocNode *docList;
+    uint32_t wordOff;       /* offset of the term in the owning table's word pool */
+    uint32_t wordLen;
+    DocNode *docList;       /* ascending docId order */
+    DocNode *lastDoc;       /* tail of docList; docs are indexed in docId order */
     int docFrequency;       /* number of documents containing this term */
-    struct WordEntry *next; /* next in bucket chain */
 } WordEntry;
 
+/* One slot of the open-addressed dictionary. The full hash is kept so that
+   probing and resizing almost never touch the term string. */
+typedef struct TermSlot {
+    uint32_t hash;
+    uint32_t entry;         /* index into entries[] + 1; 0 = empty */
+} TermSlot;
+
+/* Term dictionary used while building: a Robin Hood hash table (linear
+   probing, power-of-two size, grows at 7/8 load) over a dense entry array
+   and a contiguous term string pool. Posting nodes and position arrays
+   come from the arena, so the whole table is released in a few frees. */
+typedef struct TermTable {
+    TermSlot *slots;
+    uint32_t slotMask;
+    WordEntry *entries;
+    uint32_t termCount;
+    uint32_t entryCap;
+    char *words;            /* NUL-separated term strings */
+    size_t wordsLen;
+    size_t wordsCap;
+    Arena arena;
+} TermTable;
+
 typedef struct {
-    int id;
-    char filename[MAX_FILENAME_LEN];
-    int searchCount;
+    const char *filename;   /* interned in the document name arena */
     int totalTerms;         /* total number of tokens in doc (for normalization) */
 } DocInfo;
 
 /* ---------------- Globals & Declarations ---------------- */
 
-extern DocInfo documents[MAX_DOCS];
+extern DocInfo *documents;  /* grows with addDocument(); docId = index */
 extern int docCount;
 
+/* documents */
+int addDocument(const char *filename);
+void freeDocuments(void);
+
 /* indexer */
+/* keep each occurrence's token position and byte offset (the default);
+   without them a DocNode only counts occurrences, and phrases can't be
+   checked nor snippets marked */
+void setKeepPositions(int on);
+int keepPositions(void);
 int isStopWord(const char *word);
+int isStopWordLen(const char *word, size_t len);
+int setStopWords(const char *text, size_t len);
+int loadStopWords(const char *path);
+const char *stopWordsText(size_t *len);
+void freeStopWords(void);
 void toLowerCase(char *str);
 void removePunctuation(char *str);
-unsigned long hashFunc(const char *str);
-WordEntry *insertWordHash(WordEntry **hashTable, const char *word, int docId, int position);
-void processFile(WordEntry **hashTable, const char *filepath, int docId);
-void indexDocuments(WordEntry **hashTable, const char *folderPath);
+uint32_t hashWord(const char *str, size_t len);
+TermTable *createTermTable(void);
+WordEntry *insertWordHash(TermTable *table, const char *word, size_t len, int docId, int position, uint32_t offset);
+void processFile(TermTable *table, const char *filepath, int docId);
+void processChangingFile(TermTable *table, const char *filepath, int docId);
+char **listDocumentFiles(const char *folderPath, int *n);
+void indexDocuments(TermTable *table, const char *folderPath);
+void indexDocumentsParallel(TermTable *table, const char *folderPath, int jobs);
+void indexFileList(TermTable *table, char *const *paths, int n, int jobs);
+int indexFileListBounded(TermTable *table, char *const *paths, int n, int jobs, size_t limit,
+                         int (*flush)(TermTable *table, void *ctx), void *ctx);
+double averageDocTerms(char *const *paths, int n);
+size_t termTableBytes(const TermTable *table);
+void clearTermTable(TermTable *table);
+void mergeTermTable(TermTable *dst, TermTable *src);
 
-/* search */
-WordEntry *findWordEntry(WordEntry **hashTable, const char *word);
-/* prints results (top-k) for a query (single term/phrase/multi-term boolean/TF-IDF) */
-void printResultsForQuery(WordEntry **hashTable, const char *query);
+WordEntry *findWordEntry(const TermTable *table, const char *word, size_t len);
+const char *entryWord(const TermTable *table, const WordEntry *e);
 
 /* cleanup */
-void freeDocList(DocNode *head);
-void freeHashTable(WordEntry **hashTable);
+void freeTermTable(TermTable *table);
 
 #endif
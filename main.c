@@ -1,40 +1,335 @@
-#include "indexer.h"
+#include "batch.h"
+#include "popularity.h"
+#include "query.h"
+#include "search.h"
+#include "server.h"
+#include "shard.h"
+#include "spimi.h"
 #include <stdio.h>
 #include <string.h>
-#include <stdlib.h> 
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
-/* prototypes from search.c */
-void printResultsForQuery(WordEntry **hashTable, const char *query);
+#define DEFAULT_CACHE_MB 32
 
-int main(int argc, char *argv[]) {
-    // CRITICAL FIX: Check for the required directory argument
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <document_directory_path>\n", argv[0]);
-        return 1;
-    }
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-j N] [--stopwords file] [--explain] [--snippets] [--trace] [--cache-mb N] [--watch] <document_directory_path>\n"
+            "       %s [-j N] [--stopwords file] [--scoring m] [--impact-bits N] [--no-positions] [--mem-limit MB] [--shards N [--shard-by m]] --build-index <document_directory_path> <index_file>\n"
+            "       %s [--explain] [--snippets] [--cache-mb N] [--fanout N] --load-index <index_file or shard manifest>\n"
+            "       %s --shard-servers list [--serve ...] [--batch ...]\n"
+            "       %s [--serve socket_path] [--serve-tcp port] [--workers N] <folder or --load-index file>\n"
+            "       %s --batch queries.txt [--format tsv|json] [--out file] [--workers N] <folder or --load-index file>\n"
+            "  -j N              tokenize with N worker threads (default 1)\n"
+            "  --stopwords file  drop the words listed in file instead of the built-in list;\n"
+            "                    the list is saved in the index and used by its queries\n"
+            "  --scoring m       tfidf (default) or bm25, fixed when the index is built\n"
+            "  --impact-bits N   store each posting's score impact in 8 (default) or 16 bits\n"
+            "  --no-positions    don't store token positions and offsets: a smaller index,\n"
+            "                    but phrases then match any doc holding all of their words\n"
+            "                    and snippets start at the top of the file, unmarked\n"
+            "  --mem-limit MB    build in sorted runs of at most MB of postings, merged into\n"
+            "                    the index at the end, for corpora larger than memory\n"
+            "  --shards N        build N index files and a manifest (named index_file) that\n"
+            "                    --load-index loads as one index\n"
+            "  --shard-by m      range (default: runs of files in path order) or hash (of the\n"
+            "                    file path)\n"
+            "  --fanout N        rank the shards of a query on N threads (default: one per\n"
+            "                    shard, up to one per CPU)\n"
+            "  --shard-servers list  send every query to the shard servers in list\n"
+            "                    (comma-separated socket paths and 127.0.0.1 ports) and merge\n"
+            "                    their results; each serves one shard with --serve\n"
+            "  --max-expansions N  a wildcard word (comput*, c?t) stands for at most N\n"
+            "                    terms (default %d)\n"
+            "  --exact-scores    score in floating point from tf and doc length instead of\n"
+            "                    the stored impacts\n"
+            "  --explain         print each query's plan with estimated and visited postings\n"
+            "  --snippets        show each hit's text around its matches (at the prompt, in\n"
+            "                    server replies and --format json batches)\n"
+            "  --trace           time each query's stages and count its postings; ':trace'\n"
+            "                    at the prompt (or the end of a batch or server run) prints\n"
+            "                    the histograms\n"
+            "  --cache-mb N      memory for cached results and term-pair intersections\n"
+            "                    (default %d, 0 = off); ':stats' at the prompt shows hit rates\n"
+            "  --watch           follow changes to the document folder as they happen;\n"
+            "                    without it, ':refresh' at the prompt picks them up\n"
+            "                    (':reload' maps a rebuilt --load-index file again, and so\n"
+            "                    does SIGHUP to a server; queries keep running meanwhile)\n"
+            "  --serve path      answer queries on a Unix socket instead of the prompt:\n"
+            "                    one query per line in, one JSON line out\n"
+            "  --serve-tcp port  the same on 127.0.0.1:port\n"
+            "  --workers N       query threads for the server or a batch (default: one per CPU)\n"
+            "  --batch file      run every line of file ('-' for stdin) as a query and exit;\n"
+            "                    results come out in input order, status lines on stderr\n"
+            "  --format f        batch output: tsv (id, docId, file, score per hit; default)\n"
+            "                    or json (one object per query)\n"
+            "  --out file        write batch results to file instead of stdout\n",
+            prog, prog, prog, prog, prog, prog, DEFAULT_MAX_EXPANSIONS, DEFAULT_CACHE_MB);
+}
 
-    WordEntry *hashTable[HASH_SIZE];
-    for (int i = 0; i < HASH_SIZE; i++) hashTable[i] = NULL;
+/* Tokenize a folder into a fresh term table and flatten it into an index image. */
+static Index *buildFromFolder(const char *docPath, int jobs) {
+    TermTable *table = createTermTable();
 
     printf("Building index (hash table, positions, TF-IDF support)...\n");
+    indexDocumentsParallel(table, docPath, jobs);
+    Index *idx = buildIndexImage(table);
+    freeTermTable(table);
+    freeDocuments();
+    printf("Indexing complete. Total docs: %d\n", indexDocCount(idx));
+    return idx;
+}
 
-    // Pass the command-line argument (argv[1]) to the indexer
-    const char *docPath = argv[1];
-    indexDocuments(hashTable, docPath); 
-
-    printf("Indexing complete. Total docs: %d\n", docCount);
-
+static void queryLoop(void) {
     char query[1024];
     while (1) {
-        printf("\nEnter search (single-word, phrase \"...\", boolean using AND/OR/NOT) or 'exit':\n> ");
+        printf("\nEnter search (words, comput*, phrase \"...\", AND/OR/NOT with parentheses), "
+               "':stats', ':trace', ':index', ':refresh', ':reload', ':merge' or 'exit':\n> ");
         if (!fgets(query, sizeof(query), stdin)) break;
         query[strcspn(query, "\n")] = '\0';
         if (strcmp(query, "exit") == 0) break;
+        if (strcmp(query, ":stats") == 0) {
+            printCacheStats(stdout);
+            printSegmentStats(stdout);
+            printPopularity(stdout, 5);
+            continue;
+        }
+        if (strcmp(query, ":trace") == 0) {
+            printTraceHistograms(stdout);
+            continue;
+        }
+        if (strcmp(query, ":index") == 0) {
+            const IndexView *v = acquireView();
+            for (int s = 0; s < v->nsegs; s++) {
+                if (v->nsegs > 1) printf("segment %d of %d:\n", s + 1, v->nsegs);
+                printIndexStats(v->segs[s]->idx, stdout);
+            }
+            releaseView(v);
+            continue;
+        }
+        if (strcmp(query, ":refresh") == 0) {
+            int n = refreshSegments();
+            if (n < 0) printf("A loaded index has no document folder to refresh from\n");
+            else printf("%d document change(s) applied\n", n);
+            continue;
+        }
+        if (strcmp(query, ":reload") == 0) {
+            int n = reloadSegments();
+            if (n < 0) printf("Nothing reloaded; the current index stays\n");
+            else printf("Reloaded: %d docs\n", n);
+            continue;
+        }
+        if (strcmp(query, ":merge") == 0) {
+            mergeSegments(1);
+            printSegmentStats(stdout);
+            continue;
+        }
         if (strlen(query) == 0) continue;
-        printResultsForQuery(hashTable, query);
+        const IndexView *v = acquireView();
+        printResultsForQuery(v, query);
+        releaseView(v);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Index *idx = NULL, **shards = NULL;
+    int nshards = 0, jobs = 1, buildShardCount = 1, fanout = 0;
+    ShardBy shardBy = SHARD_BY_RANGE;
+    const char *shardServers = NULL;
+    const char *buildDir = NULL, *buildOut = NULL, *loadPath = NULL, *docPath = NULL;
+    const char *stopPath = NULL;
+    ScoringModel scoring = SCORE_TFIDF;
+    int impactBits = 8, scoringSet = 0;
+    long cacheMb = DEFAULT_CACHE_MB;
+    int watch = 0;
+    time_t builtAt = time(NULL);
+    ServerConfig server = { NULL, 0, (int)sysconf(_SC_NPROCESSORS_ONLN) };
+    BatchConfig batch = { NULL, NULL, 0, 0 };
+    const char *batchOut = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs < 1) jobs = 1;
+        } else if (strcmp(argv[i], "--build-index") == 0 && i + 2 < argc) {
+            buildDir = argv[++i];
+            buildOut = argv[++i];
+        } else if (strcmp(argv[i], "--mem-limit") == 0 && i + 1 < argc) {
+            long mb = atol(argv[++i]);
+            if (mb < 1) { usage(argv[0]); return 1; }
+            setBuildMemLimit((size_t)mb << 20);
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            buildShardCount = atoi(argv[++i]);
+            if (buildShardCount < 1) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--shard-by") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "hash") == 0) shardBy = SHARD_BY_HASH;
+            else if (strcmp(argv[i], "range") != 0) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--fanout") == 0 && i + 1 < argc) {
+            fanout = atoi(argv[++i]);
+            if (fanout < 1) fanout = 1;
+        } else if (strcmp(argv[i], "--shard-servers") == 0 && i + 1 < argc) {
+            shardServers = argv[++i];
+        } else if (strcmp(argv[i], "--stopwords") == 0 && i + 1 < argc) {
+            stopPath = argv[++i];
+        } else if (strcmp(argv[i], "--cache-mb") == 0 && i + 1 < argc) {
+            cacheMb = atol(argv[++i]);
+            if (cacheMb < 0) cacheMb = 0;
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            server.unixPath = argv[++i];
+        } else if (strcmp(argv[i], "--serve-tcp") == 0 && i + 1 < argc) {
+            server.tcpPort = atoi(argv[++i]);
+            if (server.tcpPort <= 0 || server.tcpPort > 65535) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            server.workers = atoi(argv[++i]);
+            if (server.workers < 1) server.workers = 1;
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch.input = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "json") == 0) batch.json = 1;
+            else if (strcmp(argv[i], "tsv") != 0) { usage(argv[0]); return 1; }
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            batchOut = argv[++i];
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = 1;
+        } else if (strcmp(argv[i], "--scoring") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "bm25") == 0) scoring = SCORE_BM25;
+            else if (strcmp(argv[i], "tfidf") != 0) { usage(argv[0]); return 1; }
+            scoringSet = 1;
+        } else if (strcmp(argv[i], "--impact-bits") == 0 && i + 1 < argc) {
+            impactBits = atoi(argv[++i]);
+            scoringSet = 1;
+        } else if (strcmp(argv[i], "--no-positions") == 0) {
+            setKeepPositions(0);
+            scoringSet = 1;
+        } else if (strcmp(argv[i], "--max-expansions") == 0 && i + 1 < argc) {
+            setMaxExpansions(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--exact-scores") == 0) {
+            setExactScores(1);
+        } else if (strcmp(argv[i], "--explain") == 0) {
+            setQueryExplain(1);
+        } else if (strcmp(argv[i], "--snippets") == 0) {
+            setResultSnippets(1);
+        } else if (strcmp(argv[i], "--trace") == 0) {
+            setQueryTracing(1);
+        } else if (strcmp(argv[i], "--load-index") == 0 && i + 1 < argc) {
+            loadPath = argv[++i];
+        } else if (argv[i][0] != '-' && !docPath) {
+            docPath = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (batch.input) {
+        batch.threads = server.workers;
+        if (batchOut) {
+            batch.out = fopen(batchOut, "w");
+            if (!batch.out) { perror(batchOut); return 1; }
+        } else {
+            /* results keep stdout to themselves; status lines move to stderr */
+            int outFd = dup(STDOUT_FILENO);
+            if (outFd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0 || !(batch.out = fdopen(outFd, "w"))) {
+                perror("stdout");
+                return 1;
+            }
+        }
+    }
+
+    if (stopPath) {
+        if (loadPath) {
+            fprintf(stderr, "--stopwords applies when building; a loaded index uses its own list\n");
+        } else if (loadStopWords(stopPath) != 0) {
+            return 1;
+        }
+    }
+
+    if (scoringSet) {
+        if (loadPath) {
+            fprintf(stderr, "--scoring, --impact-bits and --no-positions apply when building; a loaded index keeps its own\n");
+        } else if (setIndexScoring(scoring, impactBits) != 0) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (buildDir && buildShardCount > 1) {
+        int rc = buildShards(buildDir, buildOut, buildShardCount, shardBy, jobs);
+        freeStopWords();
+        return rc == 0 ? 0 : 1;
+    } else if (buildDir && buildMemLimit()) {
+        int n;
+        size_t size = 0;
+        char **paths = listDocumentFiles(buildDir, &n);
+        printf("Building index in runs of up to %zu MB...\n", buildMemLimit() >> 20);
+        int rc = buildIndexFile(paths, n, buildOut, jobs, &size);
+        if (rc == 0) printf("Wrote %s (%zu bytes, %d docs)\n", buildOut, size, docCount);
+        for (int i = 0; i < n; i++) free(paths[i]);
+        free(paths);
+        freeDocuments();
+        freeStopWords();
+        return rc == 0 ? 0 : 1;
+    } else if (buildDir) {
+        idx = buildFromFolder(buildDir, jobs);
+        int rc = saveIndex(idx, buildOut);
+        if (rc == 0) printf("Wrote %s (%zu bytes)\n", buildOut, idx->size);
+        freeIndex(idx);
+        freeStopWords();
+        return rc == 0 ? 0 : 1;
+    } else if (shardServers) {
+        if (loadPath || docPath) {
+            fprintf(stderr, "--shard-servers searches the servers' shards, not a local index\n");
+            return 1;
+        }
+        if (setShardServers(shardServers) != 0) { usage(argv[0]); return 1; }
+        printf("Searching %d shard server(s)\n", shardServerCount());
+    } else if (loadPath) {
+        shards = loadShards(loadPath, &nshards);
+        if (!shards) return 1;
+        int docs = 0;
+        for (int s = 0; s < nshards; s++) docs += indexDocCount(shards[s]);
+        if (nshards > 1) printf("Loaded %s: %d shards. Total docs: %d\n", loadPath, nshards, docs);
+        else printf("Loaded %s. Total docs: %d\n", loadPath, docs);
+    } else if (docPath) {
+        idx = buildFromFolder(docPath, jobs);
+        shards = &idx;
+        nshards = 1;
+    } else {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* only an index built from a folder can follow it */
+    initSegments(shards, nshards, loadPath ? NULL : docPath, loadPath, builtAt);
+    if (shards != &idx) free(shards);
+    if (!fanout) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        fanout = nshards < cpus ? nshards : (int)cpus;
+    }
+    setQueryFanout(fanout);
+    if (watch) {
+        if (loadPath || shardServers) fprintf(stderr, "--watch needs a document folder; a loaded index stays as it is\n");
+        else if (startWatch() == 0) printf("Watching %s for changes\n", docPath);
     }
+    setQueryCacheBytes((size_t)cacheMb << 20);
+    int rc = 0;
+    if (batch.input) rc = runBatch(&batch) == 0 ? 0 : 1;
+    else if (server.unixPath || server.tcpPort) rc = runServer(&server) == 0 ? 0 : 1;
+    else queryLoop();
+    if (queryTracing && (batch.input || server.unixPath || server.tcpPort)) printTraceHistograms(stderr);
+    if (batch.out) fclose(batch.out);
 
-    freeHashTable(hashTable);
+    freeQueryFanout();
+    freeShardServers();
+    freeSegments();
+    freePopularity();
+    freeQueryCaches();
+    freeQueryScratch();
+    freeStopWords();
     printf("Goodbye!\n");
-    return 0;
-}
\ No newline at end of file
+    return rc;
+}
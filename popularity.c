@@ -0,0 +1,165 @@
+#include "popularity.h"
+#include "indexer.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POP_STRIPES 8           /* per-slot counters, one per thread modulo this */
+#define POP_MIN_SLOTS 1024
+#define POP_TOP_MAX 64          /* most documents printPopularity lists */
+
+typedef struct PopName {
+    uint32_t hash;
+    char name[];
+} PopName;
+
+typedef struct PopTable {
+    struct PopTable *older;         /* the table this one replaced */
+    uint32_t mask;
+    uint32_t used;                  /* claimed slots */
+    PopName **names;                /* NULL: free slot */
+    uint32_t *counts[POP_STRIPES];  /* counts[stripe][slot] */
+} PopTable;
+
+static PopTable *table;             /* newest; swapped by reservePopularity only */
+static unsigned nextStripe;
+static _Thread_local int stripe = -1;
+
+static PopName *newPopName(const char *name, size_t len, uint32_t hash) {
+    PopName *p = malloc(sizeof(PopName) + len + 1);
+    if (!p) { perror("malloc"); exit(1); }
+    p->hash = hash;
+    memcpy(p->name, name, len + 1);
+    return p;
+}
+
+static PopTable *newPopTable(uint32_t slots) {
+    PopTable *t = calloc(1, sizeof(PopTable));
+    if (!t) { perror("calloc"); exit(1); }
+    t->mask = slots - 1;
+    t->names = calloc(slots, sizeof(PopName *));
+    if (!t->names) { perror("calloc"); exit(1); }
+    for (int s = 0; s < POP_STRIPES; s++) {
+        t->counts[s] = calloc(slots, sizeof(uint32_t));
+        if (!t->counts[s]) { perror("calloc"); exit(1); }
+    }
+    return t;
+}
+
+/* The slot holding name in t, claiming a free one if it isn't there yet;
+   -1 if t is full. *spare is a copy of the name to claim with, made on
+   first need and left for the caller to free if another thread won. */
+static int64_t findSlot(PopTable *t, const char *name, size_t len, uint32_t hash, PopName **spare) {
+    for (uint32_t i = 0, k = hash & t->mask; i <= t->mask; i++, k = (k + 1) & t->mask) {
+        PopName *p = __atomic_load_n(&t->names[k], __ATOMIC_ACQUIRE);
+        if (!p) {
+            if (!*spare) *spare = newPopName(name, len, hash);
+            if (__atomic_compare_exchange_n(&t->names[k], &p, *spare, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+                *spare = NULL;
+                __atomic_fetch_add(&t->used, 1, __ATOMIC_RELAXED);
+                return k;
+            }
+            /* lost the race: p is the winner, which may be this very name */
+        }
+        if (p->hash == hash && strcmp(p->name, name) == 0) return k;
+    }
+    return -1;
+}
+
+void countDocHit(const char *name) {
+    PopTable *t = __atomic_load_n(&table, __ATOMIC_ACQUIRE);
+    if (!t) return;
+    if (stripe < 0) stripe = (int)(__atomic_fetch_add(&nextStripe, 1, __ATOMIC_RELAXED) % POP_STRIPES);
+    size_t len = strlen(name);
+    PopName *spare = NULL;
+    int64_t k = findSlot(t, name, len, hashWord(name, len), &spare);
+    free(spare);
+    if (k >= 0) __atomic_fetch_add(&t->counts[stripe][k], 1, __ATOMIC_RELAXED);
+}
+
+/* The slot holding name in t, or -1 if no one has claimed it there. */
+static int64_t lookupSlot(const PopTable *t, const char *name, uint32_t hash) {
+    for (uint32_t i = 0, k = hash & t->mask; i <= t->mask; i++, k = (k + 1) & t->mask) {
+        const PopName *p = __atomic_load_n(&t->names[k], __ATOMIC_ACQUIRE);
+        if (!p) return -1;
+        if (p->hash == hash && strcmp(p->name, name) == 0) return k;
+    }
+    return -1;
+}
+
+static uint64_t slotHits(const PopTable *t, int64_t k) {
+    uint64_t hits = 0;
+    for (int s = 0; s < POP_STRIPES; s++) hits += __atomic_load_n(&t->counts[s][k], __ATOMIC_RELAXED);
+    return hits;
+}
+
+void reservePopularity(int docs) {
+    PopTable *old = table;
+    uint64_t want = docs > 0 ? (uint64_t)docs : 0;
+    if (old) {
+        uint32_t used = __atomic_load_n(&old->used, __ATOMIC_RELAXED);
+        if (used > want) want = used;
+        if ((uint64_t)old->mask + 1 >= 2 * want) return;
+    }
+    uint64_t slots = POP_MIN_SLOTS;
+    while (slots < 2 * want) slots <<= 1;
+    if (slots > (uint64_t)1 << 31) return;
+    /* Nothing is copied: queries still holding old go on counting into it,
+       and printPopularity adds each name's counts up over the whole chain. */
+    PopTable *t = newPopTable((uint32_t)slots);
+    t->older = old;
+    __atomic_store_n(&table, t, __ATOMIC_RELEASE);
+}
+
+void printPopularity(FILE *out, int n) {
+    const PopTable *newest = __atomic_load_n(&table, __ATOMIC_ACQUIRE);
+    if (n <= 0) return;
+    if (n > POP_TOP_MAX) n = POP_TOP_MAX;
+    const PopName *top[POP_TOP_MAX];
+    uint64_t topHits[POP_TOP_MAX];
+    int found = 0;
+    for (const PopTable *t = newest; t; t = t->older) {
+        for (uint32_t i = 0; i <= t->mask; i++) {
+            const PopName *p = __atomic_load_n(&t->names[i], __ATOMIC_ACQUIRE);
+            if (!p) continue;
+            /* a name is totalled once, from the newest table that has it */
+            const PopTable *u = newest;
+            while (u != t && lookupSlot(u, p->name, p->hash) < 0) u = u->older;
+            if (u != t) continue;
+            uint64_t hits = slotHits(t, i);
+            for (const PopTable *o = t->older; o; o = o->older) {
+                int64_t k = lookupSlot(o, p->name, p->hash);
+                if (k >= 0) hits += slotHits(o, k);
+            }
+            if (hits == 0 || (found == n && hits <= topHits[n - 1])) continue;
+            int j = found < n ? found++ : n - 1;
+            while (j > 0 && topHits[j - 1] < hits) {
+                top[j] = top[j - 1];
+                topHits[j] = topHits[j - 1];
+                j--;
+            }
+            top[j] = p;
+            topHits[j] = hits;
+        }
+    }
+    if (found == 0) {
+        fprintf(out, "no document has been returned yet\n");
+        return;
+    }
+    fprintf(out, "most returned documents:\n");
+    for (int i = 0; i < found; i++)
+        fprintf(out, "  %8llu  %s\n", (unsigned long long)topHits[i], top[i]->name);
+}
+
+void freePopularity(void) {
+    PopTable *t = table;
+    table = NULL;
+    while (t) {
+        PopTable *older = t->older;
+        for (uint32_t i = 0; i <= t->mask; i++) free(t->names[i]);
+        free(t->names);
+        for (int s = 0; s < POP_STRIPES; s++) free(t->counts[s]);
+        free(t);
+        t = older;
+    }
+}
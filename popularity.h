@@ -0,0 +1,30 @@
+#ifndef POPULARITY_H
+#define POPULARITY_H
+
+#include <stdio.h>
+
+/* ---------------- Document popularity ----------------
+   How often each document has been returned as a hit. Counts are kept by
+   document name, outside every IndexView, so they carry over refreshes,
+   merges and reloads, all of which renumber documents.
+
+   Nothing here takes a lock. Names live in an insert-only open-addressed
+   table whose slots are claimed by compare-and-swap, and each slot's count
+   is split over POP_STRIPES arrays, one per thread (round-robin beyond
+   that many), so threads returning the same popular document don't
+   bounce one cache line between them. The table only grows when the
+   writer that publishes a view calls reservePopularity, which starts an
+   empty, larger table in front of the old ones rather than copying them:
+   new hits go to the newest table, a query that loaded an older one keeps
+   counting there, and printPopularity sums each name over every table.
+   Old tables are kept until freePopularity(). */
+
+/* count one hit on the document called name; safe from several threads */
+void countDocHit(const char *name);
+/* make room for at least docs names (at most one caller at a time) */
+void reservePopularity(int docs);
+/* the n most hit documents, most first */
+void printPopularity(FILE *out, int n);
+void freePopularity(void);
+
+#endif
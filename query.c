@@ -0,0 +1,1014 @@
+#include "query.h"
+#include "docset.h"
+#include "tokenizer.h"
+#include <strings.h>  // For strcasecmp
+
+/* ---------------- Sorted docId sets ----------------
+   All sets are ascending docId arrays in the query arena. Operations whose
+   output can never be longer than their first input write over it. */
+
+static int *emptySet(Arena *arena) {
+    return arenaAlloc(arena, sizeof(int));
+}
+
+/* every posting of t, in docId order */
+static int *collectDocIds(const Index *idx, Arena *arena, QueryNode *n, int *nResults) {
+    const TermRecord *t = n->rec;
+    if (!t) { *nResults = 0; return emptySet(arena); }
+    int count = (int)t->docFrequency;
+    int *arr = arenaAlloc(arena, sizeof(int) * (count ? count : 1));
+    PostingCursor c;
+    openPostings(idx, t, &c);
+    for (int i = 0; i < count && nextPosting(&c); i++) arr[i] = c.docId;
+    n->visited += c.decoded;
+    closePostings(&c);
+    *nResults = count;
+    return arr;
+}
+
+/* Keep (keep=1) or drop (keep=0), in place, the docs of A that also appear
+   in term n. Skips through the term's blocks instead of decoding them all. */
+static int filterByTerm(const Index *idx, int *A, int nA, QueryNode *n, int keep) {
+    const TermRecord *t = n->rec;
+    if (!t) return keep ? 0 : nA;
+    PostingCursor c;
+    openPostings(idx, t, &c);
+    int live = 1, k = 0;
+    for (int i = 0; i < nA; i++) {
+        int hit = live && (live = advancePosting(&c, A[i])) && c.docId == A[i];
+        if (hit == keep) A[k++] = A[i];
+    }
+    n->visited += c.decoded;
+    closePostings(&c);
+    return k;
+}
+
+/* filterByTerm for an OR of terms: a doc hits if any term has it. */
+static int filterByAnyTerm(const Index *idx, Arena *arena, int *A, int nA, QueryNode *n, int keep) {
+    PostingCursor *cur = arenaAlloc(arena, sizeof(PostingCursor) * n->nkids);
+    int *live = arenaAlloc(arena, sizeof(int) * n->nkids);
+    for (int j = 0; j < n->nkids; j++) {
+        live[j] = n->kids[j]->rec != NULL;
+        if (live[j]) openPostings(idx, n->kids[j]->rec, &cur[j]);
+    }
+    int k = 0;
+    for (int i = 0; i < nA; i++) {
+        int hit = 0;
+        for (int j = 0; j < n->nkids && !hit; j++)
+            hit = live[j] && (live[j] = advancePosting(&cur[j], A[i])) && cur[j].docId == A[i];
+        if (hit == keep) A[k++] = A[i];
+    }
+    for (int j = 0; j < n->nkids; j++) {
+        if (!n->kids[j]->rec) continue;
+        n->kids[j]->visited += cur[j].decoded;
+        closePostings(&cur[j]);
+    }
+    return k;
+}
+
+/* helper: first index >= lo in A[0..n) with A[i] >= target, galloping from lo */
+static int gallop(const int *A, int n, int lo, int target) {
+    int step = 1, hi = lo;
+    while (hi < n && A[hi] < target) { lo = hi + 1; hi += step; step <<= 1; }
+    if (hi > n) hi = n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (A[mid] < target) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* intersection, written over the shorter input (returned); gallops
+   through the longer side when sizes are lopsided */
+static int *intersectArrays(int *A, int nA, int *B, int nB, int *nOut) {
+    if (nA > nB) { int *T = A; A = B; B = T; int tn = nA; nA = nB; nB = tn; }
+    int i=0,j=0,k=0;
+    if (nA * 8 < nB) {
+        for (; i<nA && j<nB; i++) {
+            j = gallop(B, nB, j, A[i]);
+            if (j<nB && B[j]==A[i]) A[k++]=A[i];
+        }
+        *nOut = k; return A;
+    }
+    while (i<nA && j<nB) {
+        if (A[i]==B[j]) { A[k++]=A[i]; i++; j++; }
+        else if (A[i]<B[j]) i++; else j++;
+    }
+    *nOut = k; return A;
+}
+
+/* union */
+static int *unionArrays(Arena *arena, int *A, int nA, int *B, int nB, int *nOut) {
+    int *res = arenaAlloc(arena, sizeof(int) * (nA + nB + 1));
+    int i=0,j=0,k=0;
+    while (i<nA && j<nB) {
+        if (A[i]==B[j]) { res[k++]=A[i]; i++; j++; }
+        else if (A[i]<B[j]) res[k++]=A[i++]; else res[k++]=B[j++];
+    }
+    while (i<nA) res[k++]=A[i++];
+    while (j<nB) res[k++]=B[j++];
+    *nOut = k; return res;
+}
+
+/* difference A \ B, written over A */
+static int differenceArrays(int *A, int nA, int *B, int nB) {
+    int i=0,j=0,k=0;
+    while (i<nA && j<nB) {
+        if (A[i]==B[j]) { i++; j++; }
+        else if (A[i]<B[j]) A[k++]=A[i++];
+        else j++;
+    }
+    while (i<nA) A[k++]=A[i++];
+    return k;
+}
+
+/* ---------------- Phrase and proximity matching ----------------
+   A phrase is tokenized exactly like document text. Each non stop word is
+   looked up once and keeps its token offset within the phrase (stop words
+   still count, since document positions count them too). Docs are found
+   by leapfrogging the cursors from the rarest term, and only docs holding
+   every term have their positions decoded and merged. */
+
+#define MAX_PHRASE_TERMS 64
+
+typedef struct PhraseTerm {
+    const TermRecord *rec;
+    int offset;             /* token offset within the phrase */
+    PostingCursor cur;
+} PhraseTerm;
+
+typedef struct PhraseParse {
+    const Index *idx;
+    Arena *arena;
+    PhraseTerm *terms;
+    int n;
+    int pos;
+    int missing;            /* some term is not in the index: nothing can match */
+    const char **words;     /* scoring words, if collecting */
+    int *wordCount;
+} PhraseParse;
+
+static void addPhraseToken(const char *tok, size_t len, size_t at, void *ctx) {
+    (void)at;
+    PhraseParse *pp = ctx;
+    int offset = pp->pos++;
+    if (isStopWordLen(tok, len) || pp->n >= MAX_PHRASE_TERMS) return;
+    const char *w = arenaStrdup(pp->arena, tok, len);
+    if (pp->words) pp->words[(*pp->wordCount)++] = w;
+    const TermRecord *t = findTermRecord(pp->idx, w);
+    if (!t || t->docFrequency == 0) { pp->missing = 1; return; }
+    pp->terms[pp->n].rec = t;
+    pp->terms[pp->n].offset = offset;
+    pp->n++;
+}
+
+/* Do the terms (in phrase order, cursors on the same doc) occur in order
+   with at most slop extra tokens inside the span? slop 0 = exact phrase.
+   For each start, every later term takes its earliest position that keeps
+   the order; starts only move forward, so each list is walked once. */
+static int positionsMatch(PhraseTerm *terms, int n, int slop) {
+    const int *pos[MAX_PHRASE_TERMS];
+    int cnt[MAX_PHRASE_TERMS], at[MAX_PHRASE_TERMS];
+    for (int i = 0; i < n; i++) {
+        pos[i] = postingPositions(&terms[i].cur);
+        cnt[i] = terms[i].cur.frequency;
+        at[i] = 0;
+    }
+    for (int s = 0; s < cnt[0]; s++) {
+        int start = pos[0][s], prev = start, ok = 1;
+        for (int i = 1; i < n && ok; i++) {
+            int need = prev + terms[i].offset - terms[i - 1].offset;
+            while (at[i] < cnt[i] && pos[i][at[i]] < need) at[i]++;
+            if (at[i] == cnt[i]) return 0;      /* later starts need even more */
+            prev = pos[i][at[i]];
+            ok = prev - start - (terms[i].offset - terms[0].offset) <= slop;
+        }
+        if (ok) return 1;
+    }
+    return 0;
+}
+
+/* Sorted docIds where phrase node n matches within its slop. */
+static int *matchPhrase(const Index *idx, Arena *arena, QueryNode *n, int *nOut) {
+    int nt = n->phraseTerms;
+    *nOut = 0;
+    if (nt <= 0) return emptySet(arena);
+
+    /* rarest term leads the intersection */
+    PhraseTerm *order[MAX_PHRASE_TERMS];
+    for (int i = 0; i < nt; i++) {
+        PhraseTerm *t = &n->phrase[i];
+        openPostings(idx, t->rec, &t->cur);
+        t->cur.arena = arena;
+        int j = i - 1;
+        while (j >= 0 && order[j]->rec->docFrequency > t->rec->docFrequency) { order[j + 1] = order[j]; j--; }
+        order[j + 1] = t;
+    }
+
+    int *res = arenaAlloc(arena, sizeof(int) * order[0]->rec->docFrequency);
+    int k = 0;
+    PostingCursor *lead = &order[0]->cur;
+    int doc = nextPosting(lead) ? lead->docId : -1;
+    while (doc >= 0) {
+        int i = 1;
+        for (; i < nt; i++) {
+            if (!advancePosting(&order[i]->cur, doc)) { doc = -1; break; }
+            if (order[i]->cur.docId != doc) break;
+        }
+        if (doc < 0) break;
+        if (i == nt) {
+            /* without positions a phrase only needs all of its words */
+            if (!indexHasPositions(idx) || positionsMatch(n->phrase, nt, n->slop)) res[k++] = doc;
+            doc = nextPosting(lead) ? lead->docId : -1;
+        } else {
+            /* order[i] overshot: jump the lead to where it landed */
+            doc = advancePosting(lead, order[i]->cur.docId) ? lead->docId : -1;
+        }
+    }
+    for (int i = 0; i < nt; i++) {
+        n->visited += n->phrase[i].cur.decoded;
+        closePostings(&n->phrase[i].cur);
+    }
+    *nOut = k;
+    return res;
+}
+
+/* ---------------- Lexer ---------------- */
+
+typedef enum TokKind { T_END, T_WORD, T_PHRASE, T_AND, T_OR, T_NOT, T_LPAREN, T_RPAREN } TokKind;
+
+typedef struct Lexer {
+    const char *p;
+    TokKind kind;
+    const char *text;       /* T_WORD / T_PHRASE */
+    size_t len;
+    int slop;               /* T_PHRASE */
+} Lexer;
+
+static void nextToken(Lexer *lx) {
+    const char *p = lx->p;
+    while (isspace((unsigned char)*p)) p++;
+    lx->text = p;
+    lx->len = 0;
+    if (*p == '\0') {
+        lx->kind = T_END;
+    } else if (*p == '(' || *p == ')') {
+        lx->kind = *p++ == '(' ? T_LPAREN : T_RPAREN;
+    } else if (*p == '"') {
+        const char *end = strchr(++p, '"');
+        lx->kind = T_PHRASE;
+        lx->text = p;
+        lx->len = end ? (size_t)(end - p) : strlen(p);
+        p += lx->len;
+        if (*p == '"') p++;
+        lx->slop = 0;
+        if (*p == '~' && isdigit((unsigned char)p[1])) {
+            char *after;
+            lx->slop = (int)strtol(p + 1, &after, 10);
+            p = after;
+        }
+    } else {
+        while (*p && !isspace((unsigned char)*p) && *p != '(' && *p != ')' && *p != '"') p++;
+        lx->len = (size_t)(p - lx->text);
+        lx->kind = T_WORD;
+        if (lx->len == 3 && strncasecmp(lx->text, "AND", 3) == 0) lx->kind = T_AND;
+        else if (lx->len == 2 && strncasecmp(lx->text, "OR", 2) == 0) lx->kind = T_OR;
+        else if (lx->len == 3 && strncasecmp(lx->text, "NOT", 3) == 0) lx->kind = T_NOT;
+    }
+    lx->p = p;
+}
+
+/* ---------------- Wildcards ---------------- */
+
+static int maxExpansions = DEFAULT_MAX_EXPANSIONS;
+
+void setMaxExpansions(int n) {
+    maxExpansions = n < 1 ? 1 : n;
+}
+
+/* Is s[i] a wildcard? '*' always is; '?' only with a letter, digit or '*'
+   somewhere after it, so the '?' ending "new york?" stays punctuation. */
+static int wildcardAt(const char *s, size_t len, size_t i) {
+    if (s[i] == '*') return 1;
+    if (s[i] != '?') return 0;
+    for (size_t j = i + 1; j < len; j++)
+        if (isalnum((unsigned char)s[j]) || s[j] == '*') return 1;
+    return 0;
+}
+
+static int hasWildcard(const char *s, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        if (wildcardAt(s, len, i)) return 1;
+    return 0;
+}
+
+/* a word as the index spells it: lowercase letters and digits, plus the
+   wildcards when it is a pattern */
+static char *normalizeWord(Arena *arena, const char *s, size_t len, size_t *outLen) {
+    char *w = arenaAlloc(arena, len + 1);
+    size_t k = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (isalnum(c)) w[k++] = (char)tolower(c);
+        else if (wildcardAt(s, len, i)) w[k++] = (char)c;
+    }
+    w[k] = '\0';
+    *outLen = k;
+    return w;
+}
+
+static int globMatch(const char *p, const char *s) {
+    const char *star = NULL, *resume = NULL;
+    while (*s) {
+        if (*p == '?' || (*p && *p != '*' && *p == *s)) {
+            p++;
+            s++;
+        } else if (*p == '*') {
+            star = p++;
+            resume = s;
+        } else if (star) {
+            p = star + 1;
+            s = ++resume;
+        } else {
+            return 0;
+        }
+    }
+    while (*p == '*') p++;
+    return *p == '\0';
+}
+
+int matchWildcard(const Index *idx, const char *pattern, int max, Arena *arena, const char **out) {
+    size_t prefix = strcspn(pattern, "*?");
+    TermCursor c;
+    openTerms(idx, &c);
+    int n = 0;
+    for (int ok = seekTerm(&c, pattern, prefix); ok && n < max; ok = nextTerm(&c)) {
+        if (c.len < prefix || memcmp(c.word, pattern, prefix) != 0) break;
+        if (globMatch(pattern + prefix, c.word + prefix)) out[n++] = arenaStrdup(arena, c.word, c.len);
+    }
+    closeTerms(&c);
+    return n;
+}
+
+int unionTerms(const char *const *a, int na, const char *const *b, int nb, int max, const char **out) {
+    int i = 0, j = 0, k = 0;
+    while (k < max && (i < na || j < nb)) {
+        int r = i == na ? 1 : j == nb ? -1 : strcmp(a[i], b[j]);
+        if (r <= 0) out[k++] = a[i++];
+        else out[k++] = b[j++];
+        if (r == 0) j++;
+    }
+    return k;
+}
+
+static void appendText(Arena *arena, char **buf, size_t *len, size_t *cap, const char *s, size_t n) {
+    if (*len + n + 1 > *cap) {
+        size_t nc = (*len + n + 1) * 2;
+        *buf = arenaGrow(arena, *buf, *cap, nc);
+        *cap = nc;
+    }
+    memcpy(*buf + *len, s, n);
+    *len += n;
+    (*buf)[*len] = '\0';
+}
+
+const char *expandWildcards(const char *text, TermLister lister, void *ctx, Arena *arena) {
+    if (!strpbrk(text, "*?")) return text;
+    size_t len = 0, cap = strlen(text) + 1;
+    char *out = arenaAlloc(arena, cap);
+    const char **terms = arenaAlloc(arena, sizeof(char *) * maxExpansions);
+    const char *copied = text;
+    Lexer lx = { text, T_END, NULL, 0, 0 };
+    for (nextToken(&lx); lx.kind != T_END; nextToken(&lx)) {
+        if (lx.kind != T_WORD || !hasWildcard(lx.text, lx.len)) continue;
+        size_t plen;
+        const char *pattern = normalizeWord(arena, lx.text, lx.len, &plen);
+        int n = lister(pattern, maxExpansions, arena, terms, ctx);
+        if (n == 0) continue;
+        appendText(arena, &out, &len, &cap, copied, (size_t)(lx.text - copied));
+        appendText(arena, &out, &len, &cap, "(", 1);
+        for (int i = 0; i < n; i++) {
+            /* a term spelled like an operator goes in as a one-word phrase */
+            int op = strcmp(terms[i], "and") == 0 || strcmp(terms[i], "or") == 0 || strcmp(terms[i], "not") == 0;
+            if (i) appendText(arena, &out, &len, &cap, " OR ", 4);
+            if (op) appendText(arena, &out, &len, &cap, "\"", 1);
+            appendText(arena, &out, &len, &cap, terms[i], strlen(terms[i]));
+            if (op) appendText(arena, &out, &len, &cap, "\"", 1);
+        }
+        appendText(arena, &out, &len, &cap, ")", 1);
+        copied = lx.text + lx.len;
+    }
+    appendText(arena, &out, &len, &cap, copied, strlen(copied));
+    return out;
+}
+
+/* ---------------- Parser ----------------
+   Lenient like the scanner it replaces: stray operators and ')' are
+   skipped, a missing ')' is implied, and stop words vanish (a NULL
+   subtree), so "a AND the" is just "a". */
+
+typedef struct Parser {
+    Lexer lx;
+    const Index *idx;
+    Arena *arena;
+    int negated;            /* inside an odd number of NOTs */
+    Query *q;
+} Parser;
+
+static QueryNode *newNode(Parser *ps, QueryOp op) {
+    QueryNode *n = arenaAlloc(ps->arena, sizeof(QueryNode));
+    memset(n, 0, sizeof(*n));
+    n->op = op;
+    n->outCount = -1;
+    return n;
+}
+
+static QueryNode *binary(Parser *ps, QueryOp op, QueryNode *a, QueryNode *b) {
+    if (!a) return b;
+    if (!b) return a;
+    QueryNode *n = newNode(ps, op);
+    n->kids = arenaAlloc(ps->arena, sizeof(QueryNode *) * 2);
+    n->kids[0] = a;
+    n->kids[1] = b;
+    n->nkids = 2;
+    return n;
+}
+
+static void addWord(Parser *ps, const char *w) {
+    if (!ps->negated) ps->q->words[ps->q->wordCount++] = w;
+}
+
+static QueryNode *parseOr(Parser *ps);
+
+static QueryNode *parseWord(Parser *ps) {
+    size_t k;
+    const char *w = normalizeWord(ps->arena, ps->lx.text, ps->lx.len, &k);
+    int wild = hasWildcard(w, k);
+    nextToken(&ps->lx);
+    QueryNode *n = newNode(ps, Q_TERM);
+    n->text = w;
+    /* expandWildcards() left it: nothing matches */
+    if (wild) return n;
+    if (isStopWordLen(w, k)) return NULL;
+    addWord(ps, w);
+    n->rec = findTermRecord(ps->idx, w);
+    return n;
+}
+
+static QueryNode *parsePhrase(Parser *ps) {
+    QueryNode *n = newNode(ps, Q_PHRASE);
+    n->text = arenaStrdup(ps->arena, ps->lx.text, ps->lx.len);
+    n->slop = ps->lx.slop;
+    PhraseParse pp = { ps->idx, ps->arena, arenaAlloc(ps->arena, sizeof(PhraseTerm) * MAX_PHRASE_TERMS),
+                       0, 0, 0, ps->negated ? NULL : ps->q->words, &ps->q->wordCount };
+    tokenizeBuffer(ps->lx.text, ps->lx.len, addPhraseToken, &pp);
+    n->phrase = pp.terms;
+    n->phraseTerms = pp.missing ? -1 : pp.n;
+    nextToken(&ps->lx);
+    return n;
+}
+
+static QueryNode *parsePrimary(Parser *ps) {
+    for (;;) {
+        switch (ps->lx.kind) {
+        case T_LPAREN: {
+            nextToken(&ps->lx);
+            QueryNode *n = parseOr(ps);
+            if (ps->lx.kind == T_RPAREN) nextToken(&ps->lx);
+            return n;
+        }
+        case T_WORD:
+            return parseWord(ps);
+        case T_PHRASE:
+            return parsePhrase(ps);
+        case T_AND:
+        case T_OR:
+            nextToken(&ps->lx);     /* operator with no left operand */
+            continue;
+        default:
+            return NULL;
+        }
+    }
+}
+
+static QueryNode *parseUnary(Parser *ps) {
+    if (ps->lx.kind != T_NOT) return parsePrimary(ps);
+    nextToken(&ps->lx);
+    ps->negated ^= 1;
+    QueryNode *kid = parseUnary(ps);
+    ps->negated ^= 1;
+    if (!kid) return NULL;
+    QueryNode *n = newNode(ps, Q_NOT);
+    n->kids = arenaAlloc(ps->arena, sizeof(QueryNode *));
+    n->kids[0] = kid;
+    n->nkids = 1;
+    return n;
+}
+
+static int startsOperand(TokKind k) {
+    return k == T_WORD || k == T_PHRASE || k == T_LPAREN || k == T_NOT;
+}
+
+static QueryNode *parseAnd(Parser *ps) {
+    QueryNode *left = parseUnary(ps);
+    for (;;) {
+        if (ps->lx.kind == T_AND) nextToken(&ps->lx);
+        else if (!startsOperand(ps->lx.kind)) return left;
+        left = binary(ps, Q_AND, left, parseUnary(ps));
+    }
+}
+
+static QueryNode *parseOr(Parser *ps) {
+    QueryNode *left = parseAnd(ps);
+    while (ps->lx.kind == T_OR) {
+        nextToken(&ps->lx);
+        left = binary(ps, Q_OR, left, parseAnd(ps));
+    }
+    return left;
+}
+
+/* ---------------- Planner ---------------- */
+
+typedef struct Planner {
+    Arena *arena;
+    double N;
+} Planner;
+
+static void countFlat(QueryNode *n, QueryOp op, int *count) {
+    if (n->op == op) for (int i = 0; i < n->nkids; i++) countFlat(n->kids[i], op, count);
+    else (*count)++;
+}
+
+static void gatherFlat(QueryNode *n, QueryOp op, QueryNode **out, int *k) {
+    if (n->op == op) for (int i = 0; i < n->nkids; i++) gatherFlat(n->kids[i], op, out, k);
+    else out[(*k)++] = n;
+}
+
+/* cost of probing each of `candidates` docs against a posting list of df:
+   at worst every probe decodes a fresh block */
+static double probeCost(double df, double candidates) {
+    double c = candidates * POSTING_BLOCK;
+    return c < df ? c : df;
+}
+
+static QueryNode *planNode(Planner *pl, QueryNode *n);
+
+static QueryNode *allNode(Planner *pl) {
+    QueryNode *a = arenaAlloc(pl->arena, sizeof(QueryNode));
+    memset(a, 0, sizeof(*a));
+    a->op = Q_ALL;
+    a->outCount = -1;
+    a->estDocs = pl->N;
+    return a;
+}
+
+/* A NOT that is not an AND operand filters the whole collection. */
+static QueryNode *wrapNot(Planner *pl, QueryNode *n) {
+    if (n->op != Q_NOT) return n;
+    QueryNode *a = arenaAlloc(pl->arena, sizeof(QueryNode));
+    memset(a, 0, sizeof(*a));
+    a->op = Q_AND;
+    a->outCount = -1;
+    a->kids = arenaAlloc(pl->arena, sizeof(QueryNode *));
+    a->kids[0] = n;
+    a->nkids = 1;
+    return planNode(pl, a);
+}
+
+static int byEstDocs(const void *x, const void *y) {
+    double a = (*(QueryNode * const *)x)->estDocs, b = (*(QueryNode * const *)y)->estDocs;
+    return (a > b) - (a < b);
+}
+
+/* negated operands: the one excluding the most docs goes first */
+static int byExcluded(const void *x, const void *y) {
+    double a = (*(QueryNode * const *)x)->kids[0]->estDocs, b = (*(QueryNode * const *)y)->kids[0]->estDocs;
+    return (a < b) - (a > b);
+}
+
+static QueryNode *planNode(Planner *pl, QueryNode *n) {
+    switch (n->op) {
+    case Q_TERM:
+        n->estDocs = n->estCost = n->rec ? n->rec->docFrequency : 0;
+        return n;
+    case Q_PHRASE: {
+        double minDf = 0, cost = 0;
+        for (int i = 0; i < n->phraseTerms; i++) {
+            double df = n->phrase[i].rec->docFrequency;
+            if (i == 0 || df < minDf) minDf = df;
+        }
+        for (int i = 0; i < n->phraseTerms; i++)
+            cost += probeCost(n->phrase[i].rec->docFrequency, minDf);
+        n->estDocs = n->phraseTerms > 0 ? minDf : 0;
+        n->estCost = n->phraseTerms > 0 ? cost : 0;
+        return n;
+    }
+    case Q_ALL:
+        return n;
+    case Q_NOT: {
+        QueryNode *kid = planNode(pl, n->kids[0]);
+        if (kid->op == Q_NOT) return kid->kids[0];     /* NOT NOT x = x */
+        n->kids[0] = kid;
+        n->estDocs = pl->N - kid->estDocs;
+        n->estCost = kid->estCost;
+        return n;
+    }
+    case Q_OR: {
+        int count = 0, k = 0;
+        countFlat(n, Q_OR, &count);
+        QueryNode **kids = arenaAlloc(pl->arena, sizeof(QueryNode *) * count);
+        gatherFlat(n, Q_OR, kids, &k);
+        double docs = 0, cost = 0;
+        for (int i = 0; i < count; i++) {
+            kids[i] = wrapNot(pl, planNode(pl, kids[i]));
+            docs += kids[i]->estDocs;
+            cost += kids[i]->estCost;
+        }
+        qsort(kids, count, sizeof(QueryNode *), byEstDocs);   /* cheap merges first */
+        n->kids = kids;
+        n->nkids = count;
+        n->estDocs = docs < pl->N ? docs : pl->N;
+        n->estCost = cost;
+        return n;
+    }
+    case Q_AND: {
+        int count = 0, k = 0;
+        countFlat(n, Q_AND, &count);
+        QueryNode **flat = arenaAlloc(pl->arena, sizeof(QueryNode *) * count);
+        gatherFlat(n, Q_AND, flat, &k);
+        QueryNode **kids = arenaAlloc(pl->arena, sizeof(QueryNode *) * (count + 1));
+        int pos = 0, neg = 0;
+        for (int i = 0; i < count; i++) {
+            QueryNode *c = planNode(pl, flat[i]);
+            if (c->op != Q_NOT) kids[pos++] = c;
+            else flat[neg++] = c;
+        }
+        if (pos == 0) kids[pos++] = allNode(pl);
+        qsort(kids, pos, sizeof(QueryNode *), byEstDocs);
+        qsort(flat, neg, sizeof(QueryNode *), byExcluded);
+        memcpy(kids + pos, flat, sizeof(QueryNode *) * neg);
+        if (pos + neg == 1) return kids[0];
+
+        /* the rarest operand is materialized; the rest filter it */
+        double cand = kids[0]->estDocs, cost = kids[0]->estCost;
+        for (int i = 1; i < pos + neg; i++) {
+            QueryNode *c = kids[i], *t = c->op == Q_NOT ? c->kids[0] : c;
+            if (t->op == Q_TERM) c->estCost = t->estCost = probeCost(t->estDocs, cand);
+            if (t->op == Q_OR) {
+                /* an OR of terms can be probed like a term when that beats merging it */
+                double probe = 0;
+                int terms = 1;
+                for (int j = 0; j < t->nkids; j++) {
+                    terms &= t->kids[j]->op == Q_TERM;
+                    probe += probeCost(t->kids[j]->estDocs, cand);
+                }
+                if (terms && probe < t->estCost) {
+                    t->probe = 1;
+                    for (int j = 0; j < t->nkids; j++)
+                        t->kids[j]->estCost = probeCost(t->kids[j]->estDocs, cand);
+                    c->estCost = t->estCost = probe;
+                }
+            }
+            cost += c->estCost;
+            if (c->op != Q_NOT && c->estDocs < cand) cand = c->estDocs;
+        }
+        n->kids = kids;
+        n->nkids = pos + neg;
+        n->estDocs = kids[0]->estDocs;
+        n->estCost = cost;
+        return n;
+    }
+    }
+    return n;
+}
+
+void compileQuery(const Index *idx, const char *text, Arena *arena, Query *q) {
+    size_t len = strlen(text);
+    q->root = NULL;
+    q->wordCount = 0;
+    q->pairCache = NULL;
+    q->words = arenaAlloc(arena, sizeof(char *) * (len + 1));
+
+    Parser ps = { { text, T_END, NULL, 0, 0 }, idx, arena, 0, q };
+    nextToken(&ps.lx);
+    QueryNode *root = parseOr(&ps);
+    while (ps.lx.kind != T_END) {         /* stray ')' */
+        nextToken(&ps.lx);
+        root = binary(&ps, Q_AND, root, parseOr(&ps));
+    }
+    if (!root) return;
+
+    Planner pl = { arena, (double)indexDocCount(idx) };
+    q->root = wrapNot(&pl, planNode(&pl, root));
+}
+
+int queryIsDisjunction(const Query *q) {
+    const QueryNode *r = q->root;
+    if (!r) return 0;
+    if (r->op == Q_TERM) return 1;
+    if (r->op != Q_OR) return 0;
+    for (int i = 0; i < r->nkids; i++)
+        if (r->kids[i]->op != Q_TERM) return 0;
+    return 1;
+}
+
+/* ---------------- Executor ---------------- */
+
+/* The AND's two leading terms, intersected. Pairs common enough to pass
+   the cache's admission are kept, so repeats skip both posting lists. */
+#define PAIR_MIN_DOCS 1024      /* smaller lists are cheaper to redo than to store */
+
+static int *intersectPair(const Index *idx, Arena *arena, LruCache *pairs, QueryNode *n, int *nOut) {
+    QueryNode *a = n->kids[0], *b = n->kids[1];
+    const char *x = a->text, *y = b->text;
+    if (strcmp(x, y) > 0) { const char *t = x; x = y; y = t; }
+    size_t lx = strlen(x), ly = strlen(y), len;
+    /* the pair cache is shared by every segment, so its key names the image */
+    size_t keyLen = lx + ly + 1 + sizeof(idx->generation);
+    char *key = arenaAlloc(arena, keyLen);
+    memcpy(key, x, lx);
+    key[lx] = '&';
+    memcpy(key + lx + 1, y, ly);
+    memcpy(key + lx + 1 + ly, &idx->generation, sizeof(idx->generation));
+
+    int *res = cacheGet(pairs, key, keyLen, idx->generation, arena, &len);
+    if (res) {
+        n->pairCached = 1;
+        *nOut = b->outCount = (int)(len / sizeof(int));
+        return res;
+    }
+    int count;
+    res = collectDocIds(idx, arena, a, &count);
+    a->outCount = count;
+    count = filterByTerm(idx, res, count, b, 1);
+    b->outCount = count;
+    cachePut(pairs, key, keyLen, idx->generation, res, sizeof(int) * count);
+    *nOut = count;
+    return res;
+}
+
+/* Operands the AND can combine as docId sets: a dense term (its set is
+   kept by the index), every doc, or an OR of dense terms. */
+static int setOperand(const Index *idx, const QueryNode *n) {
+    if (n->op == Q_ALL) return 1;
+    if (n->op == Q_TERM) return n->rec && termIsDense(idx, n->rec);
+    if (n->op != Q_OR) return 0;
+    for (int i = 0; i < n->nkids; i++)
+        if (n->kids[i]->op != Q_TERM || !setOperand(idx, n->kids[i])) return 0;
+    return 1;
+}
+
+static const DocSet *operandSet(const Index *idx, Arena *arena, QueryNode *n) {
+    const DocSet *s;
+    uint64_t decoded;
+    if (n->op == Q_ALL) {
+        s = docSetRange(indexDocCount(idx), arena);
+    } else if (n->op == Q_TERM) {
+        s = termDocSet(idx, n->rec, &decoded);
+        n->visited += decoded;
+    } else {
+        s = operandSet(idx, arena, n->kids[0]);
+        for (int i = 1; i < n->nkids; i++) {
+            s = docSetOr(s, operandSet(idx, arena, n->kids[i]), arena);
+            n->visited += n->kids[i]->visited;
+        }
+        n->visited += n->kids[0]->visited;
+    }
+    n->viaSet = 1;
+    n->outCount = (int)s->card;
+    return s;
+}
+
+/* The AND's leading run of set operands, combined as sets. Returns the
+   number of operands consumed (0 if fewer than two qualify). */
+static int intersectSets(const Index *idx, Arena *arena, QueryNode *n, int **res, int *nOut) {
+    QueryNode *second = n->kids[1]->op == Q_NOT ? n->kids[1]->kids[0] : n->kids[1];
+    if (!setOperand(idx, n->kids[0]) || !setOperand(idx, second)) return 0;
+    const DocSet *acc = operandSet(idx, arena, n->kids[0]);
+    int i = 1;
+    for (; i < n->nkids && acc->card > 0; i++) {
+        QueryNode *c = n->kids[i];
+        int keep = c->op != Q_NOT;
+        QueryNode *t = keep ? c : c->kids[0];
+        if (!setOperand(idx, t)) break;
+        const DocSet *s = operandSet(idx, arena, t);
+        acc = keep ? docSetAnd(acc, s, arena) : docSetAndNot(acc, s, arena);
+        if (!keep) c->visited = t->visited;
+        c->outCount = (int)acc->card;
+    }
+    n->viaSet = 1;
+    *res = docSetToArray(acc, arena, nOut);
+    return i;
+}
+
+static int *evalNode(const Index *idx, Arena *arena, LruCache *pairs, QueryNode *n, int *nOut) {
+    int *res = NULL, count = 0;
+    switch (n->op) {
+    case Q_TERM:
+        if (n->rec && termIsDense(idx, n->rec)) res = docSetToArray(operandSet(idx, arena, n), arena, &count);
+        else res = collectDocIds(idx, arena, n, &count);
+        break;
+    case Q_PHRASE:
+        res = matchPhrase(idx, arena, n, &count);
+        break;
+    case Q_ALL:
+        count = indexDocCount(idx);
+        res = arenaAlloc(arena, sizeof(int) * (count ? count : 1));
+        for (int i = 0; i < count; i++) res[i] = i;
+        break;
+    case Q_OR:
+        res = evalNode(idx, arena, pairs, n->kids[0], &count);
+        for (int i = 1; i < n->nkids; i++) {
+            int nb;
+            int *b = evalNode(idx, arena, pairs, n->kids[i], &nb);
+            res = unionArrays(arena, res, count, b, nb, &count);
+        }
+        break;
+    case Q_AND: {
+        int i = n->nkids > 1 ? intersectSets(idx, arena, n, &res, &count) : 0;
+        if (i > 0) {
+            /* the rest filter the set result below */
+        } else if (pairs && n->kids[0]->op == Q_TERM && n->kids[1]->op == Q_TERM
+            && n->kids[0]->rec && n->kids[1]->rec && n->kids[0]->rec->docFrequency >= PAIR_MIN_DOCS) {
+            res = intersectPair(idx, arena, pairs, n, &count);
+            i = 2;
+        } else {
+            res = evalNode(idx, arena, pairs, n->kids[0], &count);
+            i = 1;
+        }
+        for (; i < n->nkids && count > 0; i++) {
+            QueryNode *c = n->kids[i];
+            int keep = c->op != Q_NOT;
+            QueryNode *t = keep ? c : c->kids[0];
+            if (t->op == Q_TERM) {
+                count = filterByTerm(idx, res, count, t, keep);
+            } else if (t->probe) {
+                count = filterByAnyTerm(idx, arena, res, count, t, keep);
+                for (int j = 0; j < t->nkids; j++) t->visited += t->kids[j]->visited;
+                if (keep) t->outCount = count;
+            } else {
+                int nb;
+                int *b = evalNode(idx, arena, pairs, t, &nb);
+                if (keep) res = intersectArrays(res, count, b, nb, &count);
+                else count = differenceArrays(res, count, b, nb);
+            }
+            if (!keep) c->visited = t->visited;
+            c->outCount = count;
+        }
+        break;
+    }
+    case Q_NOT:
+        break;      /* only ever an AND operand after planning */
+    }
+    for (int i = 0; i < n->nkids && n->op != Q_NOT; i++) n->visited += n->kids[i]->visited;
+    n->outCount = count;
+    *nOut = count;
+    return res;
+}
+
+int *executeQuery(const Index *idx, Query *q, Arena *arena, int *nOut) {
+    if (!q->root) { *nOut = 0; return emptySet(arena); }
+    return evalNode(idx, arena, q->pairCache, q->root, nOut);
+}
+
+/* ---------------- Cache key ----------------
+   The planned tree printed with AND/OR operands sorted, so grouping and
+   operand order don't matter (flattening already undid nesting), followed
+   by the sorted scoring words, which ranking depends on:
+     "&(dog,|(cat,mouse),!fish)#cat dog mouse"  */
+
+typedef struct KeyBuf {
+    Arena *arena;
+    char *s;
+    size_t len, cap;
+} KeyBuf;
+
+static void keyPut(KeyBuf *k, const char *s, size_t len) {
+    if (k->len + len + 1 > k->cap) {
+        size_t cap = (k->cap ? k->cap * 2 : 64) + len;
+        k->s = arenaGrow(k->arena, k->s, k->cap, cap);
+        k->cap = cap;
+    }
+    memcpy(k->s + k->len, s, len);
+    k->len += len;
+    k->s[k->len] = '\0';
+}
+
+static void keyStr(KeyBuf *k, const char *s) {
+    keyPut(k, s, strlen(s));
+}
+
+static int cmpStr(const void *a, const void *b) {
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+typedef struct PhraseKey {
+    KeyBuf *k;
+    int pos;
+    int first;              /* offset of the first non stop word */
+    int words;
+} PhraseKey;
+
+static void addPhraseKeyToken(const char *tok, size_t len, size_t at, void *ctx) {
+    (void)at;
+    PhraseKey *pk = ctx;
+    int offset = pk->pos++;
+    if (isStopWordLen(tok, len)) return;
+    char num[32];
+    if (pk->first < 0) pk->first = offset;
+    if (pk->words++) keyStr(pk->k, " ");
+    keyPut(pk->k, tok, len);
+    snprintf(num, sizeof(num), "@%d", offset - pk->first);
+    keyStr(pk->k, num);
+}
+
+static const char *nodeKey(Arena *arena, const QueryNode *n) {
+    KeyBuf k = { arena, NULL, 0, 0 };
+    char num[32];
+    switch (n->op) {
+    case Q_TERM:
+        keyStr(&k, n->text);
+        break;
+    case Q_PHRASE: {
+        /* its words at offsets relative to the first, re-tokenized from the
+           text so the key doesn't depend on which words an index holds */
+        PhraseKey pk = { &k, 0, -1, 0 };
+        keyStr(&k, "\"");
+        tokenizeBuffer(n->text, strlen(n->text), addPhraseKeyToken, &pk);
+        snprintf(num, sizeof(num), "\"~%d", pk.words ? n->slop : 0);
+        keyStr(&k, num);
+        break;
+    }
+    case Q_ALL:
+        keyStr(&k, "*");
+        break;
+    case Q_NOT:
+        keyStr(&k, "!");
+        keyStr(&k, nodeKey(arena, n->kids[0]));
+        break;
+    case Q_AND:
+    case Q_OR: {
+        const char **kids = arenaAlloc(arena, sizeof(char *) * n->nkids);
+        for (int i = 0; i < n->nkids; i++) kids[i] = nodeKey(arena, n->kids[i]);
+        qsort(kids, n->nkids, sizeof(char *), cmpStr);
+        keyStr(&k, n->op == Q_AND ? "&(" : "|(");
+        for (int i = 0; i < n->nkids; i++) {
+            if (i) keyStr(&k, ",");
+            keyStr(&k, kids[i]);
+        }
+        keyStr(&k, ")");
+        break;
+    }
+    }
+    return k.s;
+}
+
+const char *queryCacheKey(const Query *q, Arena *arena, size_t *len) {
+    KeyBuf k = { arena, NULL, 0, 0 };
+    keyStr(&k, q->root ? nodeKey(arena, q->root) : "");
+    keyStr(&k, "#");
+    const char **words = arenaAlloc(arena, sizeof(char *) * (q->wordCount ? q->wordCount : 1));
+    memcpy(words, q->words, sizeof(char *) * q->wordCount);
+    qsort(words, q->wordCount, sizeof(char *), cmpStr);
+    for (int i = 0; i < q->wordCount; i++) {
+        if (i) keyStr(&k, " ");
+        keyStr(&k, words[i]);
+    }
+    *len = k.len;
+    return k.s;
+}
+
+/* ---------------- --explain ---------------- */
+
+static void explainNode(const QueryNode *n, int depth, FILE *out) {
+    char label[160];
+    switch (n->op) {
+    case Q_TERM:
+        snprintf(label, sizeof(label), "TERM %s%s", n->text, !n->rec ? " (not indexed)" : n->viaSet ? " (set)" : "");
+        break;
+    case Q_PHRASE:
+        if (n->slop) snprintf(label, sizeof(label), "PHRASE \"%s\"~%d", n->text, n->slop);
+        else snprintf(label, sizeof(label), "PHRASE \"%s\"", n->text);
+        break;
+    case Q_AND: snprintf(label, sizeof(label), n->pairCached ? "AND (pair cached)" : n->viaSet ? "AND (sets)" : "AND"); break;
+    case Q_OR:  snprintf(label, sizeof(label), n->viaSet ? "OR (set)" : n->probe ? "OR (filter)" : "OR"); break;
+    case Q_NOT:
+        if (n->kids[0]->op == Q_TERM)
+            snprintf(label, sizeof(label), "NOT %s (%s)", n->kids[0]->text, n->kids[0]->viaSet ? "set" : "filter");
+        else snprintf(label, sizeof(label), n->kids[0]->viaSet ? "NOT (set)" : "NOT (filter)");
+        break;
+    case Q_ALL: snprintf(label, sizeof(label), n->viaSet ? "ALL DOCS (set)" : "ALL DOCS"); break;
+    }
+    fprintf(out, "  %*s%-*s est=%-10.0f visited=%-10llu ", depth * 2, "", 36 - depth * 2, label,
+            n->estCost, (unsigned long long)n->visited);
+    if (n->outCount < 0) fprintf(out, n->visited ? "docs=-\n" : "docs=- (skipped)\n");
+    else fprintf(out, "docs=%d\n", n->outCount);
+    if (n->op == Q_NOT && n->kids[0]->op == Q_TERM) return;   /* shown on the NOT line */
+    for (int i = 0; i < n->nkids; i++) explainNode(n->kids[i], depth + 1, out);
+}
+
+void explainQuery(const Query *q, const char *rawQuery, const char *strategy, FILE *out) {
+    fprintf(out, "Plan for '%s' (%s):\n", rawQuery, strategy);
+    if (!q->root) { fprintf(out, "  (nothing to search: only stop words)\n"); return; }
+    explainNode(q->root, 0, out);
+}
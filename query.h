@@ -0,0 +1,97 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdio.h>
+#include "store.h"
+#include "cache.h"
+
+/* ---------------- Query compiler ----------------
+   Grammar (operators are case-insensitive; juxtaposition means AND):
+
+     or      := and ( OR and )*
+     and     := unary ( [AND] unary )*
+     unary   := NOT unary | primary
+     primary := '(' or ')' | '"' phrase '"' [ '~' N ] | word | wildcard
+
+   compileQuery() parses into an AST and rewrites it into a plan: nested
+   AND/OR are flattened, AND operands are ordered rarest first, and NOT
+   operands become filters on the AND's running candidate list instead of
+   complements of the whole collection. Stop words drop out of the tree.
+   Everything lives in the caller's arena. */
+
+typedef enum QueryOp {
+    Q_TERM,
+    Q_PHRASE,
+    Q_AND,
+    Q_OR,
+    Q_NOT,
+    Q_ALL                       /* every doc; only appears as an AND driver */
+} QueryOp;
+
+struct PhraseTerm;
+
+typedef struct QueryNode {
+    QueryOp op;
+    const char *text;           /* TERM: normalized word; PHRASE: phrase as typed */
+    int slop;                   /* PHRASE: allowed extra tokens (~N) */
+    const TermRecord *rec;      /* TERM: NULL if not in the index */
+    struct PhraseTerm *phrase;  /* PHRASE: looked-up terms in phrase order */
+    int phraseTerms;            /* -1 if some phrase word is not in the index */
+    struct QueryNode **kids;
+    int nkids;
+    double estDocs;             /* estimated result size; drives operand order */
+    double estCost;             /* estimated postings visited */
+    int probe;                  /* OR of terms: probe the AND's candidates instead of merging */
+    uint64_t visited;           /* postings actually decoded */
+    int outCount;               /* docs produced; -1 if never evaluated */
+    int pairCached;             /* AND: its first two terms came from the pair cache */
+    int viaSet;                 /* evaluated on docId sets (docset.h) instead of postings */
+} QueryNode;
+
+typedef struct Query {
+    QueryNode *root;            /* NULL when nothing searchable is left */
+    const char **words;         /* words outside NOT, in query order (scoring) */
+    int wordCount;
+    LruCache *pairCache;        /* if set, AND reuses intersections of frequent term pairs */
+} Query;
+
+void compileQuery(const Index *idx, const char *text, Arena *arena, Query *q);
+/* Sorted docIds matching q; fills in visited/outCount on the plan. */
+int *executeQuery(const Index *idx, Query *q, Arena *arena, int *nOut);
+/* 1 if q is one term or an OR of plain terms (rankable by WAND). */
+int queryIsDisjunction(const Query *q);
+/* Canonical text of the plan plus its scoring words, equal for queries that
+   differ only in case, stop words, operand order or grouping. */
+const char *queryCacheKey(const Query *q, Arena *arena, size_t *len);
+void explainQuery(const Query *q, const char *rawQuery, const char *strategy, FILE *out);
+
+/* ---------------- Wildcards ----------------
+   A word holding '*' (any run of characters) or '?' (one character, but
+   only when a letter, digit or '*' follows it: a trailing '?' is just
+   punctuation) stands for the OR of the terms it matches, at most maxExpansions of
+   them (the first in term order). matchWildcard() seeks the sorted
+   dictionary to the pattern's literal prefix and decodes terms from there
+   until the prefix runs out or enough have matched, so `comput*` costs
+   time in proportion to its matches. Every segment and shard has its own
+   dictionary, but all of them must rank the same words, so the query
+   text is rewritten once, with the union of their matches, before any of
+   them compiles it. A wildcard that matches nothing stays as typed and
+   matches no docs. */
+
+#define DEFAULT_MAX_EXPANSIONS 128
+
+/* up to max terms matching pattern, ascending, into out[] (strings in the
+   arena); returns how many */
+typedef int (*TermLister)(const char *pattern, int max, Arena *arena, const char **out, void *ctx);
+
+/* wildcard words expand to at most n terms each */
+void setMaxExpansions(int n);
+int matchWildcard(const Index *idx, const char *pattern, int max, Arena *arena, const char **out);
+/* merge two ascending term lists into out, dropping duplicates and all
+   but the first max */
+int unionTerms(const char *const *a, int na, const char *const *b, int nb, int max, const char **out);
+/* text with each wildcard word replaced by "(t1 OR t2 ...)" of the terms
+   lister finds; text itself if it has no wildcards */
+const char *expandWildcards(const char *text, TermLister lister, void *ctx, Arena *arena);
+
+#endif
@@ -1,363 +1,715 @@
-#include "indexer.h"
-#include <string.h>   // For strncpy, strlen, strtok, and the explicit strdup prototype
-#include <stdlib.h>   // For strdup (which performs dynamic memory allocation)
-#include <strings.h>  // For strcasecmp (case-insensitive comparison)
-/* Utility: collect docIds from a posting list into a dynamically allocated array.
-    Returns number of docs in *nResults and an allocated int* (caller frees). */
-static int *collectDocIds(DocNode *list, int *nResults) {
-    int count = 0;
-    DocNode *cur = list;
-    while (cur) { count++; cur = cur->next; }
-    int *arr = malloc(sizeof(int) * count);
-    cur = list;
-    for (int i = 0; i < count; i++) { arr[i] = cur->docId; cur = cur->next; }
-    *nResults = count;
-    return arr;
+#include "search.h"
+#include "popularity.h"
+#include "query.h"
+#include "segments.h"
+#include "shard.h"
+#include "stats.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Per-thread scratch for everything a query allocates. It is reset, not
+   freed, between queries, so a warmed-up thread does no heap allocation. */
+static _Thread_local Arena scratch = { .chunkSize = 64 * 1024 };
+
+static void *scratchAlloc(size_t size) { return arenaAlloc(&scratch, size); }
+
+/* stage timings of the calling thread's last query (with tracing on) */
+static _Thread_local QueryTrace trace;
+
+const QueryTrace *lastQueryTrace(void) {
+    return &trace;
 }
 
-/* set operations on sorted arrays of ints (docs) */
-/* helper: sort small arrays of ints ascending */
-static void sortIntArray(int *a, int n) {
-    for (int i = 0; i < n - 1; ++i)
-        for (int j = i + 1; j < n; ++j)
-            if (a[j] < a[i]) { int t = a[i]; a[i] = a[j]; a[j] = t; }
+/* the calling thread's last compiled query, for its snippets (in scratch) */
+static _Thread_local const Query *lastQuery;
+
+static int explainPlans;
+static int exactScores;
+static int snippets;
+
+void setQueryExplain(int on) {
+    explainPlans = on;
 }
 
-/* intersection */
-static int *intersectArrays(int *A, int nA, int *B, int nB, int *nOut) {
-    sortIntArray(A, nA); sortIntArray(B, nB);
-    int *res = malloc(sizeof(int) * (nA < nB ? nA : nB));
-    int i=0,j=0,k=0;
-    while (i<nA && j<nB) {
-        if (A[i]==B[j]) { res[k++]=A[i]; i++; j++; }
-        else if (A[i]<B[j]) i++; else j++;
-    }
-    while (i<nA) res[k++]=A[i++];
-    while (j<nB) res[k++]=B[j++];
-    *nOut = k; return res;
-}
-
-/* union */
-static int *unionArrays(int *A, int nA, int *B, int nB, int *nOut) {
-    sortIntArray(A, nA); sortIntArray(B, nB);
-    int *res = malloc(sizeof(int) * (nA + nB));
-    int i=0,j=0,k=0;
-    while (i<nA && j<nB) {
-        if (A[i]==B[j]) { res[k++]=A[i]; i++; j++; }
-        else if (A[i]<B[j]) res[k++]=A[i++]; else res[k++]=B[j++];
-    }
-    while (i<nA) res[k++]=A[i++];
-    while (j<nB) res[k++]=B[j++];
-    *nOut = k; return res;
-}
-
-/* difference A \ B */
-static int *differenceArrays(int *A, int nA, int *B, int nB, int *nOut) {
-    sortIntArray(A, nA); sortIntArray(B, nB);
-    int *res = malloc(sizeof(int) * nA);
-    int i=0,j=0,k=0;
-    while (i<nA && j<nB) {
-        if (A[i]==B[j]) { i++; j++; }
-        else if (A[i]<B[j]) res[k++]=A[i++];
-        else j++;
-    }
-    while (i<nA) res[k++]=A[i++];
-    *nOut = k; return res;
-}
-
-/* phrase search: check if phrase (words[]) occurs in docId using position lists */
-static int phraseInDoc(WordEntry **hashTable, char **words, int wcount, int docId) {
-    if (wcount == 0) return 0;
-    WordEntry *first = findWordEntry(hashTable, words[0]);
-    if (!first) return 0;
-    /* find posting for docId in first */
-    DocNode *d0 = first->docList;
-    while (d0 && d0->docId != docId) d0 = d0->next;
-    if (!d0) return 0;
-    /* for each position p in d0, check if subsequent words have p+1, p+2 ... */
-    for (int pi = 0; pi < d0->posCount; pi++) {
-        int base = d0->positions[pi];
-        int ok = 1;
-        for (int k = 1; k < wcount; k++) {
-            WordEntry *we = findWordEntry(hashTable, words[k]);
-            if (!we) { ok = 0; break; }
-            DocNode *dk = we->docList;
-            while (dk && dk->docId != docId) dk = dk->next;
-            if (!dk) { ok = 0; break; }
-            /* check if dk->positions contains base + k */
-            int found = 0;
-            for (int m = 0; m < dk->posCount; m++)
-                if (dk->positions[m] == base + k) { found = 1; break; }
-            if (!found) { ok = 0; break; }
-        }
-        if (ok) return 1;
-    }
-    return 0;
+void setResultSnippets(int on) {
+    snippets = on;
+}
+
+int resultSnippets(void) {
+    return snippets;
+}
+
+void setExactScores(int on) {
+    exactScores = on;
+}
+
+void freeQueryScratch(void) {
+    freeArena(&scratch);
+}
+
+/* Ranked top-K lists by normalized query, and AND intersections of
+   frequent term pairs (admitted on their second sighting). */
+static LruCache resultCache, pairCache;
+static int cachesReady;
+
+void setQueryCacheBytes(size_t bytes) {
+    freeQueryCaches();
+    if (bytes == 0) return;
+    initCache(&resultCache, bytes / 2, 1);
+    initCache(&pairCache, bytes - bytes / 2, 2);
+    cachesReady = 1;
+}
+
+void freeQueryCaches(void) {
+    if (!cachesReady) return;
+    freeCache(&resultCache);
+    freeCache(&pairCache);
+    cachesReady = 0;
+}
+
+static void printCacheTier(FILE *out, const char *name, LruCache *c) {
+    CacheStats st;
+    cacheStats(c, &st);
+    uint64_t lookups = st.hits + st.misses;
+    fprintf(out, "%-7s hits=%llu misses=%llu (%.1f%% hit) evictions=%llu stale=%llu rejected=%llu "
+            "entries=%u bytes=%zu/%zu\n", name,
+            (unsigned long long)st.hits, (unsigned long long)st.misses,
+            lookups ? 100.0 * st.hits / lookups : 0.0,
+            (unsigned long long)st.evictions, (unsigned long long)st.stale,
+            (unsigned long long)st.rejected, st.entries, st.bytes, st.capacity);
+}
+
+void printCacheStats(FILE *out) {
+    if (!cachesReady) { fprintf(out, "query caches are off\n"); return; }
+    printCacheTier(out, "results", &resultCache);
+    printCacheTier(out, "pairs", &pairCache);
 }
 
-/* compute TF-IDF scores for provided doc list (docs[]) for terms in queryWords[] */
 typedef struct Score {
     int docId;
     double score;
 } Score;
 
-static Score *computeTfIdfScores(WordEntry **hashTable, char **queryWords, int qwCount, int *docs, int docCountLocal, int *outCount) {
-    /* allocate scores */
-    Score *arr = malloc(sizeof(Score) * docCountLocal);
-    for (int i = 0; i < docCountLocal; i++) arr[i].docId = docs[i], arr[i].score = 0.0;
-    int N = docCount; /* global number of docs indexed */
-    for (int t = 0; t < qwCount; t++) {
-        WordEntry *we = findWordEntry(hashTable, queryWords[t]);
-        if (!we) continue;
-        int df = we->docFrequency;
-        if (df == 0) continue;
-        double idf = log((double)N / (double)df);
-        /* for each doc in docs[], find tf (term frequency in that doc) */
+/* ---------------- Scoring ----------------
+   A term's score in a doc is idf * impact. With stored impacts, a term
+   gets an integer weight per segment, and a doc's score is the integer
+   sum of weight * quantized impact over its terms, times a per-query unit
+   shared by all segments. WEIGHT_BITS keeps the heaviest weight near 2^24,
+   so rounding the weights costs nothing next to quantizing the impacts,
+   and a 64-term sum of 16-bit impacts still fits in 64 bits. exactScores
+   recomputes every impact in floating point from tf and doc length. */
+
+#define WEIGHT_BITS 24
+
+static uint64_t termWeight(const Index *idx, const TermRecord *t, double idf, double unit) {
+    if (idf <= 0 || unit <= 0) return 0;
+    return (uint64_t)llround(idf * t->maxImpact / indexImpactMax(idx) / unit);
+}
+
+/* avgDocTerms is the view's, not the segment's (BM25) */
+static double exactImpact(const Index *idx, double avgDocTerms, const PostingCursor *c) {
+    return scoringImpact((ScoringModel)idx->hdr->scoring, avgDocTerms, c->frequency,
+                         indexDocTerms(idx, c->docId));
+}
+
+/* Score the sorted matches docs[] by the terms in queryWords[]; idf[t] is
+   queryWords[t]'s idf over the whole view, not just this segment. */
+static Score *scoreMatches(const Index *idx, double avgDocTerms, const char *const *queryWords, const double *idf,
+                           double unit, int qwCount, int *docs, int docCountLocal, QueryTrace *t) {
+    Score *arr = scratchAlloc(sizeof(Score) * (docCountLocal ? docCountLocal : 1));
+    uint64_t *acc = exactScores ? NULL : scratchAlloc(sizeof(uint64_t) * (docCountLocal ? docCountLocal : 1));
+    for (int i = 0; i < docCountLocal; i++) {
+        arr[i].docId = docs[i], arr[i].score = 0.0;
+        if (acc) acc[i] = 0;
+    }
+    for (int q = 0; q < qwCount; q++) {
+        const TermRecord *we = findTermRecord(idx, queryWords[q]);
+        if (!we || we->docFrequency == 0) continue;
+        uint64_t w = termWeight(idx, we, idf[q], unit);
+        if (acc && w == 0) continue;
+        /* docs[] is sorted, so one forward pass over the postings finds every posting */
+        PostingCursor d;
+        openPostings(idx, we, &d);
         for (int i = 0; i < docCountLocal; i++) {
             int did = docs[i];
-            DocNode *d = we->docList;
-            while (d && d->docId != did) d = d->next;
-            if (d) {
-                double tf = (double)d->frequency;
-                /* optional normalization by doc length */
-                double norm = documents[did].totalTerms > 0 ? (double)documents[did].totalTerms : 1.0;
-                arr[i].score += (tf / norm) * idf;
-            }
+            if (!advancePosting(&d, did)) break;
+            if (d.docId != did) continue;
+            if (acc) acc[i] += w * (uint64_t)d.impact;
+            else arr[i].score += exactImpact(idx, avgDocTerms, &d) * idf[q];
         }
+        t->postingsScored += d.decoded;
+        closePostings(&d);
     }
-    *outCount = docCountLocal;
+    if (acc)
+        for (int i = 0; i < docCountLocal; i++) arr[i].score = (double)acc[i] * unit;
     return arr;
 }
 
-/* sort scores descending */
-static void sortScores(Score *scores, int n) {
-    for (int i = 0; i < n - 1; i++)
-        for (int j = i + 1; j < n; j++)
-            if (scores[j].score > scores[i].score) {
-                Score tmp = scores[i]; scores[i] = scores[j]; scores[j] = tmp;
-            }
+/* ---------------- Top-K selection ----------------
+   A size-K min-heap keyed on (score, then larger docId is worse), so the
+   root is always the weakest kept result and ties favour lower docIds. */
+
+typedef struct TopK {
+    Score items[TOP_K];
+    int size;
+} TopK;
+
+static int worse(const Score *a, const Score *b) {
+    if (a->score != b->score) return a->score < b->score;
+    return a->docId > b->docId;
 }
 
-/* parse a simple query supporting:
-    - quoted phrase: "this is phrase"
-    - boolean operators: AND, OR, NOT (left-to-right, NOT applied to terms)
-    process tokens left-to-right with AND/OR combining. */
-void printResultsForQuery(WordEntry **hashTable, const char *rawQuery) {
-    if (!rawQuery || strlen(rawQuery) == 0) { printf("Empty query\n"); return; }
+static void siftDown(TopK *h, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < h->size && worse(&h->items[l], &h->items[m])) m = l;
+        if (r < h->size && worse(&h->items[r], &h->items[m])) m = r;
+        if (m == i) return;
+        Score t = h->items[i]; h->items[i] = h->items[m]; h->items[m] = t;
+        i = m;
+    }
+}
 
-    /* Copy query and tokenize while preserving quoted phrases */
-    char qcopy[1024] = {0}; 
-    strncpy(qcopy, rawQuery, sizeof(qcopy) - 1);
-    qcopy[sizeof(qcopy)-1]='\0';
-
-    /* vector of intermediate docId sets */
-    int *currentDocs = NULL;
-    int currentCount = 0;
-    // Removed unused variable 'expectOp'
-
-    char *p = qcopy;
-    while (*p) {
-        while (isspace((unsigned char)*p)) p++;
-        if (*p == '\0') break;
-        if (*p == '"') {
-            /* phrase */
-            p++;
-            char phrase[512] = {0};
-            int idx = 0;
-            while (*p && *p != '"' && idx + 1 < (int)sizeof(phrase)) phrase[idx++] = *p++;
-            phrase[idx] = '\0';
-            if (*p == '"') p++;
-            /* split phrase into words */
-            char *words[64]; int wcount = 0;
-            char phcopy[512] = {0}; 
-            strncpy(phcopy, phrase, sizeof(phcopy) - 1);
-            phcopy[sizeof(phcopy)-1] = '\0';
-            toLowerCase(phcopy); removePunctuation(phcopy);
-            char *tk = strtok(phcopy, " \t\r\n");
-            while (tk && wcount < 64) {
-                if (!isStopWord(tk)) {
-                    words[wcount++] = strdup(tk);
-                }
-                tk = strtok(NULL, " \t\r\n");
-            }
-            /* collect documents that contain entire phrase */
-            int *phraseDocs = malloc(sizeof(int) * docCount);
-            int pd = 0;
-            for (int d = 0; d < docCount; d++) {
-                if (phraseInDoc(hashTable, words, wcount, d)) phraseDocs[pd++] = d;
-            }
-            /* free words */
-            for (int k = 0; k < wcount; k++) free(words[k]);
-
-            /* combine with currentDocs (if present) - default initial */
-            if (!currentDocs) { currentDocs = phraseDocs; currentCount = pd; }
-            else {
-                int nOut;
-                int *res = intersectArrays(currentDocs, currentCount, phraseDocs, pd, &nOut);
-                free(currentDocs); free(phraseDocs);
-                currentDocs = res; currentCount = nOut;
+static void pushTopK(TopK *h, int docId, double score) {
+    Score s = { docId, score };
+    if (h->size < TOP_K) {
+        int i = h->size++;
+        h->items[i] = s;
+        while (i > 0) {
+            int parent = (i - 1) / 2;
+            if (!worse(&h->items[i], &h->items[parent])) break;
+            Score t = h->items[i]; h->items[i] = h->items[parent]; h->items[parent] = t;
+            i = parent;
+        }
+    } else if (worse(&h->items[0], &s)) {
+        h->items[0] = s;
+        siftDown(h, 0);
+    }
+}
+
+/* score a doc must beat to enter the heap (-1 while there is room) */
+static double heapThreshold(const TopK *h) {
+    return h->size < TOP_K ? -1.0 : h->items[0].score;
+}
+
+/* drain the heap into best-first order; returns the number of results */
+static int finishTopK(TopK *h) {
+    int n = h->size;
+    while (h->size > 1) {
+        Score t = h->items[0]; h->items[0] = h->items[h->size - 1]; h->items[h->size - 1] = t;
+        h->size--;
+        siftDown(h, 0);
+    }
+    h->size = n;
+    return n;
+}
+
+/* ---------------- WAND over a disjunction of terms ----------------
+   Each term's upper bound is maxImpact * idf (times how often it was typed).
+   Cursors are kept ordered by current docId; summing bounds in that order
+   gives the first "pivot" doc that could possibly beat the heap threshold,
+   and every cursor before it is advanced straight to the pivot. Docs that
+   cannot reach the top K are never scored, and tombstoned ones are stepped
+   over. One segment at a time, into a heap shared by all of them. */
+
+typedef struct WandTerm {
+    PostingCursor cur;
+    double idf;
+    uint64_t w;             /* integer weight (see termWeight) */
+    double bound;           /* largest score the term can add, times weight */
+    int weight;             /* times the term appears in the query */
+} WandTerm;
+
+#define WAND_MAX_TERMS 64
+
+/* largest score one occurrence of the term can add; the quantized bound
+   covers the weight's rounding. maxImpact was taken against the segment's
+   own BM25 average, so under another one only BM25's ceiling holds. */
+static double termBound(const Index *idx, double avgDocTerms, const TermRecord *t, const WandTerm *w, double unit) {
+    if (exactScores && idx->hdr->scoring == SCORE_BM25 && avgDocTerms != idx->hdr->avgDocTerms)
+        return (BM25_K1 + 1) * w->idf;
+    if (exactScores) return (double)t->maxImpact * w->idf;
+    return (double)(w->w * (uint64_t)indexImpactMax(idx)) * unit;
+}
+
+static void sortByDoc(WandTerm **ts, int n) {
+    for (int i = 1; i < n; i++) {
+        WandTerm *x = ts[i];
+        int j = i - 1;
+        /* exhausted cursors (docId -1) compare as huge and sink to the end */
+        while (j >= 0 && (unsigned)ts[j]->cur.docId > (unsigned)x->cur.docId) { ts[j + 1] = ts[j]; j--; }
+        ts[j + 1] = x;
+    }
+}
+
+static void wandTopK(const Index *idx, double avgDocTerms, Query *query, const double *idf, double unit,
+                     const uint64_t *dead, int base, TopK *heap) {
+    const char *const *words = query->words;
+    int wcount = query->wordCount;
+    WandTerm terms[WAND_MAX_TERMS];
+    WandTerm *live[WAND_MAX_TERMS];
+    const TermRecord *recs[WAND_MAX_TERMS];
+    int slot[WAND_MAX_TERMS];           /* query word -> terms[] index, -1 if not indexed */
+    int n = 0;
+    for (int i = 0; i < wcount; i++) {
+        const TermRecord *t = findTermRecord(idx, words[i]);
+        slot[i] = -1;
+        if (!t || t->docFrequency == 0) continue;
+        for (int j = 0; j < n; j++)
+            if (recs[j] == t) { slot[i] = j; break; }
+        if (slot[i] >= 0) {
+            terms[slot[i]].weight++;
+            terms[slot[i]].bound += termBound(idx, avgDocTerms, t, &terms[slot[i]], unit);
+            continue;
+        }
+        WandTerm *w = &terms[n];
+        openPostings(idx, t, &w->cur);
+        w->idf = idf[i];
+        w->w = termWeight(idx, t, w->idf, unit);
+        w->bound = termBound(idx, avgDocTerms, t, w, unit);
+        w->weight = 1;
+        nextPosting(&w->cur);
+        recs[n] = t;
+        live[n] = w;
+        slot[i] = n++;
+    }
+    sortByDoc(live, n);
+
+    while (n > 0 && live[0]->cur.docId >= 0) {
+        double theta = heapThreshold(heap);
+        double acc = 0.0;
+        int p = -1;
+        for (int i = 0; i < n && live[i]->cur.docId >= 0; i++) {
+            acc += live[i]->bound;
+            if (acc > theta) { p = i; break; }
+        }
+        if (p < 0) break;
+        int pivot = live[p]->cur.docId;
+        if (live[0]->cur.docId == pivot && dead && (dead[pivot >> 6] >> (pivot & 63)) & 1) {
+            for (int i = 0; i < n && live[i]->cur.docId == pivot; i++) nextPosting(&live[i]->cur);
+        } else if (live[0]->cur.docId == pivot) {
+            /* every cursor up to the pivot sits on it: score the doc,
+               summing in query order like scoreMatches does */
+            double score = 0.0;
+            uint64_t acc = 0;
+            for (int q = 0; q < wcount; q++) {
+                if (slot[q] < 0) continue;
+                const WandTerm *w = &terms[slot[q]];
+                if (w->cur.docId != pivot) continue;
+                if (exactScores) score += exactImpact(idx, avgDocTerms, &w->cur) * w->idf;
+                else acc += w->w * (uint64_t)w->cur.impact;
             }
-            // expectOp = 1;
+            pushTopK(heap, base + pivot, exactScores ? score : (double)acc * unit);
+            for (int i = 0; i < n && live[i]->cur.docId == pivot; i++) nextPosting(&live[i]->cur);
         } else {
-            /* read next token (up to space) */
-            char tok[256] = {0}; 
-            int ti = 0;
-            while (*p && !isspace((unsigned char)*p)) { if (ti+1 < (int)sizeof(tok)) tok[ti++]=*p; p++; }
-            tok[ti]='\0';
-            /* check if operator */
-            if (strcasecmp(tok, "AND")==0 || strcasecmp(tok, "OR")==0) {
-                char op[8]; strncpy(op, tok, sizeof(op)); op[7]='\0';
-                while (isspace((unsigned char)*p)) p++;
-                if (*p == '"') {
-                    p++; char phrase[512] = {0}; int idx=0;
-                    while (*p && *p != '"' && idx+1 < (int)sizeof(phrase)) phrase[idx++] = *p++;
-                    phrase[idx]='\0'; if (*p=='"') p++;
-                    char *words[64]; int wcount=0;
-                    char phcopy[512] = {0}; strncpy(phcopy, phrase, sizeof(phcopy)-1); phcopy[sizeof(phcopy)-1]=0;
-                    toLowerCase(phcopy); removePunctuation(phcopy);
-                    char *tk = strtok(phcopy, " \t\r\n");
-                    while (tk && wcount < 64) { if (!isStopWord(tk)) words[wcount++]=strdup(tk); tk = strtok(NULL, " \t\r\n"); }
-                    int *phraseDocs = malloc(sizeof(int) * docCount); int pd=0;
-                    for (int d=0; d<docCount; d++) if (phraseInDoc(hashTable, words, wcount, d)) phraseDocs[pd++]=d;
-                    for (int k=0;k<wcount;k++) free(words[k]);
-                    if (!currentDocs) { currentDocs = phraseDocs; currentCount = pd; }
-                    else {
-                        int nOut; int *res = NULL;
-                        if (strcasecmp(op,"AND")==0) res = intersectArrays(currentDocs, currentCount, phraseDocs, pd, &nOut);
-                        else res = unionArrays(currentDocs, currentCount, phraseDocs, pd, &nOut);
-                        free(currentDocs); free(phraseDocs);
-                        currentDocs = res; currentCount = nOut;
-                    }
-                    // expectOp = 1;
-                } else {
-                    char nextTok[256] = {0}; int nti=0;
-                    while (*p && !isspace((unsigned char)*p)) { if (nti+1 < (int)sizeof(nextTok)) nextTok[nti++]=*p; p++; }
-                    nextTok[nti]=0;
-                    toLowerCase(nextTok); removePunctuation(nextTok);
-                    if (isStopWord(nextTok) || strlen(nextTok)==0) {
-                        continue;
-                    }
-                    WordEntry *we = findWordEntry(hashTable, nextTok);
-                    int *nextDocs; int nd=0;
-                    if (!we) { nextDocs = malloc(sizeof(int)*0); nd=0; }
-                    else nextDocs = collectDocIds(we->docList, &nd);
-                    if (!currentDocs) { currentDocs = nextDocs; currentCount = nd; }
-                    else {
-                        int nOut; int *res;
-                        if (strcasecmp(op,"AND")==0) res = intersectArrays(currentDocs, currentCount, nextDocs, nd, &nOut);
-                        else res = unionArrays(currentDocs, currentCount, nextDocs, nd, &nOut);
-                        free(currentDocs); free(nextDocs);
-                        currentDocs = res; currentCount = nOut;
-                    }
-                    // expectOp = 1;
-                }
-            } else if (strcasecmp(tok, "NOT")==0) {
-                while (isspace((unsigned char)*p)) p++;
-                if (*p == '"') {
-                    p++; char phrase[512] = {0}; int idx=0;
-                    while (*p && *p != '"' && idx+1 < (int)sizeof(phrase)) phrase[idx++] = *p++;
-                    phrase[idx]='\0'; if (*p=='"') p++;
-                    char *words[64]; int wcount=0;
-                    char phcopy[512] = {0}; strncpy(phcopy, phrase, sizeof(phcopy)-1); phcopy[sizeof(phcopy)-1]=0;
-                    toLowerCase(phcopy); removePunctuation(phcopy);
-                    char *tk = strtok(phcopy, " \t\r\n");
-                    while (tk && wcount < 64) { if (!isStopWord(tk)) words[wcount++]=strdup(tk); tk = strtok(NULL, " \t\r\n"); }
-                    int *phraseDocs = malloc(sizeof(int) * docCount); int pd=0;
-                    for (int d=0; d<docCount; d++) if (phraseInDoc(hashTable, words, wcount, d)) phraseDocs[pd++]=d;
-                    for (int k=0;k<wcount;k++) free(words[k]);
-                    int *allDocs = malloc(sizeof(int) * docCount);
-                    for (int i=0;i<docCount;i++) allDocs[i]=i;
-                    int *newCur; int nOut;
-                    if (!currentDocs) {
-                        newCur = differenceArrays(allDocs, docCount, phraseDocs, pd, &nOut);
-                        free(allDocs); free(phraseDocs);
-                        currentDocs = newCur; currentCount = nOut;
-                    } else {
-                        newCur = differenceArrays(currentDocs, currentCount, phraseDocs, pd, &nOut);
-                        free(currentDocs); free(phraseDocs);
-                        currentDocs = newCur; currentCount = nOut;
-                    }
-                    // expectOp = 1;
-                } else {
-                    char nextTok[256] = {0}; int nti=0;
-                    while (*p && !isspace((unsigned char)*p)) { if (nti+1 < (int)sizeof(nextTok)) nextTok[nti++]=*p; p++; }
-                    nextTok[nti]=0;
-                    toLowerCase(nextTok); removePunctuation(nextTok);
-                    if (isStopWord(nextTok) || strlen(nextTok)==0) continue;
-                    WordEntry *we = findWordEntry(hashTable, nextTok);
-                    int *excludeDocs; int ed=0;
-                    if (!we) { excludeDocs = malloc(sizeof(int)*0); ed=0; }
-                    else excludeDocs = collectDocIds(we->docList, &ed);
-                    int *allDocs = malloc(sizeof(int) * docCount);
-                    for (int i=0;i<docCount;i++) allDocs[i]=i;
-                    int *newCur; int nOut;
-                    if (!currentDocs) {
-                        newCur = differenceArrays(allDocs, docCount, excludeDocs, ed, &nOut);
-                        free(allDocs); free(excludeDocs);
-                        currentDocs = newCur; currentCount = nOut;
-                    } else {
-                        newCur = differenceArrays(currentDocs, currentCount, excludeDocs, ed, &nOut);
-                        free(currentDocs); free(excludeDocs);
-                        currentDocs = newCur; currentCount = nOut;
-                    }
-                    // expectOp = 1;
-                }
-            } else {
-                /* Normal word token */
-                char w[256]; strncpy(w, tok, sizeof(w)); w[sizeof(w)-1]=0;
-                toLowerCase(w); removePunctuation(w);
-                if (isStopWord(w) || strlen(w)==0) continue;
-                WordEntry *we = findWordEntry(hashTable, w);
-                int *nextDocs; int nd=0;
-                if (!we) { nextDocs = malloc(sizeof(int)*0); nd=0; }
-                else nextDocs = collectDocIds(we->docList, &nd);
-                if (!currentDocs) { currentDocs = nextDocs; currentCount = nd; }
-                else {
-                    /* default combine is AND */
-                    int nOut; int *res = intersectArrays(currentDocs, currentCount, nextDocs, nd, &nOut);
-                    free(currentDocs); free(nextDocs);
-                    currentDocs = res; currentCount = nOut;
-                }
-                // expectOp = 1;
-            }
+            /* no doc before the pivot can beat theta: skip the lagging cursors to it */
+            for (int i = 0; i < p; i++)
+                if (live[i]->cur.docId < pivot) advancePosting(&live[i]->cur, pivot);
         }
-    } /* end parsing tokens */
+        sortByDoc(live, n);
+    }
+    for (int i = 0; i < n; i++) closePostings(&terms[i].cur);
 
-    if (!currentDocs || currentCount == 0) {
-        printf("No results for '%s'\n", rawQuery);
-        if (currentDocs) free(currentDocs);
+    /* report postings decoded per term for --explain */
+    QueryNode *r = query->root;
+    QueryNode **leaves = r->op == Q_OR ? r->kids : &r;
+    int nLeaves = r->op == Q_OR ? r->nkids : 1;
+    r->visited = 0;
+    for (int l = 0; l < nLeaves; l++) {
+        leaves[l]->visited = 0;
+        for (int j = 0; j < n; j++)
+            if (recs[j] == leaves[l]->rec) { leaves[l]->visited = terms[j].cur.decoded; recs[j] = NULL; break; }
+        r->visited += leaves[l]->visited;
+    }
+    r->outCount = heap->size;
+}
+
+/* Drop tombstoned docs from a sorted match list; returns the new count. */
+static int dropDead(int *docs, int count, const uint64_t *dead) {
+    if (!dead) return count;
+    int k = 0;
+    for (int i = 0; i < count; i++)
+        if (!((dead[docs[i] >> 6] >> (docs[i] & 63)) & 1)) docs[k++] = docs[i];
+    return k;
+}
+
+/* ---------------- Ranking ----------------
+   A query is compiled once per segment (qs[]) and scored with statistics
+   of the whole view: idf from df summed over the segments, and one weight
+   unit for all of them, so every segment scores as if it were the whole
+   index. Each segment is ranked into a top-K heap: WAND for a pure
+   disjunction of terms, otherwise the boolean plan followed by TF-IDF over
+   its matches (the plan also serves disjunctions too long for WAND). */
+
+typedef struct RankJob {
+    const IndexView *v;
+    Query *qs;
+    const char *rawQuery;
+    const double *idf;
+    double unit;
+    int wand;
+    TopK *heaps;                /* fanned out: one per segment */
+    QueryTrace *traces;         /* fanned out: one per segment */
+    atomic_int next;            /* fanned out: next segment to claim */
+    int done;                   /* fanned out: segments finished, under poolLock */
+    struct RankJob *link;       /* pending jobs */
+} RankJob;
+
+/* Per ranking word of q0: df summed over the view's segments, and the
+   largest impact step (maxImpact over the impact range) of any segment. */
+static void viewTermStats(const IndexView *v, const Query *q0, double *df, double *step) {
+    for (int i = 0; i < q0->wordCount; i++) {
+        df[i] = step[i] = 0.0;
+        for (int s = 0; s < v->nsegs; s++) {
+            const Index *idx = v->segs[s]->idx;
+            const TermRecord *t = findTermRecord(idx, q0->words[i]);
+            if (!t) continue;
+            df[i] += t->docFrequency;
+            double st = (double)t->maxImpact / indexImpactMax(idx);
+            if (st > step[i]) step[i] = st;
+        }
+    }
+}
+
+double scoreUnit(const double *idf, const double *step, int words) {
+    double heaviest = 0.0;          /* largest idf * impact step of any term */
+    for (int i = 0; i < words; i++)
+        if (idf[i] * step[i] > heaviest) heaviest = idf[i] * step[i];
+    return heaviest / (double)(1 << WEIGHT_BITS);
+}
+
+/* Rank segment s into heap. Time since *mark is charged to t's match and
+   score stages as they finish. */
+static void rankSegment(RankJob *job, int s, TopK *heap, QueryTrace *t, uint64_t *mark) {
+    const IndexView *v = job->v;
+    const Index *idx = v->segs[s]->idx;
+    Query *q = &job->qs[s];
+    char strategy[64];
+    snprintf(strategy, sizeof(strategy), "%s", job->wand ? "WAND top-k" : "boolean, then TF-IDF");
+    if (v->nsegs > 1)
+        snprintf(strategy + strlen(strategy), sizeof(strategy) - strlen(strategy),
+                 ", segment %d of %d", s + 1, v->nsegs);
+
+    if (job->wand) {
+        /* WAND matches and scores in one pass */
+        wandTopK(idx, v->avgDocTerms, q, job->idf, job->unit, v->dead[s], v->base[s], heap);
+        t->postingsScored += q->root->visited;
+        traceSpan(t, STAGE_SCORE, mark);
+        if (explainPlans) explainQuery(q, job->rawQuery, strategy, stdout);
+        return;
+    }
+
+    int count;
+    int *docs = executeQuery(idx, q, &scratch, &count);
+    count = dropDead(docs, count, v->dead[s]);
+    t->postingsMatched += q->root->visited;
+    t->docsMatched += (uint64_t)count;
+    traceSpan(t, STAGE_MATCH, mark);
+    if (explainPlans) explainQuery(q, job->rawQuery, strategy, stdout);
+    if (count == 0) return;
+
+    /* score the matches and keep the best TOP_K */
+    Score *scores = scoreMatches(idx, v->avgDocTerms, q->words, job->idf, job->unit, q->wordCount, docs, count, t);
+    for (int i = 0; i < count; i++) pushTopK(heap, v->base[s] + scores[i].docId, scores[i].score);
+    traceSpan(t, STAGE_SCORE, mark);
+}
+
+/* ---------------- Scatter-gather ----------------
+   With a fan-out above one, a view of several segments (shards) is ranked
+   by several threads at once. The query's own thread and the pool's
+   helpers claim segments off a shared counter, each ranks into that
+   segment's heap, and the query's thread merges the heaps. The scoring
+   statistics were fixed before the fan-out, so the results are the same
+   as ranking the segments one after another. */
+
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poolWork = PTHREAD_COND_INITIALIZER, poolDone = PTHREAD_COND_INITIALIZER;
+static RankJob *poolJobs;           /* jobs with segments left to claim */
+static pthread_t *poolThreads;
+static int poolSize, poolStopping;
+
+static int claimSegment(RankJob *job) {
+    int s = atomic_fetch_add(&job->next, 1);
+    return s < job->v->nsegs ? s : -1;
+}
+
+static void runClaimed(RankJob *job, int s) {
+    uint64_t mark = traceClock();
+    rankSegment(job, s, &job->heaps[s], &job->traces[s], &mark);
+    pthread_mutex_lock(&poolLock);
+    if (++job->done == job->v->nsegs) pthread_cond_broadcast(&poolDone);
+    pthread_mutex_unlock(&poolLock);
+}
+
+static void unlinkJob(RankJob *job) {
+    for (RankJob **p = &poolJobs; *p; p = &(*p)->link)
+        if (*p == job) { *p = job->link; return; }
+}
+
+static void *fanoutMain(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&poolLock);
+    for (;;) {
+        while (!poolJobs && !poolStopping) pthread_cond_wait(&poolWork, &poolLock);
+        if (!poolJobs) break;
+        RankJob *job = poolJobs;
+        int s = claimSegment(job);
+        if (s < 0) { unlinkJob(job); continue; }
+        pthread_mutex_unlock(&poolLock);
+        arenaReset(&scratch);       /* a helper's scratch only ever holds one segment's work */
+        runClaimed(job, s);
+        pthread_mutex_lock(&poolLock);
+    }
+    pthread_mutex_unlock(&poolLock);
+    freeQueryScratch();
+    return NULL;
+}
+
+void setQueryFanout(int threads) {
+    freeQueryFanout();
+    if (threads <= 1) return;
+    poolThreads = malloc(sizeof(pthread_t) * (threads - 1));
+    if (!poolThreads) { perror("malloc"); exit(1); }
+    for (poolSize = 0; poolSize < threads - 1; poolSize++)
+        if (pthread_create(&poolThreads[poolSize], NULL, fanoutMain, NULL) != 0) { perror("pthread_create"); exit(1); }
+}
+
+void freeQueryFanout(void) {
+    pthread_mutex_lock(&poolLock);
+    poolStopping = 1;
+    pthread_cond_broadcast(&poolWork);
+    pthread_mutex_unlock(&poolLock);
+    for (int i = 0; i < poolSize; i++) pthread_join(poolThreads[i], NULL);
+    free(poolThreads);
+    poolThreads = NULL;
+    poolSize = poolStopping = 0;
+}
+
+/* Rank every segment on the pool and merge the heaps into heap. The
+   segments' stage times add up to more than the wall time they took, so
+   they are scaled to share it. */
+static void fanOut(RankJob *job, TopK *heap, uint64_t *mark) {
+    int n = job->v->nsegs;
+    job->heaps = scratchAlloc(sizeof(TopK) * n);
+    job->traces = scratchAlloc(sizeof(QueryTrace) * n);
+    memset(job->traces, 0, sizeof(QueryTrace) * n);
+    for (int s = 0; s < n; s++) job->heaps[s].size = 0;
+    atomic_init(&job->next, 0);
+    job->done = 0;
+
+    pthread_mutex_lock(&poolLock);
+    job->link = poolJobs;
+    poolJobs = job;
+    pthread_cond_broadcast(&poolWork);
+    pthread_mutex_unlock(&poolLock);
+    int s;
+    while ((s = claimSegment(job)) >= 0) runClaimed(job, s);
+    pthread_mutex_lock(&poolLock);
+    unlinkJob(job);
+    while (job->done < n) pthread_cond_wait(&poolDone, &poolLock);
+    pthread_mutex_unlock(&poolLock);
+
+    uint64_t busy = 0, wall = traceClock() - *mark;
+    for (s = 0; s < n; s++) {
+        for (int i = 0; i < job->heaps[s].size; i++)
+            pushTopK(heap, job->heaps[s].items[i].docId, job->heaps[s].items[i].score);
+        const QueryTrace *t = &job->traces[s];
+        trace.postingsMatched += t->postingsMatched;
+        trace.postingsScored += t->postingsScored;
+        trace.docsMatched += t->docsMatched;
+        busy += t->ns[STAGE_MATCH] + t->ns[STAGE_SCORE];
+    }
+    if (queryTracing && busy > 0) {
+        uint64_t match = 0;
+        for (s = 0; s < n; s++) match += job->traces[s].ns[STAGE_MATCH];
+        trace.ns[STAGE_MATCH] += (uint64_t)((double)wall * match / busy);
+        trace.ns[STAGE_SCORE] += wall - (uint64_t)((double)wall * match / busy);
+        *mark += wall;
+    }
+}
+
+/* Rank qs over the view into heap, with idf[] and unit as the scoring
+   statistics. Time since *mark is charged to the match and score stages. */
+static void rankQuery(const IndexView *v, Query *qs, const char *rawQuery, const double *idf, double unit,
+                      TopK *heap, uint64_t *mark) {
+    RankJob job = { .v = v, .qs = qs, .rawQuery = rawQuery, .idf = idf, .unit = unit };
+    job.wand = queryIsDisjunction(&qs[0]) && qs[0].wordCount <= WAND_MAX_TERMS;
+    /* plans print in segment order */
+    if (poolSize > 0 && v->nsegs > 1 && !explainPlans) {
+        fanOut(&job, heap, mark);
         return;
     }
+    for (int s = 0; s < v->nsegs; s++) rankSegment(&job, s, heap, &trace, mark);
+}
 
-    /* Prepare query words for TF-IDF scoring: extract words (non-stop) from rawQuery */
-    char qcopy2[1024] = {0}; 
-    strncpy(qcopy2, rawQuery, sizeof(qcopy2) - 1); 
-    qcopy2[sizeof(qcopy2)-1]=0;
-    toLowerCase(qcopy2); removePunctuation(qcopy2);
-    char *qtk = strtok(qcopy2, " \t\r\n");
-    char *qwords[128]; int qwCount = 0;
-    while (qtk && qwCount < 128) {
-        if (!isStopWord(qtk)) qwords[qwCount++] = strdup(qtk);
-        qtk = strtok(NULL, " \t\r\n");
+static int finishTrace(uint64_t start, uint64_t mark, int k) {
+    if (queryTracing) {
+        trace.totalNs = mark - start;
+        recordQueryTrace(&trace);
     }
+    return k;
+}
 
-    /* compute tf-idf scores for currentDocs */
-    int outCount;
-    Score *scores = computeTfIdfScores(hashTable, qwords, qwCount, currentDocs, currentCount, &outCount);
+/* the union of the terms matching the pattern over every segment, capped at max */
+int matchViewTerms(const IndexView *v, const char *pattern, int max, Arena *arena, const char **out) {
+    const char **seg = arenaAlloc(arena, sizeof(char *) * max), **merged = arenaAlloc(arena, sizeof(char *) * max);
+    int n = 0;
+    for (int s = 0; s < v->nsegs; s++) {
+        int k = matchWildcard(v->segs[s]->idx, pattern, max, arena, seg);
+        n = unionTerms(out, n, seg, k, max, merged);
+        memcpy(out, merged, sizeof(char *) * n);
+    }
+    return n;
+}
+
+static int viewTerms(const char *pattern, int max, Arena *arena, const char **out, void *ctx) {
+    return matchViewTerms(ctx, pattern, max, arena, out);
+}
 
-    /* sort scores */
-    sortScores(scores, outCount);
+/* Compile rawQuery once per segment of v into scratch; NULL if it is empty. */
+static Query *compileForView(const IndexView *v, const char *rawQuery) {
+    if (!rawQuery || !*rawQuery || v->nsegs == 0) return NULL;
+    /* the plan's shape and words are the same in every segment; only the
+       term lookups and operand order differ */
+    const char *text = expandWildcards(rawQuery, viewTerms, (void *)v, &scratch);
+    Query *qs = scratchAlloc(sizeof(Query) * v->nsegs);
+    for (int s = 0; s < v->nsegs; s++) {
+        compileQuery(v->segs[s]->idx, text, &scratch, &qs[s]);
+        qs[s].pairCache = cachesReady ? &pairCache : NULL;
+    }
+    lastQuery = &qs[0];
+    return qs;
+}
 
-    /* print top-k */
-    int k = TOP_K < outCount ? TOP_K : outCount;
-    printf("Top %d results for '%s':\n", k, rawQuery);
+/* Fill hits from the ranked top[0..k) and count them towards popularity. */
+static void resolveHits(const IndexView *v, const Score *top, int k, SearchHit *hits) {
     for (int i = 0; i < k; i++) {
-        int id = scores[i].docId;
-        printf("  %s (score=%.6f)\n", documents[id].filename, scores[i].score);
-        documents[id].searchCount++;
+        int id = top[i].docId, s = viewSegmentOf(v, id);
+        hits[i].docId = id;
+        hits[i].name = indexDocName(v->segs[s]->idx, id - v->base[s]);
+        hits[i].score = top[i].score;
+        countDocHit(hits[i].name);
+    }
+}
+
+int searchQuery(const IndexView *v, const char *rawQuery, SearchHit *hits) {
+    lastQuery = NULL;
+    if (shardServerCount() > 0) return searchShardServers(rawQuery, hits);
+    arenaReset(&scratch);
+    if (queryTracing) memset(&trace, 0, sizeof(trace));
+    uint64_t start = traceClock(), mark = start;
+    Query *qs = compileForView(v, rawQuery);
+    if (!qs) return 0;
+    if (!qs[0].root) {
+        traceSpan(&trace, STAGE_PARSE, &mark);
+        if (explainPlans) explainQuery(&qs[0], rawQuery, "boolean, then TF-IDF", stdout);
+        return finishTrace(start, mark, 0);
     }
 
-    /* clean up */
-    for (int i = 0; i < qwCount; i++) free(qwords[i]);
-    free(scores); free(currentDocs);
-}
\ No newline at end of file
+    size_t keyLen, len;
+    const char *key = queryCacheKey(&qs[0], &scratch, &keyLen);
+    traceSpan(&trace, STAGE_PARSE, &mark);
+    const Score *top = cachesReady ? cacheGet(&resultCache, key, keyLen, v->generation, &scratch, &len) : NULL;
+    traceSpan(&trace, STAGE_CACHE, &mark);
+    TopK heap = { .size = 0 };
+    int k;
+    if (top) {
+        k = (int)(len / sizeof(Score));
+        trace.cached = 1;
+        if (explainPlans) printf("Plan for '%s' (result cache hit, key %s)\n", rawQuery, key);
+    } else {
+        int words = qs[0].wordCount ? qs[0].wordCount : 1;
+        double *df = scratchAlloc(sizeof(double) * words), *step = scratchAlloc(sizeof(double) * words);
+        double *idf = scratchAlloc(sizeof(double) * words);
+        ScoringModel model = (ScoringModel)v->segs[0]->idx->hdr->scoring;
+        viewTermStats(v, &qs[0], df, step);
+        for (int i = 0; i < qs[0].wordCount; i++) idf[i] = scoringIdf(model, (double)v->docCount, df[i]);
+        double unit = scoreUnit(idf, step, qs[0].wordCount);
+        traceSpan(&trace, STAGE_SCORE, &mark);
+        rankQuery(v, qs, rawQuery, idf, unit, &heap, &mark);
+        k = finishTopK(&heap);
+        traceSpan(&trace, STAGE_SORT, &mark);
+        if (cachesReady) cachePut(&resultCache, key, keyLen, v->generation, heap.items, sizeof(Score) * k);
+        traceSpan(&trace, STAGE_CACHE, &mark);
+        top = heap.items;
+    }
+    resolveHits(v, top, k, hits);
+    traceSpan(&trace, STAGE_SORT, &mark);
+    return finishTrace(start, mark, k);
+}
+
+int searchQueryStats(const IndexView *v, const char *rawQuery, QueryStats *st) {
+    lastQuery = NULL;
+    arenaReset(&scratch);
+    memset(st, 0, sizeof(*st));
+    if (v->nsegs == 0) return -1;
+    st->docCount = v->docCount;
+    st->scoring = (ScoringModel)v->segs[0]->idx->hdr->scoring;
+    Query *qs = compileForView(v, rawQuery);
+    if (!qs || !qs[0].root) return 0;
+    st->words = qs[0].wordCount;
+    st->df = scratchAlloc(sizeof(double) * (st->words ? st->words : 1));
+    st->step = scratchAlloc(sizeof(double) * (st->words ? st->words : 1));
+    viewTermStats(v, &qs[0], st->df, st->step);
+    return 0;
+}
+
+int searchQueryWithStats(const IndexView *v, const char *rawQuery, const double *idf, int words, double unit,
+                         SearchHit *hits) {
+    lastQuery = NULL;
+    arenaReset(&scratch);
+    if (queryTracing) memset(&trace, 0, sizeof(trace));
+    uint64_t start = traceClock(), mark = start;
+    Query *qs = compileForView(v, rawQuery);
+    if (!qs || !qs[0].root || qs[0].wordCount != words) return 0;
+    traceSpan(&trace, STAGE_PARSE, &mark);
+    TopK heap = { .size = 0 };
+    rankQuery(v, qs, rawQuery, idf, unit, &heap, &mark);
+    int k = finishTopK(&heap);
+    resolveHits(v, heap.items, k, hits);
+    traceSpan(&trace, STAGE_SORT, &mark);
+    return finishTrace(start, mark, k);
+}
+
+void searchSnippets(const IndexView *v, const SearchHit *hits, int k, Snippet *out) {
+    memset(out, 0, sizeof(Snippet) * k);
+    if (!lastQuery) return;
+    int docIds[TOP_K];
+    const char *paths[TOP_K];
+    Snippet *slots[TOP_K];
+    for (int s = 0; s < v->nsegs; s++) {
+        int n = 0;
+        for (int i = 0; i < k; i++) {
+            if (viewSegmentOf(v, hits[i].docId) != s) continue;
+            docIds[n] = hits[i].docId - v->base[s];
+            paths[n] = hits[i].name;
+            slots[n++] = &out[i];
+        }
+        if (n > 0) makeSnippets(v->segs[s]->idx, docIds, paths, n, lastQuery->words, lastQuery->wordCount, slots);
+    }
+}
+
+void printResultsForQuery(const IndexView *v, const char *rawQuery) {
+    if (!rawQuery || strlen(rawQuery) == 0) { printf("Empty query\n"); return; }
+    SearchHit hits[TOP_K];
+    Snippet snips[TOP_K];
+    int k = searchQuery(v, rawQuery, hits);
+    if (snippets) searchSnippets(v, hits, k, snips);
+    /* matches in bold on a terminal, in brackets otherwise */
+    int tty = isatty(STDOUT_FILENO);
+    if (k == 0) {
+        printf("No results for '%s'\n", rawQuery);
+    } else {
+        printf("Top %d results for '%s':\n", k, rawQuery);
+        for (int i = 0; i < k; i++) {
+            printf("  %s (score=%.6f)\n", hits[i].name, hits[i].score);
+            if (!snippets || !snips[i].text) continue;
+            printf("    ");
+            printSnippet(stdout, &snips[i], tty ? "\033[1m" : "[", tty ? "\033[0m" : "]");
+            printf("\n");
+        }
+    }
+    if (queryTracing) printQueryTrace(&trace, stdout);
+}
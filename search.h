@@ -0,0 +1,71 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "segments.h"
+#include "snippet.h"
+#include "stats.h"
+
+typedef struct SearchHit {
+    int docId;              /* view docId */
+    const char *name;       /* valid while the view is held */
+    double score;
+} SearchHit;
+
+/* Rank a query over every live document of the view into hits[TOP_K], best
+   first, and count each hit towards its document's popularity. Returns the
+   number of hits. Safe to call from several threads at once. */
+int searchQuery(const IndexView *v, const char *query, SearchHit *hits);
+/* prints results (top-k) for a query (single term/phrase/multi-term boolean/TF-IDF)
+   over every live document of the view */
+void printResultsForQuery(const IndexView *v, const char *query);
+/* print each query's execution plan (estimated vs visited postings) before its results */
+void setQueryExplain(int on);
+/* show a snippet with every hit (at the prompt, in server replies and JSON batches) */
+void setResultSnippets(int on);
+int resultSnippets(void);
+/* Snippets of hits[0..k) of the calling thread's last searchQuery() over
+   v, marking its ranking words. Hits from shard servers get none (text
+   NULL): their files are theirs. */
+void searchSnippets(const IndexView *v, const SearchHit *hits, int k, Snippet *out);
+/* score from tf and doc length in floating point instead of the index's
+   quantized impacts (slower; the reference for their accuracy) */
+void setExactScores(int on);
+/* (re)size the result and term-pair caches, split evenly; 0 turns them off */
+void setQueryCacheBytes(size_t bytes);
+/* hit/miss/eviction counters of both caches */
+void printCacheStats(FILE *out);
+void freeQueryCaches(void);
+/* stage breakdown of the calling thread's last searchQuery(), filled in
+   while tracing is on (setQueryTracing) */
+const QueryTrace *lastQueryTrace(void);
+/* release the calling thread's query scratch memory */
+void freeQueryScratch(void);
+/* up to max terms of any segment of the view matching a wildcard pattern,
+   ascending (query.h) */
+int matchViewTerms(const IndexView *v, const char *pattern, int max, Arena *arena, const char **out);
+/* rank the segments (shards) of a view on up to `threads` threads at once
+   (1, the default: one after another); the pool is shared by all queries */
+void setQueryFanout(int threads);
+void freeQueryFanout(void);
+
+/* Scoring statistics of a query over a view, for combining with other
+   views' (shard.c): per ranking word, in query order, df summed over the
+   segments and the largest impact step (maxImpact / impact max). */
+typedef struct QueryStats {
+    int docCount;
+    ScoringModel scoring;
+    int words;
+    double *df;             /* valid until the calling thread's next query */
+    double *step;
+} QueryStats;
+
+/* -1 if the view is empty */
+int searchQueryStats(const IndexView *v, const char *query, QueryStats *st);
+/* weight unit for ranking words with these idfs and steps */
+double scoreUnit(const double *idf, const double *step, int words);
+/* searchQuery() scored with idf[0..words) and unit instead of the view's
+   own statistics, bypassing the result cache */
+int searchQueryWithStats(const IndexView *v, const char *query, const double *idf, int words, double unit,
+                         SearchHit *hits);
+
+#endif
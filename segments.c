@@ -0,0 +1,795 @@
+#include "segments.h"
+#include "popularity.h"
+#include "shard.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define MERGE_FACTOR 4          /* segments of one tier that trigger a merge */
+#define MERGE_MIN_DOCS 256      /* tier 0 is everything up to this many live docs */
+#define WATCH_QUIET_MS 200      /* apply watched changes once events pause this long... */
+#define WATCH_MAX_DELAY_MS 2000 /* ...or once the oldest has waited this long */
+
+static IndexView *published;    /* swapped atomically; read as is by the writer only */
+/* one writer at a time: prompt commands, the watch thread and reloads */
+static pthread_mutex_t writerLock = PTHREAD_MUTEX_INITIALIZER;
+static char *docRoot;
+static char *imagePath;         /* the file (or manifest) a loaded view came from */
+static int64_t builtAtNs;      /* when the initial build started reading files */
+
+/* ---------------- Views ----------------
+   Queries take no lock. A view is reference counted, with one reference
+   for being published and one per query holding it, and whoever drops the
+   last frees it, query thread or writer. The only race is between a
+   reader loading published and counting itself in, while the writer swaps
+   the view and drops its reference: a reader shows the view it is about
+   to count in its hazard slot, and the writer waits until no slot shows
+   the old view before dropping it. That window is a few instructions
+   long, so a publish never waits for a query to finish and a query never
+   waits for a publish. Adding a slot to the list, showing a view in it
+   and loading published are all sequentially consistent, as are the
+   writer's swap and its load of the list: that total order makes any
+   reader the writer's scan misses load the new view, where with weaker
+   orders a thread's first acquire could pin the old view in a slot the
+   writer never sees and count itself into a freed view. */
+
+typedef struct ReaderSlot {
+    struct ReaderSlot *next;
+    const IndexView *pinned;    /* being acquired */
+    int inUse;                  /* owned by a live thread */
+    char pad[64 - 2 * sizeof(void *) - sizeof(int)];    /* a cache line of its own */
+} ReaderSlot;
+
+static ReaderSlot *readerSlots;     /* only grows; slots of exited threads are reused */
+static pthread_key_t slotKey;
+static pthread_once_t slotOnce = PTHREAD_ONCE_INIT;
+
+static void releaseSlot(void *arg) {
+    ReaderSlot *r = arg;
+    __atomic_store_n(&r->inUse, 0, __ATOMIC_RELEASE);
+}
+
+static void makeSlotKey(void) {
+    pthread_key_create(&slotKey, releaseSlot);
+}
+
+static ReaderSlot *readerSlot(void) {
+    pthread_once(&slotOnce, makeSlotKey);
+    ReaderSlot *r = pthread_getspecific(slotKey);
+    if (r) return r;
+    for (r = __atomic_load_n(&readerSlots, __ATOMIC_ACQUIRE); r; r = r->next) {
+        int idle = 0;
+        if (__atomic_compare_exchange_n(&r->inUse, &idle, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) break;
+    }
+    if (!r) {
+        r = aligned_alloc(64, sizeof(ReaderSlot));
+        if (!r) { perror("aligned_alloc"); exit(1); }
+        memset(r, 0, sizeof(*r));
+        r->inUse = 1;
+        r->next = __atomic_load_n(&readerSlots, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&readerSlots, &r->next, r, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {}
+    }
+    pthread_setspecific(slotKey, r);
+    return r;
+}
+
+const IndexView *acquireView(void) {
+    ReaderSlot *r = readerSlot();
+    IndexView *v;
+    do {
+        v = __atomic_load_n(&published, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&r->pinned, v, __ATOMIC_SEQ_CST);
+    } while (__atomic_load_n(&published, __ATOMIC_SEQ_CST) != v);
+    if (v) __atomic_fetch_add(&v->refs, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&r->pinned, NULL, __ATOMIC_RELEASE);
+    return v;
+}
+
+static void dropView(IndexView *v);
+
+static void unrefView(IndexView *v) {
+    if (__atomic_sub_fetch(&v->refs, 1, __ATOMIC_ACQ_REL) == 0) dropView(v);
+}
+
+void releaseView(const IndexView *v) {
+    if (v) unrefView((IndexView *)v);
+}
+
+int viewSegmentOf(const IndexView *v, int docId) {
+    int lo = 0, hi = v->nsegs - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (v->base[mid] <= docId) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+const char *viewDocName(const IndexView *v, int docId) {
+    int s = viewSegmentOf(v, docId);
+    return indexDocName(v->segs[s]->idx, docId - v->base[s]);
+}
+
+static size_t deadBytes(const Segment *s) {
+    return ((size_t)indexDocCount(s->idx) + 63) / 64 * sizeof(uint64_t);
+}
+
+/* Tokens and documents over the live documents of v. */
+static void liveTerms(const IndexView *v, uint64_t *terms, int *docs) {
+    *terms = 0;
+    *docs = 0;
+    for (int i = 0; i < v->nsegs; i++) {
+        const Index *idx = v->segs[i]->idx;
+        *terms += v->segs[i]->docTerms;
+        *docs += indexDocCount(idx) - v->deadCount[i];
+        for (int d = 0; v->dead[i] && d < indexDocCount(idx); d++)
+            if (viewIsDead(v, i, d)) *terms -= (uint64_t)indexDocTerms(idx, d);
+    }
+}
+
+/* An empty view with room for cap segments. */
+static IndexView *allocView(int cap) {
+    if (cap < 1) cap = 1;
+    IndexView *v = calloc(1, sizeof(IndexView));
+    if (!v) { perror("calloc"); exit(1); }
+    v->segs = calloc(cap, sizeof(Segment *));
+    v->dead = calloc(cap, sizeof(uint64_t *));
+    v->deadCount = calloc(cap, sizeof(int));
+    v->base = calloc(cap, sizeof(int));
+    if (!v->segs || !v->dead || !v->deadCount || !v->base) { perror("calloc"); exit(1); }
+    return v;
+}
+
+/* Append src's segment i to dst, with a private copy of its tombstones. */
+static void keepSegment(IndexView *dst, const IndexView *src, int i) {
+    int k = dst->nsegs++;
+    dst->segs[k] = src->segs[i];
+    __atomic_fetch_add(&dst->segs[k]->refs, 1, __ATOMIC_RELAXED);
+    dst->deadCount[k] = src->deadCount[i];
+    if (src->dead[i]) {
+        size_t bytes = deadBytes(src->segs[i]);
+        dst->dead[k] = malloc(bytes);
+        if (!dst->dead[k]) { perror("malloc"); exit(1); }
+        memcpy(dst->dead[k], src->dead[i], bytes);
+    }
+}
+
+static void addSegment(IndexView *v, Segment *s) {
+    v->segs[v->nsegs++] = s;
+    s->refs++;
+}
+
+static void dropView(IndexView *v) {
+    for (int i = 0; i < v->nsegs; i++) {
+        free(v->dead[i]);
+        if (__atomic_sub_fetch(&v->segs[i]->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+            freeIndex(v->segs[i]->idx);
+            free(v->segs[i]);
+        }
+    }
+    free(v->segs);
+    free(v->dead);
+    free(v->deadCount);
+    free(v->base);
+    free(v);
+}
+
+/* Fill in bases and counts and make v the view new queries get. The old
+   view is freed by whoever releases it last: queries still running on it
+   finish there, and this only waits out readers in the middle of
+   acquiring it. */
+static void publishView(IndexView *v) {
+    v->docCount = v->liveCount = 0;
+    for (int i = 0; i < v->nsegs; i++) {
+        int docs = indexDocCount(v->segs[i]->idx);
+        v->base[i] = v->docCount;
+        v->docCount += docs;
+        v->liveCount += docs - v->deadCount[i];
+    }
+    /* a folder's view changes document by document; a loaded one keeps the
+       average its images were built with (a shard's is the collection's) */
+    if (docRoot) {
+        uint64_t terms;
+        int docs;
+        liveTerms(v, &terms, &docs);
+        v->avgDocTerms = docs ? (double)terms / docs : 0.0;
+    } else {
+        v->avgDocTerms = v->nsegs ? v->segs[0]->idx->hdr->avgDocTerms : 0.0;
+    }
+    v->generation = newIndexGeneration();
+    v->refs = 1;
+    reservePopularity(v->docCount);
+    IndexView *old = __atomic_exchange_n(&published, v, __ATOMIC_SEQ_CST);
+    if (!old) return;
+    for (ReaderSlot *r = __atomic_load_n(&readerSlots, __ATOMIC_SEQ_CST); r; r = r->next)
+        while (__atomic_load_n(&r->pinned, __ATOMIC_SEQ_CST) == old) sched_yield();
+    unrefView(old);
+}
+
+static Segment *newSegment(Index *idx) {
+    Segment *s = calloc(1, sizeof(Segment));
+    if (!s) { perror("calloc"); exit(1); }
+    s->idx = idx;
+    for (int d = 0; d < indexDocCount(idx); d++) s->docTerms += (uint64_t)indexDocTerms(idx, d);
+    return s;
+}
+
+
+static void killDoc(IndexView *v, const Segment *s, int local) {
+    int i = 0;
+    while (v->segs[i] != s) i++;
+    if (!v->dead[i]) {
+        v->dead[i] = calloc(1, deadBytes(s));
+        if (!v->dead[i]) { perror("calloc"); exit(1); }
+    }
+    uint64_t bit = 1ULL << (local & 63);
+    if (!(v->dead[i][local >> 6] & bit)) {
+        v->dead[i][local >> 6] |= bit;
+        v->deadCount[i]++;
+    }
+}
+
+/* ---------------- Files ----------------
+   Path -> where its live document is, plus what the file looked like when
+   it was indexed. Only kept when the index has a document folder. */
+
+typedef struct FileDoc {
+    struct FileDoc *next;
+    Segment *seg;
+    int local;
+    int seen;               /* refresh bookkeeping */
+    int64_t mtimeNs;        /* -1: indexed by the initial build, not stat'ed yet */
+    int64_t size;
+    char path[];
+} FileDoc;
+
+static FileDoc **files;
+static uint32_t fileMask;
+static uint32_t fileCount;
+
+static FileDoc *findFile(const char *path) {
+    if (!files) return NULL;
+    for (FileDoc *f = files[hashWord(path, strlen(path)) & fileMask]; f; f = f->next)
+        if (strcmp(f->path, path) == 0) return f;
+    return NULL;
+}
+
+static FileDoc *addFile(const char *path) {
+    if (!files || fileCount > fileMask) {
+        uint32_t mask = files ? fileMask * 2 + 1 : 1023;
+        FileDoc **b = calloc((size_t)mask + 1, sizeof(FileDoc *));
+        if (!b) { perror("calloc"); exit(1); }
+        for (uint32_t i = 0; files && i <= fileMask; i++) {
+            FileDoc *f = files[i];
+            while (f) {
+                FileDoc *next = f->next;
+                uint32_t h = hashWord(f->path, strlen(f->path)) & mask;
+                f->next = b[h];
+                b[h] = f;
+                f = next;
+            }
+        }
+        free(files);
+        files = b;
+        fileMask = mask;
+    }
+    size_t len = strlen(path);
+    FileDoc *f = calloc(1, sizeof(FileDoc) + len + 1);
+    if (!f) { perror("calloc"); exit(1); }
+    memcpy(f->path, path, len + 1);
+    uint32_t h = hashWord(path, len) & fileMask;
+    f->next = files[h];
+    files[h] = f;
+    fileCount++;
+    return f;
+}
+
+static void removeFile(FileDoc *f) {
+    FileDoc **pp = &files[hashWord(f->path, strlen(f->path)) & fileMask];
+    while (*pp != f) pp = &(*pp)->next;
+    *pp = f->next;
+    fileCount--;
+    free(f);
+}
+
+/* 1 if path is a regular file now, with its mtime and size. */
+static int statFile(const char *path, int64_t *mtimeNs, int64_t *size) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+    *mtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    *size = (int64_t)st.st_size;
+    return 1;
+}
+
+/* ---------------- Changes ---------------- */
+
+/* Index files into a new segment of v; files[i] becomes its document i.
+   BM25 impacts are taken against the average length of v's live documents
+   and the new ones, as a fresh build of them would. */
+static Segment *indexFiles(const IndexView *v, FileDoc **add, int n) {
+    TermTable *t = createTermTable();
+    freeDocuments();
+    uint64_t terms;
+    int docs;
+    liveTerms(v, &terms, &docs);
+    for (int i = 0; i < n; i++) {
+        int d = addDocument(add[i]->path);
+        processChangingFile(t, documents[d].filename, d);
+        terms += (uint64_t)documents[d].totalTerms;
+    }
+    setIndexAvgDocTerms((double)terms / (docs + n));
+    Index *idx = buildIndexImage(t);
+    setIndexAvgDocTerms(0);
+    freeTermTable(t);
+    freeDocuments();
+    return newSegment(idx);
+}
+
+static int cmpPath(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* Bring paths up to date: new and changed files go into one new segment,
+   and the old copies of changed files and the documents of vanished ones
+   are tombstoned. force treats every existing file as changed (the watcher
+   knows it was written). Publishes a view if anything changed and returns
+   the number of documents added plus removed. Caller holds writerLock. */
+static int applyChanges(char **paths, int n, int force) {
+    qsort(paths, n, sizeof(char *), cmpPath);
+    IndexView *next = allocView(published->nsegs + 1);
+    for (int i = 0; i < published->nsegs; i++) keepSegment(next, published, i);
+    FileDoc **add = malloc(sizeof(FileDoc *) * (n ? n : 1));
+    if (!add) { perror("malloc"); exit(1); }
+    int nadd = 0, removed = 0;
+    for (int i = 0; i < n; i++) {
+        if (i > 0 && strcmp(paths[i], paths[i - 1]) == 0) continue;
+        int64_t mtime = 0, size = 0;
+        int exists = statFile(paths[i], &mtime, &size);
+        FileDoc *f = findFile(paths[i]);
+        int changed;
+        if (!exists || !f || force) changed = exists;
+        else if (f->mtimeNs < 0) changed = mtime >= builtAtNs;   /* written since the build read it */
+        else changed = f->mtimeNs != mtime || f->size != size;
+        if (f && exists && !changed) {
+            f->mtimeNs = mtime;
+            f->size = size;
+        }
+        if (f && (changed || !exists)) {
+            killDoc(next, f->seg, f->local);
+            removed++;
+        }
+        if (f && !exists) removeFile(f);
+        if (!changed) continue;
+        if (!f) f = addFile(paths[i]);
+        f->mtimeNs = mtime;
+        f->size = size;
+        add[nadd++] = f;
+    }
+    if (nadd) {
+        Segment *s = indexFiles(next, add, nadd);
+        addSegment(next, s);
+        for (int i = 0; i < nadd; i++) {
+            add[i]->seg = s;
+            add[i]->local = i;
+        }
+    }
+    free(add);
+    if (nadd + removed == 0) {
+        dropView(next);
+        return 0;
+    }
+    publishView(next);
+    return nadd + removed;
+}
+
+/* Compare the folder with the file table: new, modified and removed files. */
+static int refreshLocked(void) {
+    int n;
+    char **paths = listDocumentFiles(docRoot, &n);
+    for (uint32_t i = 0; i <= fileMask && files; i++)
+        for (FileDoc *f = files[i]; f; f = f->next) f->seen = 0;
+    for (int i = 0; i < n; i++) {
+        FileDoc *f = findFile(paths[i]);
+        if (f) f->seen = 1;
+    }
+    /* paths may be exactly n long: keep our own capacity for the vanished */
+    int total = n, cap = n;
+    for (uint32_t i = 0; i <= fileMask && files; i++) {
+        for (FileDoc *f = files[i]; f; f = f->next) {
+            if (f->seen) continue;
+            if (total == cap) {
+                cap = cap ? cap * 2 : 16;
+                paths = realloc(paths, sizeof(char *) * cap);
+                if (!paths) { perror("realloc"); exit(1); }
+            }
+            paths[total++] = strdup(f->path);
+        }
+    }
+    int changes = applyChanges(paths, total, 0);
+    for (int i = 0; i < total; i++) free(paths[i]);
+    free(paths);
+    return changes;
+}
+
+/* ---------------- Merging ---------------- */
+
+static int tierOf(int live) {
+    int t = 0;
+    for (long cap = MERGE_MIN_DOCS; live > cap; cap *= MERGE_FACTOR) t++;
+    return t;
+}
+
+/* Size-tiered policy: MERGE_FACTOR segments whose live sizes fall in the
+   same tier are merged, smallest tier first. A segment that is mostly
+   tombstones is rewritten on its own. Fills which[] in view order. */
+static int pickMerge(const IndexView *v, int *which) {
+    for (int i = 0; i < v->nsegs; i++) {
+        if (v->deadCount[i] * 2 > indexDocCount(v->segs[i]->idx)) {
+            which[0] = i;
+            return 1;
+        }
+    }
+    for (int t = 0;; t++) {
+        int n = 0, higher = 0;
+        for (int i = 0; i < v->nsegs && n < MERGE_FACTOR; i++) {
+            int ti = tierOf(indexDocCount(v->segs[i]->idx) - v->deadCount[i]);
+            if (ti == t) which[n++] = i;
+            else if (ti > t) higher = 1;
+        }
+        if (n == MERGE_FACTOR) return n;
+        if (!higher) return 0;
+    }
+}
+
+/* Rewrite segments which[0..n) of v as one, leaving out tombstoned
+   documents. Returns NULL if none of their documents is live. */
+static Segment *mergeImages(const IndexView *v, const int *which, int n) {
+    freeDocuments();
+    int **remap = malloc(sizeof(int *) * n);
+    if (!remap) { perror("malloc"); exit(1); }
+    for (int k = 0; k < n; k++) {
+        const Index *idx = v->segs[which[k]]->idx;
+        int docs = indexDocCount(idx);
+        remap[k] = malloc(sizeof(int) * (docs ? docs : 1));
+        if (!remap[k]) { perror("malloc"); exit(1); }
+        for (int d = 0; d < docs; d++) {
+            if (viewIsDead(v, which[k], d)) { remap[k][d] = -1; continue; }
+            int id = addDocument(indexDocName(idx, d));
+            documents[id].totalTerms = indexDocTerms(idx, d);
+            remap[k][d] = id;
+        }
+    }
+
+    Segment *merged = NULL;
+    if (docCount > 0) {
+        /* segments are visited in view order, so every term still receives
+           its docIds in increasing order */
+        TermTable *t = createTermTable();
+        for (int k = 0; k < n; k++) {
+            const Index *idx = v->segs[which[k]]->idx;
+            TermCursor term;
+            openTerms(idx, &term);
+            while (nextTerm(&term)) {
+                PostingCursor c;
+                openPostings(idx, &idx->terms[term.term], &c);
+                while (nextPosting(&c)) {
+                    int id = remap[k][c.docId];
+                    if (id < 0) continue;
+                    const int *pos = postingPositions(&c);
+                    const uint32_t *off = postingOffsets(&c);
+                    for (int p = 0; p < c.frequency; p++)
+                        insertWordHash(t, term.word, term.len, id, pos ? pos[p] : -1, off ? off[p] : 0);
+                }
+                closePostings(&c);
+            }
+            closeTerms(&term);
+        }
+        /* a merge leaves the live documents, and so their average, as they are */
+        setIndexAvgDocTerms(v->avgDocTerms);
+        merged = newSegment(buildIndexImage(t));
+        setIndexAvgDocTerms(0);
+        freeTermTable(t);
+    }
+    for (int k = 0; k < n; k++) free(remap[k]);
+    free(remap);
+    freeDocuments();
+    return merged;
+}
+
+/* Merge by policy (or everything into one segment when all is set) until
+   nothing qualifies. Caller holds writerLock. Returns merges done. */
+static int mergeLocked(int all) {
+    int merges = 0;
+    for (;;) {
+        const IndexView *v = published;
+        int *which = malloc(sizeof(int) * (v->nsegs ? v->nsegs : 1)), n = 0;
+        if (!which) { perror("malloc"); exit(1); }
+        if (!all) {
+            n = pickMerge(v, which);
+        } else if (v->nsegs > 1 || (v->nsegs == 1 && v->deadCount[0] > 0)) {
+            for (; n < v->nsegs; n++) which[n] = n;
+        }
+        if (n == 0) { free(which); break; }
+
+        Segment *merged = mergeImages(v, which, n);
+        IndexView *next = allocView(v->nsegs - n + 1);
+        for (int i = 0, k = 0; i < v->nsegs; i++) {
+            if (k < n && which[k] == i) {
+                /* the merged segment takes the place of the first one it replaces */
+                if (k++ == 0 && merged) addSegment(next, merged);
+                continue;
+            }
+            keepSegment(next, v, i);
+        }
+        for (int d = 0; merged && docRoot && d < indexDocCount(merged->idx); d++) {
+            FileDoc *f = findFile(indexDocName(merged->idx, d));
+            if (f) { f->seg = merged; f->local = d; }
+        }
+        publishView(next);
+        free(which);
+        merges++;
+        if (all) break;
+    }
+    return merges;
+}
+
+/* ---------------- Public writer API ---------------- */
+
+void initSegments(Index **idx, int n, const char *root, const char *image, time_t builtAt) {
+    pthread_mutex_lock(&writerLock);
+    IndexView *v = allocView(n);
+    for (int i = 0; i < n; i++) addSegment(v, newSegment(idx[i]));
+    if (image) imagePath = strdup(image);
+    if (root && n == 1) {
+        Segment *s = v->segs[0];
+        /* files are stat'ed by the first refresh instead of up front; the
+           slack covers coarse timestamps (FAT rounds to two seconds) */
+        docRoot = strdup(root);
+        builtAtNs = ((int64_t)builtAt - 2) * 1000000000;
+        for (int d = 0; d < indexDocCount(idx[0]); d++) {
+            FileDoc *f = addFile(indexDocName(idx[0], d));
+            f->mtimeNs = -1;
+            f->seg = s;
+            f->local = d;
+        }
+    }
+    publishView(v);
+    pthread_mutex_unlock(&writerLock);
+}
+
+/* Rescan the document folder and apply what changed. Returns the number
+   of documents added plus removed, or -1 without a folder. */
+int refreshSegments(void) {
+    if (!docRoot) return -1;
+    pthread_mutex_lock(&writerLock);
+    int changes = refreshLocked();
+    if (changes > 0) mergeLocked(0);
+    pthread_mutex_unlock(&writerLock);
+    return changes;
+}
+
+/* Bring the view up to date with where it came from: map the image (or
+   manifest) a loaded view came from again, after it was rebuilt in place,
+   or refresh a built one from its folder. Queries keep running throughout,
+   those already started on the old images. Returns the documents now
+   loaded, or the changes applied, or -1. */
+int reloadSegments(void) {
+    if (!imagePath) return refreshSegments();
+    pthread_mutex_lock(&writerLock);
+    int n, docs = -1;
+    Index **shards = openShards(imagePath, &n);
+    if (shards) {
+        /* queries share the stop-word set, which can't be swapped under them */
+        const IndexHeader *h = shards[0]->hdr;
+        size_t len;
+        const char *words = stopWordsText(&len);
+        if (h->stopwordsLen != len || memcmp(shards[0]->strings + h->stopwordsOff, words, len) != 0) {
+            fprintf(stderr, "%s was built with other stop words: restart to load it\n", imagePath);
+            for (int i = 0; i < n; i++) freeIndex(shards[i]);
+        } else {
+            IndexView *v = allocView(n);
+            for (int i = 0; i < n; i++) addSegment(v, newSegment(shards[i]));
+            publishView(v);
+            docs = v->docCount;
+        }
+        free(shards);
+    }
+    pthread_mutex_unlock(&writerLock);
+    return docs;
+}
+
+/* Merge by the size-tiered policy, or everything into one segment. */
+int mergeSegments(int all) {
+    pthread_mutex_lock(&writerLock);
+    int merges = mergeLocked(all);
+    pthread_mutex_unlock(&writerLock);
+    return merges;
+}
+
+void printSegmentStats(FILE *out) {
+    const IndexView *v = acquireView();
+    fprintf(out, "segments=%d docs=%d live=%d\n", v->nsegs, v->docCount, v->liveCount);
+    for (int i = 0; i < v->nsegs; i++) {
+        const Index *idx = v->segs[i]->idx;
+        fprintf(out, "  segment %d: docs=%d deleted=%d terms=%u bytes=%zu\n", i,
+                indexDocCount(idx), v->deadCount[i], idx->hdr->termCount, idx->size);
+    }
+    releaseView(v);
+}
+
+/* ---------------- Watching ----------------
+   inotify is not recursive, so every directory under the root gets its own
+   watch. Events only name files; they are collected and applied as one
+   change once the burst quiets down. A new or vanished directory, or an
+   event queue overflow, triggers a full rescan instead. */
+
+static int watchFd = -1;
+static int wakePipe[2] = { -1, -1 };
+static pthread_t watchThread;
+static char **watchDirs;        /* indexed by watch descriptor */
+static int watchDirCap;
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE)
+
+static void watchTree(const char *dir) {
+    int wd = inotify_add_watch(watchFd, dir, WATCH_MASK | IN_ONLYDIR);
+    if (wd < 0) { perror(dir); return; }
+    if (wd >= watchDirCap) {
+        int cap = watchDirCap ? watchDirCap : 64;
+        while (cap <= wd) cap *= 2;
+        watchDirs = realloc(watchDirs, sizeof(char *) * cap);
+        if (!watchDirs) { perror("realloc"); exit(1); }
+        memset(watchDirs + watchDirCap, 0, sizeof(char *) * (cap - watchDirCap));
+        watchDirCap = cap;
+    }
+    free(watchDirs[wd]);
+    watchDirs[wd] = strdup(dir);
+
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        int isDir = e->d_type == DT_DIR;
+        if (e->d_type == DT_UNKNOWN) {
+            struct stat st;
+            isDir = lstat(path, &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (isDir) watchTree(path);
+    }
+    closedir(d);
+}
+
+static long long nowMs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void *watchMain(void *arg) {
+    (void)arg;
+    _Alignas(struct inotify_event) char buf[64 * 1024];
+    char **pending = NULL;
+    int npending = 0, cap = 0, rescan = 0;
+    long long since = 0;
+    for (;;) {
+        int timeout = -1;
+        if (npending || rescan) {
+            long long left = since + WATCH_MAX_DELAY_MS - nowMs();
+            timeout = left < WATCH_QUIET_MS ? (left > 0 ? (int)left : 0) : WATCH_QUIET_MS;
+        }
+        struct pollfd fds[2] = { { watchFd, POLLIN, 0 }, { wakePipe[0], POLLIN, 0 } };
+        int r = poll(fds, 2, timeout);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) { perror("poll"); break; }
+        if (fds[1].revents) break;
+
+        if (fds[0].revents & POLLIN) {
+            ssize_t len = read(watchFd, buf, sizeof(buf));
+            for (char *p = buf; len > 0 && p < buf + len;) {
+                const struct inotify_event *ev = (const struct inotify_event *)p;
+                p += sizeof(struct inotify_event) + ev->len;
+                if (!npending && !rescan) since = nowMs();
+                if (ev->mask & IN_Q_OVERFLOW) { rescan = 1; continue; }
+                if (ev->wd < 0 || ev->wd >= watchDirCap || !watchDirs[ev->wd] || ev->len == 0) continue;
+                size_t plen = strlen(watchDirs[ev->wd]) + strlen(ev->name) + 2;
+                char *path = malloc(plen);
+                if (!path) { perror("malloc"); exit(1); }
+                snprintf(path, plen, "%s/%s", watchDirs[ev->wd], ev->name);
+                const char *ext = strrchr(ev->name, '.');
+                if (ev->mask & IN_ISDIR) {
+                    /* files can arrive or leave with a directory */
+                    if (ev->mask & (IN_CREATE | IN_MOVED_TO)) watchTree(path);
+                    rescan = 1;
+                    free(path);
+                } else if (ext && strcmp(ext, ".txt") == 0 && !(ev->mask & IN_CREATE)) {
+                    if (npending == cap) {
+                        cap = cap ? cap * 2 : 64;
+                        pending = realloc(pending, sizeof(char *) * cap);
+                        if (!pending) { perror("realloc"); exit(1); }
+                    }
+                    pending[npending++] = path;
+                } else {
+                    free(path);
+                }
+            }
+            if (nowMs() - since < WATCH_MAX_DELAY_MS) continue;
+        } else if (r > 0) {
+            continue;
+        }
+        if (!npending && !rescan) continue;
+
+        pthread_mutex_lock(&writerLock);
+        int changes = rescan ? refreshLocked() : applyChanges(pending, npending, 1);
+        if (changes > 0) mergeLocked(0);
+        pthread_mutex_unlock(&writerLock);
+        if (changes > 0) fprintf(stderr, "[watch] %d document change(s) applied\n", changes);
+        for (int i = 0; i < npending; i++) free(pending[i]);
+        npending = rescan = 0;
+    }
+    for (int i = 0; i < npending; i++) free(pending[i]);
+    free(pending);
+    return NULL;
+}
+
+/* Follow the document folder with inotify until stopWatch(). */
+int startWatch(void) {
+    if (!docRoot || watchFd >= 0) return -1;
+    watchFd = inotify_init1(IN_CLOEXEC);
+    if (watchFd < 0) { perror("inotify_init1"); return -1; }
+    if (pipe(wakePipe) != 0) {
+        perror("pipe");
+        close(watchFd);
+        watchFd = -1;
+        return -1;
+    }
+    watchTree(docRoot);
+    if (pthread_create(&watchThread, NULL, watchMain, NULL) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+    return 0;
+}
+
+void stopWatch(void) {
+    if (watchFd < 0) return;
+    if (write(wakePipe[1], "x", 1) != 1) perror("write");
+    pthread_join(watchThread, NULL);
+    close(watchFd);
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    watchFd = wakePipe[0] = wakePipe[1] = -1;
+    for (int i = 0; i < watchDirCap; i++) free(watchDirs[i]);
+    free(watchDirs);
+    watchDirs = NULL;
+    watchDirCap = 0;
+}
+
+void freeSegments(void) {
+    stopWatch();
+    pthread_mutex_lock(&writerLock);
+    IndexView *v = __atomic_exchange_n(&published, NULL, __ATOMIC_SEQ_CST);
+    if (v) unrefView(v);
+    for (uint32_t i = 0; files && i <= fileMask; i++) {
+        FileDoc *f = files[i];
+        while (f) {
+            FileDoc *next = f->next;
+            free(f);
+            f = next;
+        }
+    }
+    free(files);
+    files = NULL;
+    fileMask = fileCount = 0;
+    free(docRoot);
+    free(imagePath);
+    docRoot = imagePath = NULL;
+    pthread_mutex_unlock(&writerLock);
+}
@@ -0,0 +1,79 @@
+#ifndef SEGMENTS_H
+#define SEGMENTS_H
+
+#include <time.h>
+#include "store.h"
+
+/* ---------------- Segmented index ----------------
+   What queries search is a list of immutable segments (index images), each
+   numbering its documents from 0; a document's docId in the view is its
+   segment's base plus its local id. A published segment is never changed:
+
+   - new and modified files are indexed into a new small segment;
+   - removed documents, and the old copies of modified ones, are marked in
+     a per-segment tombstone bitmap;
+   - a size-tiered merge rewrites MERGE_FACTOR segments of similar size into
+     one, dropping tombstoned documents for good.
+
+   Every change publishes a new IndexView. A query holds one view from start
+   to finish (acquireView/releaseView), so it never sees half of a change,
+   and a view is immutable and reference counted: publishing swaps the
+   pointer atomically, queries still on the old view finish there, and the
+   last one out frees it. Neither side takes a lock or waits for the other.
+   A loaded index can be reloaded the same way once its file has been
+   rebuilt (reloadSegments).
+   Until they are merged away, tombstoned documents still count towards N and
+   document frequencies, so scores can drift slightly from a fresh build;
+   after a full merge they are identical again.
+
+   BM25 normalizes by the average length of the view's live documents: a
+   new or merged segment is built against it, and --exact-scores uses the
+   current view's. A segment's stored impacts keep the average of when it
+   was built, though, so as documents come and go the quantized scores of
+   older segments drift from a fresh build's until they are merged (a
+   loaded view keeps the average its images were built with). */
+
+typedef struct Segment {
+    Index *idx;
+    int refs;               /* views using it (atomic: the last query out of a view drops it) */
+    uint64_t docTerms;      /* tokens over all of its documents */
+} Segment;
+
+typedef struct IndexView {
+    Segment **segs;
+    uint64_t **dead;        /* per segment tombstone bitmap; NULL if nothing is deleted */
+    int *deadCount;
+    int *base;              /* view docId of each segment's first document */
+    int nsegs;
+    int docCount;           /* every document, tombstoned ones included */
+    int liveCount;
+    uint64_t generation;    /* fresh for every published view */
+    double avgDocTerms;     /* BM25's average document length (see above) */
+    int refs;               /* queries holding it, plus one while it is published (atomic) */
+} IndexView;
+
+/* readers */
+const IndexView *acquireView(void);
+void releaseView(const IndexView *v);
+int viewSegmentOf(const IndexView *v, int docId);
+const char *viewDocName(const IndexView *v, int docId);
+
+static inline int viewIsDead(const IndexView *v, int seg, int local) {
+    const uint64_t *d = v->dead[seg];
+    return d && (d[local >> 6] >> (local & 63)) & 1;
+}
+
+/* writers: the view starts as the n images idx[] (the shards of a sharded
+   index, else one); root is the folder a single image was built from,
+   starting at builtAt, and image the file or manifest they were loaded
+   from (one of them is NULL; with neither the view stays as it is) */
+void initSegments(Index **idx, int n, const char *root, const char *image, time_t builtAt);
+int refreshSegments(void);
+int reloadSegments(void);
+int mergeSegments(int all);
+int startWatch(void);
+void stopWatch(void);
+void printSegmentStats(FILE *out);
+void freeSegments(void);
+
+#endif
@@ -0,0 +1,496 @@
+#include "server.h"
+#include "search.h"
+#include "shard.h"
+#include "textbuf.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define SERVER_MAX_LINE 32768       /* longest request line (shard requests carry expanded wildcards) */
+#define SERVER_IN_LIMIT 65536       /* unread input kept per connection before reading pauses */
+#define SERVER_MAX_EVENTS 256
+
+/* A client. Only one of its requests is with the workers at a time, which
+   keeps replies in request order; the rest wait in its input buffer. */
+typedef struct Conn {
+    struct Conn *prev, *next;       /* every open connection, for shutdown */
+    int fd;                         /* -1 once closed */
+    char *in;
+    size_t inLen, inCap;
+    char *out;
+    size_t outLen, outOff, outCap;
+    int busy;                       /* a request is with the workers */
+    int eof;                        /* peer finished sending: answer what's left, then close */
+    int dead;                       /* error: drop everything */
+    int reaped;                     /* in the graveyard */
+} Conn;
+
+typedef struct Job {
+    struct Job *next;
+    Conn *conn;
+    char *reply;
+    size_t replyLen;
+    char query[];
+} Job;
+
+/* requests for the workers, and finished replies for the epoll thread */
+static pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobReady = PTHREAD_COND_INITIALIZER;
+static Job *pendingHead, *pendingTail, *doneHead;
+static int stopping;
+static int wakeFd = -1;             /* eventfd: replies are waiting */
+static int stopPipe[2] = { -1, -1 };
+static int reloadPipe[2] = { -1, -1 };  /* 'r' per SIGHUP, 'q' to stop the reload thread */
+static Conn *conns;
+
+/* epoll tags for the fds that aren't connections */
+static char listenTag[2], wakeTag, stopTag;
+/* connections closed while handling an epoll batch; a later event of the
+   same batch may still point at them, so they are freed after it */
+static Conn *graveyard;
+
+static long long nowUs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* ---------------- Replies ---------------- */
+
+/* Run one query on the calling worker and format its reply line. */
+static char *answer(const char *query, size_t *len) {
+    if (strncmp(query, ":shard-", 7) == 0) return answerShardRequest(query, len);
+    long long start = nowUs();
+    SearchHit hits[TOP_K];
+    Snippet snips[TOP_K];
+    TextBuf b = { NULL, 0, 0 };
+    char num[64];
+
+    textStr(&b, "{\"query\":");
+    textJsonString(&b, query);
+    textStr(&b, ",\"hits\":[");
+    const IndexView *v = acquireView();
+    int k = searchQuery(v, query, hits);
+    int snippets = resultSnippets();
+    if (snippets) searchSnippets(v, hits, k, snips);
+    for (int i = 0; i < k; i++) {
+        textStr(&b, i ? ",{\"doc\":" : "{\"doc\":");
+        textJsonString(&b, hits[i].name);
+        snprintf(num, sizeof(num), ",\"score\":%.6f", hits[i].score);
+        textStr(&b, num);
+        if (snippets && snips[i].text) {
+            textStr(&b, ",\"snippet\":");
+            snippetJson(&b, &snips[i]);
+        }
+        textStr(&b, "}");
+    }
+    releaseView(v);
+    snprintf(num, sizeof(num), "],\"took_us\":%lld}\n", nowUs() - start);
+    textStr(&b, num);
+    *len = b.len;
+    return b.s;
+}
+
+static void *workerMain(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&jobLock);
+        while (!pendingHead && !stopping) pthread_cond_wait(&jobReady, &jobLock);
+        Job *job = pendingHead;
+        if (!job) {
+            pthread_mutex_unlock(&jobLock);
+            break;
+        }
+        pendingHead = job->next;
+        if (!pendingHead) pendingTail = NULL;
+        pthread_mutex_unlock(&jobLock);
+
+        job->reply = answer(job->query, &job->replyLen);
+
+        pthread_mutex_lock(&jobLock);
+        job->next = doneHead;
+        doneHead = job;
+        pthread_mutex_unlock(&jobLock);
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) != sizeof(one)) perror("write");
+    }
+    freeQueryScratch();
+    return NULL;
+}
+
+/* ---------------- Connections ---------------- */
+
+static void freeConn(Conn *c) {
+    if (c->prev) c->prev->next = c->next; else conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    if (c->fd >= 0) close(c->fd);
+    free(c->in);
+    free(c->out);
+    free(c);
+}
+
+static void killConn(Conn *c) {
+    c->dead = 1;
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+}
+
+static void flushConn(Conn *c) {
+    while (!c->dead && c->outOff < c->outLen) {
+        ssize_t n = send(c->fd, c->out + c->outOff, c->outLen - c->outOff, MSG_NOSIGNAL);
+        if (n > 0) { c->outOff += (size_t)n; continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;   /* EPOLLOUT resumes */
+        killConn(c);
+    }
+    c->outLen = c->outOff = 0;
+}
+
+static void queueReply(Conn *c, const char *s, size_t len) {
+    if (c->outLen + len > c->outCap) {
+        size_t cap = c->outCap ? c->outCap * 2 : 1024;
+        while (cap < c->outLen + len) cap *= 2;
+        c->out = realloc(c->out, cap);
+        if (!c->out) { perror("realloc"); exit(1); }
+        c->outCap = cap;
+    }
+    memcpy(c->out + c->outLen, s, len);
+    c->outLen += len;
+    flushConn(c);
+}
+
+/* Hand the connection's next complete line to the workers. */
+static void dispatch(Conn *c) {
+    if (c->busy || c->dead) return;
+    char *nl = memchr(c->in, '\n', c->inLen);
+    size_t len = nl ? (size_t)(nl - c->in) : c->inLen;
+    if (len > SERVER_MAX_LINE) {
+        static const char tooLong[] = "{\"error\":\"request line too long\"}\n";
+        queueReply(c, tooLong, sizeof(tooLong) - 1);
+        c->eof = 1;             /* stop reading; close once the error is out */
+        c->inLen = 0;
+        return;
+    }
+    if (!nl && !(c->eof && len > 0)) return;   /* a last line may lack its newline */
+    size_t used = nl ? len + 1 : len;
+    if (len > 0 && c->in[len - 1] == '\r') len--;
+
+    Job *job = malloc(sizeof(Job) + len + 1);
+    if (!job) { perror("malloc"); exit(1); }
+    job->next = NULL;
+    job->conn = c;
+    memcpy(job->query, c->in, len);
+    job->query[len] = '\0';
+    memmove(c->in, c->in + used, c->inLen - used);
+    c->inLen -= used;
+    c->busy = 1;
+
+    pthread_mutex_lock(&jobLock);
+    if (pendingTail) pendingTail->next = job; else pendingHead = job;
+    pendingTail = job;
+    pthread_cond_signal(&jobReady);
+    pthread_mutex_unlock(&jobLock);
+}
+
+/* Read what the peer sent, up to SERVER_IN_LIMIT buffered; reading
+   resumes when a reply frees the connection. */
+static void readConn(Conn *c) {
+    while (!c->dead && !c->eof && c->inLen < SERVER_IN_LIMIT) {
+        if (c->inCap - c->inLen < 4096) {
+            c->inCap = c->inCap ? c->inCap * 2 : 8192;
+            c->in = realloc(c->in, c->inCap);
+            if (!c->in) { perror("realloc"); exit(1); }
+        }
+        ssize_t n = recv(c->fd, c->in + c->inLen, c->inCap - c->inLen, 0);
+        if (n > 0) { c->inLen += (size_t)n; continue; }
+        if (n == 0) { c->eof = 1; break; }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) killConn(c);
+        break;
+    }
+    dispatch(c);
+}
+
+/* Retire the connection once nothing more can happen on it. */
+static void reapConn(Conn *c) {
+    if (c->busy || c->reaped) return;
+    if (!c->dead && !(c->eof && c->inLen == 0 && c->outLen == 0)) return;
+    if (c->prev) c->prev->next = c->next; else conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+    c->reaped = 1;
+    c->prev = NULL;
+    c->next = graveyard;
+    graveyard = c;
+}
+
+static void buryConns(void) {
+    while (graveyard) {
+        Conn *c = graveyard;
+        graveyard = c->next;
+        free(c->in);
+        free(c->out);
+        free(c);
+    }
+}
+
+static void finishJobs(void) {
+    uint64_t n;
+    if (read(wakeFd, &n, sizeof(n)) < 0 && errno != EAGAIN) perror("read");
+    pthread_mutex_lock(&jobLock);
+    Job *job = doneHead;
+    doneHead = NULL;
+    pthread_mutex_unlock(&jobLock);
+    while (job) {
+        Job *next = job->next;
+        Conn *c = job->conn;
+        c->busy = 0;
+        if (!c->dead) queueReply(c, job->reply, job->replyLen);
+        free(job->reply);
+        free(job);
+        if (!c->dead) readConn(c);
+        reapConn(c);
+        job = next;
+    }
+}
+
+/* ---------------- Listening ---------------- */
+
+static int openUnix(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);  /* left by an earlier run */
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) { perror("socket"); return -1; }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int openTcp(int port) {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) { perror("socket"); return -1; }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+        perror("tcp listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Out of descriptors, a pending connection would keep the listener readable
+   forever; a spare fd lets us accept it just to close it. */
+static int spareFd = -1;
+
+static void acceptAll(int epfd, int lfd) {
+    for (;;) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if ((errno == EMFILE || errno == ENFILE) && spareFd >= 0) {
+                close(spareFd);
+                fd = accept(lfd, NULL, NULL);
+                if (fd >= 0) close(fd);
+                spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                fprintf(stderr, "out of file descriptors: connection refused\n");
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+        Conn *c = calloc(1, sizeof(Conn));
+        if (!c) { perror("calloc"); exit(1); }
+        c->fd = fd;
+        c->next = conns;
+        if (conns) conns->prev = c;
+        conns = c;
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = c };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            perror("epoll_ctl");
+            freeConn(c);
+        }
+    }
+}
+
+static void onStopSignal(int sig) {
+    (void)sig;
+    int saved = errno;
+    if (write(stopPipe[1], "x", 1) < 0) { /* already signalled */ }
+    errno = saved;
+}
+
+static void onReloadSignal(int sig) {
+    (void)sig;
+    int saved = errno;
+    if (write(reloadPipe[1], "r", 1) < 0) { /* a reload is already due */ }
+    errno = saved;
+}
+
+/* Reloads run on a thread of their own: the workers keep answering from
+   the current view while the new one is mapped, and move to it query by
+   query once it is published. */
+static void *reloadMain(void *arg) {
+    (void)arg;
+    for (;;) {
+        char c;
+        ssize_t n = read(reloadPipe[0], &c, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n != 1 || c != 'r') break;
+        int docs = reloadSegments();
+        if (docs < 0) fprintf(stderr, "[reload] nothing reloaded; serving the current index\n");
+        else fprintf(stderr, "[reload] done\n");
+    }
+    return NULL;
+}
+
+/* Lift the soft descriptor limit to the hard one: every client is an fd. */
+static void raiseFdLimit(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+int runServer(const ServerConfig *cfg) {
+    int listeners[2], nl = 0;
+    raiseFdLimit();
+    if (cfg->unixPath) {
+        int fd = openUnix(cfg->unixPath);
+        if (fd >= 0) listeners[nl++] = fd;
+    }
+    if (cfg->tcpPort > 0) {
+        int fd = openTcp(cfg->tcpPort);
+        if (fd >= 0) listeners[nl++] = fd;
+    }
+    if (nl == 0) return -1;
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epfd < 0 || wakeFd < 0 || pipe2(stopPipe, O_CLOEXEC | O_NONBLOCK) != 0 || pipe2(reloadPipe, O_CLOEXEC) != 0) {
+        perror("server setup");
+        exit(1);
+    }
+    fcntl(reloadPipe[1], F_SETFL, O_NONBLOCK);     /* written by the signal handler */
+    spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN };
+    for (int i = 0; i < nl; i++) {
+        ev.data.ptr = &listenTag[i];
+        epoll_ctl(epfd, EPOLL_CTL_ADD, listeners[i], &ev);
+    }
+    ev.data.ptr = &wakeTag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, wakeFd, &ev);
+    ev.data.ptr = &stopTag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, stopPipe[0], &ev);
+
+    struct sigaction sa = { .sa_handler = onStopSignal };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = onReloadSignal;
+    sigaction(SIGHUP, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    pthread_t reloader;
+    if (pthread_create(&reloader, NULL, reloadMain, NULL) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+
+    int nworkers = cfg->workers > 0 ? cfg->workers : 1;
+    pthread_t *workers = malloc(sizeof(pthread_t) * nworkers);
+    if (!workers) { perror("malloc"); exit(1); }
+    for (int i = 0; i < nworkers; i++) {
+        if (pthread_create(&workers[i], NULL, workerMain, NULL) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    printf("Serving");
+    if (cfg->unixPath) printf(" unix:%s", cfg->unixPath);
+    if (cfg->tcpPort > 0) printf(" tcp:127.0.0.1:%d", cfg->tcpPort);
+    printf(" with %d worker(s); SIGHUP reloads the index, SIGINT or SIGTERM stops\n", nworkers);
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    int running = 1;
+    while (running) {
+        int n = epoll_wait(epfd, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &stopTag) {
+                running = 0;
+            } else if (tag == &wakeTag) {
+                finishJobs();
+            } else if (tag == &listenTag[0] || tag == &listenTag[1]) {
+                acceptAll(epfd, listeners[(char *)tag - listenTag]);
+            } else {
+                Conn *c = tag;
+                if (c->reaped) continue;
+                if (events[i].events & EPOLLERR) killConn(c);
+                if (!c->dead && (events[i].events & EPOLLOUT)) flushConn(c);
+                if (!c->dead && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) readConn(c);
+                reapConn(c);
+            }
+        }
+        buryConns();
+    }
+
+    pthread_mutex_lock(&jobLock);
+    stopping = 1;
+    pthread_cond_broadcast(&jobReady);
+    pthread_mutex_unlock(&jobLock);
+    for (int i = 0; i < nworkers; i++) pthread_join(workers[i], NULL);
+    free(workers);
+    signal(SIGHUP, SIG_DFL);
+    if (write(reloadPipe[1], "q", 1) != 1) perror("write");
+    pthread_join(reloader, NULL);
+
+    /* workers are gone: drop unanswered requests, then every connection */
+    for (Job *job = pendingHead, *next; job; job = next) { next = job->next; free(job); }
+    for (Job *job = doneHead, *next; job; job = next) { next = job->next; free(job->reply); free(job); }
+    pendingHead = pendingTail = doneHead = NULL;
+    while (conns) freeConn(conns);
+    buryConns();
+    for (int i = 0; i < nl; i++) close(listeners[i]);
+    if (cfg->unixPath) unlink(cfg->unixPath);
+    close(epfd);
+    close(wakeFd);
+    close(stopPipe[0]);
+    close(stopPipe[1]);
+    close(reloadPipe[0]);
+    close(reloadPipe[1]);
+    if (spareFd >= 0) close(spareFd);
+    wakeFd = spareFd = stopPipe[0] = stopPipe[1] = reloadPipe[0] = reloadPipe[1] = -1;
+    stopping = 0;
+    printf("Server stopped\n");
+    return 0;
+}
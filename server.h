@@ -0,0 +1,30 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/* ---------------- Query server ----------------
+   Listens on a Unix domain socket and/or 127.0.0.1:port. The protocol is
+   line based: each request is one query terminated by '\n', and each reply
+   is one line of JSON,
+
+     {"query":"new york","hits":[{"doc":"a.txt","score":0.125000}],"took_us":41}
+
+   or {"error":"..."} before the server drops a connection it can't serve.
+   A connection may pipeline requests; its replies come back in order.
+   With snippets on (setResultSnippets), each hit also has a "snippet":
+   HTML text from around its matches, which are in <b></b>.
+
+   One epoll thread owns every socket and hands complete lines to a fixed
+   pool of workers, which all search the current IndexView. SIGHUP reloads
+   the index (reloadSegments) on a thread of its own while the workers go
+   on serving. Runs until SIGINT or SIGTERM. */
+
+typedef struct ServerConfig {
+    const char *unixPath;   /* NULL: no Unix socket */
+    int tcpPort;            /* 0: no TCP listener */
+    int workers;
+} ServerConfig;
+
+/* 0 on a clean shutdown, -1 if no listener could be opened */
+int runServer(const ServerConfig *cfg);
+
+#endif
@@ -0,0 +1,612 @@
+#include "shard.h"
+#include "query.h"
+#include "spimi.h"
+#include "textbuf.h"
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define MANIFEST_MAGIC "mse-shards 1"
+#define SHARD_MAX_LINE 65536        /* longest reply line a coordinator accepts */
+
+/* ---------------- Building ---------------- */
+
+/* FNV-1a: stable across runs and platforms, unlike the term hash */
+static uint64_t hashPath(const char *path) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+int buildShards(const char *docPath, const char *manifest, int shards, ShardBy by, int jobs) {
+    int n;
+    char **paths = listDocumentFiles(docPath, &n);
+    char **part = malloc(sizeof(char *) * (n ? n : 1));
+    if (!part) { perror("malloc"); exit(1); }
+    char tmp[1024], name[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", manifest);
+    FILE *mf = fopen(tmp, "w");
+    if (!mf) { perror(tmp); return -1; }
+    fprintf(mf, "%s\nby %s\n", MANIFEST_MAGIC, by == SHARD_BY_HASH ? "hash" : "range");
+    const char *slash = strrchr(manifest, '/');
+    const char *base = slash ? slash + 1 : manifest;
+
+    /* BM25 normalizes by the whole collection's average doc length, which a
+       shard can't know from its own documents: one counting pass finds it */
+    if (indexBuildScoring() == SCORE_BM25) setIndexAvgDocTerms(averageDocTerms(paths, n));
+    int rc = 0;
+    uint64_t total = 0;
+    for (int s = 0; s < shards && rc == 0; s++) {
+        /* paths are sorted, so each shard's docs stay in path order */
+        int k = 0;
+        for (int i = 0; i < n; i++) {
+            int owner = by == SHARD_BY_HASH ? (int)(hashPath(paths[i]) % (uint64_t)shards)
+                                            : (int)((int64_t)i * shards / n);
+            if (owner == s) part[k++] = paths[i];
+        }
+        printf("Building shard %d of %d (%d docs)...\n", s + 1, shards, k);
+        snprintf(name, sizeof(name), "%s.%d", manifest, s);
+        size_t size = 0;
+        freeDocuments();
+        if (buildMemLimit()) {
+            rc = buildIndexFile(part, k, name, jobs, &size);
+        } else {
+            TermTable *table = createTermTable();
+            indexFileList(table, part, k, jobs);
+            Index *idx = buildIndexImage(table);
+            freeTermTable(table);
+            rc = saveIndex(idx, name);
+            size = idx->size;
+            freeIndex(idx);
+        }
+        freeDocuments();
+        if (rc == 0) {
+            printf("Wrote %s (%zu bytes)\n", name, size);
+            fprintf(mf, "shard %s.%d\n", base, s);
+            total += size;
+        }
+    }
+    setIndexAvgDocTerms(0);
+    for (int i = 0; i < n; i++) free(paths[i]);
+    free(paths);
+    free(part);
+    if (fclose(mf) != 0 && rc == 0) { perror(tmp); rc = -1; }
+    if (rc == 0 && rename(tmp, manifest) != 0) { perror(manifest); rc = -1; }
+    if (rc != 0) { remove(tmp); return -1; }
+    printf("Wrote %s: %d shards, %d docs, %llu bytes\n", manifest, shards, n, (unsigned long long)total);
+    return 0;
+}
+
+/* ---------------- Loading ---------------- */
+
+Index **openShards(const char *path, int *n) {
+    char line[1100];
+    FILE *f = fopen(path, "r");
+    if (!f) { perror(path); return NULL; }
+    Index **shards = NULL;
+    *n = 0;
+    if (!fgets(line, sizeof(line), f) || strncmp(line, MANIFEST_MAGIC "\n", sizeof(MANIFEST_MAGIC)) != 0) {
+        /* not a manifest: a plain index file */
+        fclose(f);
+        shards = malloc(sizeof(Index *));
+        if (!shards) { perror("malloc"); exit(1); }
+        if (!(shards[0] = openIndex(path))) { free(shards); return NULL; }
+        *n = 1;
+        return shards;
+    }
+    const char *slash = strrchr(path, '/');
+    int dirLen = slash ? (int)(slash - path + 1) : 0;
+    int cap = 0, bad = 0;
+    while (!bad && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (strncmp(line, "by ", 3) == 0 || line[0] == '\0') continue;
+        if (strncmp(line, "shard ", 6) != 0) {
+            fprintf(stderr, "%s: bad manifest line '%s'\n", path, line);
+            bad = 1;
+            break;
+        }
+        char file[1200];
+        if (line[6] == '/') snprintf(file, sizeof(file), "%s", line + 6);
+        else snprintf(file, sizeof(file), "%.*s%s", dirLen, path, line + 6);
+        if (*n == cap) {
+            cap = cap ? cap * 2 : 8;
+            shards = realloc(shards, sizeof(Index *) * cap);
+            if (!shards) { perror("realloc"); exit(1); }
+        }
+        if (!(shards[*n] = openIndex(file))) bad = 1;
+        else (*n)++;
+    }
+    fclose(f);
+    if (!bad && *n == 0) {
+        fprintf(stderr, "%s: no shards\n", path);
+        bad = 1;
+    }
+    if (bad) {
+        for (int i = 0; i < *n; i++) freeIndex(shards[i]);
+        free(shards);
+        return NULL;
+    }
+    return shards;
+}
+
+Index **loadShards(const char *path, int *n) {
+    Index **shards = openShards(path, n);
+    if (shards) useIndexSettings(shards[0]);
+    return shards;
+}
+
+/* ---------------- Shard side ---------------- */
+
+static void textNumber(TextBuf *b, const char *fmt, double v) {
+    char num[64];
+    snprintf(num, sizeof(num), fmt, v);
+    textStr(b, num);
+}
+
+static void textNumbers(TextBuf *b, const char *key, const double *v, int n) {
+    textStr(b, key);
+    for (int i = 0; i < n; i++) textNumber(b, i ? ",%.17g" : "%.17g", v[i]);
+    textStr(b, "]");
+}
+
+static char *errorReply(TextBuf *b, const char *msg, size_t *len) {
+    b->len = 0;
+    textStr(b, "{\"error\":");
+    textJsonString(b, msg);
+    textStr(b, "}\n");
+    *len = b->len;
+    return b->s;
+}
+
+char *answerShardRequest(const char *line, size_t *len) {
+    TextBuf b = { NULL, 0, 0 };
+    const IndexView *v = acquireView();
+    if (strncmp(line, ":shard-stats ", 13) == 0) {
+        QueryStats st;
+        if (searchQueryStats(v, line + 13, &st) != 0) {
+            releaseView(v);
+            return errorReply(&b, "no index", len);
+        }
+        char num[32];
+        snprintf(num, sizeof(num), "{\"docs\":%d", st.docCount);
+        textStr(&b, num);
+        textStr(&b, st.scoring == SCORE_BM25 ? ",\"scoring\":\"bm25\"" : ",\"scoring\":\"tfidf\"");
+        textNumbers(&b, ",\"df\":[", st.df, st.words);
+        textNumbers(&b, ",\"step\":[", st.step, st.words);
+        textStr(&b, "}\n");
+    } else if (strncmp(line, ":shard-rank ", 12) == 0) {
+        char *p;
+        double unit = strtod(line + 12, &p);
+        long words = strtol(p, &p, 10);
+        if (words < 0 || words > (long)strlen(line)) {
+            releaseView(v);
+            return errorReply(&b, "bad :shard-rank request", len);
+        }
+        double *idf = malloc(sizeof(double) * (words ? words : 1));
+        if (!idf) { perror("malloc"); exit(1); }
+        for (long i = 0; i < words; i++) idf[i] = strtod(p, &p);
+        if (*p == ' ') p++;
+        SearchHit hits[TOP_K];
+        int k = searchQueryWithStats(v, p, idf, (int)words, unit, hits);
+        free(idf);
+        textStr(&b, "{\"hits\":[");
+        for (int i = 0; i < k; i++) {
+            char num[48];
+            snprintf(num, sizeof(num), "%s{\"docId\":%d,\"doc\":", i ? "," : "", hits[i].docId);
+            textStr(&b, num);
+            textJsonString(&b, hits[i].name);
+            textNumber(&b, ",\"score\":%.17g}", hits[i].score);
+        }
+        textStr(&b, "]}\n");
+    } else if (strncmp(line, ":shard-terms ", 13) == 0) {
+        char *p;
+        long max = strtol(line + 13, &p, 10);
+        if (max < 1 || max > (1 << 20) || *p != ' ') {
+            releaseView(v);
+            return errorReply(&b, "bad :shard-terms request", len);
+        }
+        Arena arena = { NULL, 0, 0 };
+        const char **terms = malloc(sizeof(char *) * max);
+        if (!terms) { perror("malloc"); exit(1); }
+        int k = matchViewTerms(v, p + 1, (int)max, &arena, terms);
+        textStr(&b, "{\"terms\":[");
+        for (int i = 0; i < k; i++) {
+            if (i) textStr(&b, ",");
+            textJsonString(&b, terms[i]);
+        }
+        textStr(&b, "]}\n");
+        free(terms);
+        freeArena(&arena);
+    } else {
+        releaseView(v);
+        return errorReply(&b, "unknown shard request", len);
+    }
+    releaseView(v);
+    *len = b.len;
+    return b.s;
+}
+
+/* ---------------- Coordinator ----------------
+   Every thread that searches keeps its own connection to each shard
+   server, so requests and replies never interleave. All shards get a
+   round's request before any reply is read, so they work in parallel. When
+   a shard fails, the query gets no results and the thread drops all its
+   connections; the next query reopens them. */
+
+typedef struct ShardServer {
+    char *path;             /* Unix socket, or NULL */
+    int port;
+} ShardServer;
+
+typedef struct ShardConn {
+    int fd;                 /* -1 while closed */
+    char *in;
+    size_t inLen;           /* bytes buffered */
+    size_t lineLen;         /* length of the line last returned, consumed on the next read */
+} ShardConn;
+
+typedef struct CoordState {
+    ShardConn *conns;
+    Arena names;            /* hit names and expanded text of the thread's last query */
+    int failed;             /* a shard failed while expanding the query's wildcards */
+} CoordState;
+
+static ShardServer *servers;
+static int serverCount;
+static pthread_key_t coordKey;
+static pthread_once_t coordOnce = PTHREAD_ONCE_INIT;
+
+static void freeCoordState(void *arg) {
+    CoordState *cs = arg;
+    for (int i = 0; i < serverCount; i++) {
+        if (cs->conns[i].fd >= 0) close(cs->conns[i].fd);
+        free(cs->conns[i].in);
+    }
+    free(cs->conns);
+    freeArena(&cs->names);
+    free(cs);
+}
+
+static void makeCoordKey(void) {
+    pthread_key_create(&coordKey, freeCoordState);
+}
+
+static CoordState *coordState(void) {
+    pthread_once(&coordOnce, makeCoordKey);
+    CoordState *cs = pthread_getspecific(coordKey);
+    if (cs) return cs;
+    cs = calloc(1, sizeof(CoordState));
+    if (cs) cs->conns = calloc(serverCount, sizeof(ShardConn));
+    if (!cs || !cs->conns) { perror("calloc"); exit(1); }
+    for (int i = 0; i < serverCount; i++) cs->conns[i].fd = -1;
+    pthread_setspecific(coordKey, cs);
+    return cs;
+}
+
+static const char *serverName(int i, char *buf, size_t size) {
+    if (servers[i].path) return servers[i].path;
+    snprintf(buf, size, "127.0.0.1:%d", servers[i].port);
+    return buf;
+}
+
+static void shardError(int i, const char *what) {
+    char name[64];
+    fprintf(stderr, "shard %s: %s\n", serverName(i, name, sizeof(name)), what);
+}
+
+static void dropConn(ShardConn *c) {
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+    c->inLen = c->lineLen = 0;
+}
+
+static int openConn(int i, ShardConn *c) {
+    if (c->fd >= 0) return 0;
+    if (!c->in && !(c->in = malloc(SHARD_MAX_LINE))) { perror("malloc"); exit(1); }
+    int fd;
+    if (servers[i].path) {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", servers[i].path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) { close(fd); fd = -1; }
+    } else {
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)servers[i].port) };
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) { close(fd); fd = -1; }
+    }
+    if (fd < 0) { shardError(i, strerror(errno)); return -1; }
+    c->fd = fd;
+    c->inLen = c->lineLen = 0;
+    return 0;
+}
+
+static int sendRequest(int i, ShardConn *c, const char *s, size_t len) {
+    if (openConn(i, c) != 0) return -1;
+    while (len > 0) {
+        ssize_t w = send(c->fd, s, len, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) { shardError(i, strerror(errno)); dropConn(c); return -1; }
+        s += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+/* the next reply line, NUL-terminated in place; NULL on error */
+static char *readReply(int i, ShardConn *c) {
+    if (c->fd < 0) return NULL;
+    memmove(c->in, c->in + c->lineLen, c->inLen - c->lineLen);
+    c->inLen -= c->lineLen;
+    c->lineLen = 0;
+    for (;;) {
+        char *nl = memchr(c->in, '\n', c->inLen);
+        if (nl) {
+            *nl = '\0';
+            c->lineLen = (size_t)(nl - c->in) + 1;
+            if (strncmp(c->in, "{\"error\":", 9) == 0) { shardError(i, c->in); dropConn(c); return NULL; }
+            return c->in;
+        }
+        if (c->inLen == SHARD_MAX_LINE) { shardError(i, "reply too long"); dropConn(c); return NULL; }
+        ssize_t r = recv(c->fd, c->in + c->inLen, SHARD_MAX_LINE - c->inLen, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) { shardError(i, r < 0 ? strerror(errno) : "connection closed"); dropConn(c); return NULL; }
+        c->inLen += (size_t)r;
+    }
+}
+
+/* The value after "key": at or after *p; *p moves past the key. */
+static const char *findKey(const char **p, const char *key) {
+    char pat[32];
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    const char *at = strstr(*p, pat);
+    if (!at) return NULL;
+    *p = at + strlen(pat);
+    return *p;
+}
+
+/* "key":[n,n,...] into out[0..n); 0 if exactly n numbers were there */
+static int parseNumbers(const char *line, const char *key, double *out, int n) {
+    const char *p = line;
+    if (!findKey(&p, key) || *p++ != '[') return -1;
+    for (int i = 0; i < n; i++) {
+        char *end;
+        out[i] = strtod(p, &end);
+        if (end == p) return -1;
+        p = end;
+        if (*p == ',') p++;
+    }
+    return *p == ']' ? 0 : -1;
+}
+
+/* JSON string at *p (as textJsonString writes them) into the arena */
+static const char *parseString(const char **p, Arena *arena) {
+    const char *s = *p;
+    if (*s++ != '"') return NULL;
+    char *out = arenaAlloc(arena, strlen(s) + 1);
+    size_t k = 0;
+    while (*s && *s != '"') {
+        if (*s == '\\' && s[1] == 'u' && s[2] && s[3] && s[4] && s[5]) {
+            char hex[5] = { s[2], s[3], s[4], s[5], 0 };
+            out[k++] = (char)strtol(hex, NULL, 16);
+            s += 6;
+        } else if (*s == '\\' && s[1]) {
+            out[k++] = s[1];
+            s += 2;
+        } else {
+            out[k++] = *s++;
+        }
+    }
+    if (*s != '"') return NULL;
+    out[k] = '\0';
+    *p = s + 1;
+    return out;
+}
+
+static int cmpHit(const void *x, const void *y) {
+    const SearchHit *a = x, *b = y;
+    if (a->score != b->score) return a->score < b->score ? 1 : -1;
+    return (a->docId > b->docId) - (a->docId < b->docId);
+}
+
+int setShardServers(const char *spec) {
+    freeShardServers();
+    char *copy = strdup(spec);
+    if (!copy) { perror("strdup"); exit(1); }
+    int bad = 0;
+    for (char *save = NULL, *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        servers = realloc(servers, sizeof(ShardServer) * (serverCount + 1));
+        if (!servers) { perror("realloc"); exit(1); }
+        ShardServer *s = &servers[serverCount++];
+        char *end;
+        long port = strtol(tok, &end, 10);
+        s->path = NULL;
+        s->port = (int)port;
+        if (*end != '\0') s->path = strdup(tok);
+        else if (port <= 0 || port > 65535) bad = 1;
+    }
+    free(copy);
+    if (bad || serverCount == 0) { freeShardServers(); return -1; }
+    return 0;
+}
+
+int shardServerCount(void) {
+    return serverCount;
+}
+
+void freeShardServers(void) {
+    if (serverCount > 0) {
+        pthread_once(&coordOnce, makeCoordKey);
+        CoordState *cs = pthread_getspecific(coordKey);
+        if (cs) freeCoordState(cs);
+        pthread_setspecific(coordKey, NULL);
+    }
+    for (int i = 0; i < serverCount; i++) free(servers[i].path);
+    free(servers);
+    servers = NULL;
+    serverCount = 0;
+}
+
+static void dropAll(CoordState *cs) {
+    for (int i = 0; i < serverCount; i++) dropConn(&cs->conns[i]);
+}
+
+/* TermLister over the shard servers (ctx: the thread's CoordState): one
+   round of ":shard-terms <max> <pattern>" */
+static int shardTerms(const char *pattern, int max, Arena *arena, const char **out, void *ctx) {
+    CoordState *cs = ctx;
+    if (cs->failed) return 0;
+    TextBuf req = { NULL, 0, 0 };
+    char head[32];
+    snprintf(head, sizeof(head), ":shard-terms %d ", max);
+    textStr(&req, head);
+    textStr(&req, pattern);
+    textStr(&req, "\n");
+    const char **shard = arenaAlloc(arena, sizeof(char *) * max), **merged = arenaAlloc(arena, sizeof(char *) * max);
+    int n = 0, sent = 0;
+    for (int i = 0; i < serverCount; i++) sent += sendRequest(i, &cs->conns[i], req.s, req.len) == 0;
+    free(req.s);
+    for (int i = 0; i < serverCount && !cs->failed; i++) {
+        char *line = readReply(i, &cs->conns[i]);
+        const char *p = line;
+        if (!line || !findKey(&p, "terms") || *p++ != '[') {
+            if (line) shardError(i, "bad reply");
+            cs->failed = 1;
+            break;
+        }
+        int k = 0;
+        while (k < max && *p == '"') {
+            if (!(shard[k++] = parseString(&p, arena))) { shardError(i, "bad reply"); cs->failed = 1; break; }
+            if (*p == ',') p++;
+        }
+        n = unionTerms(out, n, shard, k, max, merged);
+        memcpy(out, merged, sizeof(char *) * n);
+    }
+    if (sent < serverCount || cs->failed) {
+        cs->failed = 1;
+        dropAll(cs);
+        return 0;
+    }
+    return n;
+}
+
+/* Both rounds of one query (three with wildcards). Returns the number of hits, or -1 if a shard
+   failed (it has been reported). */
+static int scatterGather(CoordState *cs, const char *query, SearchHit *hits) {
+    TextBuf req = { NULL, 0, 0 };
+    int n = serverCount, words = -1, rc = -1, total = 0;
+    double *df = NULL, *step = NULL, *idf = NULL, *shardDf = NULL;
+    int *base = malloc(sizeof(int) * n);
+    SearchHit *all = malloc(sizeof(SearchHit) * TOP_K * n);
+    if (!base || !all) { perror("malloc"); exit(1); }
+    ScoringModel model = SCORE_TFIDF;
+
+    /* every shard must see the same words: their wildcards are expanded
+       over all of them first */
+    cs->failed = 0;
+    query = expandWildcards(query, shardTerms, cs, &cs->names);
+    if (cs->failed) goto done;
+
+    /* round 1: statistics */
+    textStr(&req, ":shard-stats ");
+    textStr(&req, query);
+    textStr(&req, "\n");
+    int sent = 0;
+    for (int i = 0; i < n; i++) sent += sendRequest(i, &cs->conns[i], req.s, req.len) == 0;
+    int docs = 0;
+    for (int i = 0; i < n; i++) {
+        char *line = readReply(i, &cs->conns[i]);
+        if (!line) goto done;
+        const char *p = line;
+        if (!findKey(&p, "docs")) { shardError(i, "bad reply"); goto done; }
+        base[i] = docs;
+        docs += atoi(p);
+        p = line;
+        if (findKey(&p, "scoring") && strncmp(p, "\"bm25\"", 6) == 0) model = SCORE_BM25;
+        /* every shard parses the query alike, so the word lists line up */
+        int w = 0;
+        p = line;
+        if (findKey(&p, "df") && *p == '[' && p[1] != ']')
+            for (w = 1; *p && *p != ']'; p++) w += *p == ',';
+        if (words < 0) {
+            words = w;
+            df = calloc(words ? words : 1, sizeof(double));
+            step = calloc(words ? words : 1, sizeof(double));
+            idf = calloc(words ? words : 1, sizeof(double));
+            shardDf = calloc(words ? words : 1, sizeof(double));
+            if (!df || !step || !idf || !shardDf) { perror("calloc"); exit(1); }
+        }
+        double *shardStep = idf;        /* scratch until the idfs are computed */
+        if (w != words || parseNumbers(line, "df", shardDf, w) != 0 || parseNumbers(line, "step", shardStep, w) != 0) {
+            shardError(i, "statistics don't match the other shards'");
+            goto done;
+        }
+        for (int k = 0; k < w; k++) {
+            df[k] += shardDf[k];
+            if (shardStep[k] > step[k]) step[k] = shardStep[k];
+        }
+    }
+    if (sent < n) goto done;
+
+    /* round 2: rank with the collection's statistics */
+    for (int k = 0; k < words; k++) idf[k] = scoringIdf(model, (double)docs, df[k]);
+    double unit = scoreUnit(idf, step, words);
+    char num[64];
+    req.len = 0;
+    snprintf(num, sizeof(num), ":shard-rank %.17g %d", unit, words);
+    textStr(&req, num);
+    for (int k = 0; k < words; k++) {
+        snprintf(num, sizeof(num), " %.17g", idf[k]);
+        textStr(&req, num);
+    }
+    textStr(&req, " ");
+    textStr(&req, query);
+    textStr(&req, "\n");
+    sent = 0;
+    for (int i = 0; i < n; i++) sent += sendRequest(i, &cs->conns[i], req.s, req.len) == 0;
+    for (int i = 0; i < n; i++) {
+        char *line = readReply(i, &cs->conns[i]);
+        if (!line) goto done;
+        const char *p = line;
+        while (total < TOP_K * n && findKey(&p, "docId")) {
+            SearchHit *h = &all[total];
+            h->docId = base[i] + atoi(p);
+            if (!findKey(&p, "doc") || !(h->name = parseString(&p, &cs->names)) || !findKey(&p, "score")) {
+                shardError(i, "bad reply");
+                goto done;
+            }
+            h->score = strtod(p, NULL);
+            total++;
+        }
+    }
+    if (sent < n) goto done;
+    qsort(all, total, sizeof(SearchHit), cmpHit);
+    rc = total < TOP_K ? total : TOP_K;
+    memcpy(hits, all, sizeof(SearchHit) * rc);
+done:
+    /* replies still unread would answer the next query */
+    if (rc < 0) dropAll(cs);
+    free(req.s);
+    free(base);
+    free(all);
+    free(df);
+    free(step);
+    free(idf);
+    free(shardDf);
+    return rc;
+}
+
+int searchShardServers(const char *query, SearchHit *hits) {
+    if (!query || !*query) return 0;
+    CoordState *cs = coordState();
+    arenaReset(&cs->names);
+    int k = scatterGather(cs, query, hits);
+    return k < 0 ? 0 : k;
+}
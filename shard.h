@@ -0,0 +1,69 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "search.h"
+
+/* ---------------- Shards ----------------
+   A collection too big for one index is split into N shards, each an
+   ordinary index file, by docId range (runs of files in path order, the
+   default) or by a hash of the file path. Shards are built and saved one
+   after another, so a build holds one shard in memory at a time. A text
+   manifest lists them, relative to its own directory:
+
+     mse-shards 1
+     by range
+     shard docs.idx.0
+     shard docs.idx.1
+
+   Loaded together, the shards are the segments of one view: idf comes
+   from df and N summed over all of them, and --fanout ranks them on
+   several threads at once. Built by range, docIds are the same as an
+   unsharded build. With --exact-scores the results are the same too.
+   Quantized impacts are fitted to each shard's own maxima, as they are
+   per segment.
+
+   Shards can also be separate processes. Each one serves its shard
+   (--serve), and a coordinator (--shard-servers) sends every query to all
+   of them in two rounds over their sockets:
+
+     ":shard-stats <query>"
+        -> {"docs":N,"scoring":"bm25","df":[..],"step":[..]}
+     ":shard-rank <unit> <k> <idf 1..k> <query>"
+        -> {"hits":[{"docId":..,"doc":"..","score":..}]}
+     ":shard-terms <max> <pattern>"
+        -> {"terms":[".."]}
+
+   The first round gets each shard's doc count, and its df and largest
+   impact step for every ranking word of the query. The coordinator turns
+   the sums into idf and one weight unit. In the second round every shard
+   ranks its documents with those numbers and returns its top K with
+   scores printed to full precision. The coordinator then merges the
+   lists, numbering each shard's docs after the previous shard's. A query
+   with wildcards first asks every shard for its matching terms, and the
+   rounds after that get the query with the union of them written in. */
+
+typedef enum ShardBy { SHARD_BY_RANGE, SHARD_BY_HASH } ShardBy;
+
+/* Index the files under docPath into `shards` index files named
+   manifest.0, manifest.1, ... and write the manifest. 0 on success. */
+int buildShards(const char *docPath, const char *manifest, int shards, ShardBy by, int jobs);
+/* Map every shard of a manifest, or a plain index file as one shard.
+   Returns a malloc'd array of *n images, or NULL. loadShards also takes
+   on the first shard's settings (useIndexSettings). */
+Index **openShards(const char *path, int *n);
+Index **loadShards(const char *path, int *n);
+
+/* coordinator: spec is a comma-separated list of Unix socket paths and
+   127.0.0.1 port numbers. -1 if it is malformed. */
+int setShardServers(const char *spec);
+int shardServerCount(void);
+/* searchQuery() over the shard servers; names stay valid until the
+   calling thread's next query */
+int searchShardServers(const char *query, SearchHit *hits);
+void freeShardServers(void);
+
+/* shard side: the reply line (malloc'd, '\n'-terminated) to a request
+   starting with ":shard-" */
+char *answerShardRequest(const char *line, size_t *len);
+
+#endif
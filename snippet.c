@@ -0,0 +1,249 @@
+#include "snippet.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define SNIPPET_OCCURRENCES 512     /* occurrences a window is chosen from, shared by the words */
+#define SNAP_BYTES 24               /* how far in a window edge may move to land on whitespace */
+
+typedef struct Occurrence {
+    uint32_t offset;        /* of the token's first kept byte */
+    int word;               /* index into the query's words */
+} Occurrence;
+
+static int cmpOccurrence(const void *a, const void *b) {
+    uint32_t x = ((const Occurrence *)a)->offset, y = ((const Occurrence *)b)->offset;
+    return (x > y) - (x < y);
+}
+
+static inline int isSpace(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline int isWordByte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+/* The run occ[*first..*end) that fits in SNIPPET_BYTES with the most
+   distinct words, then the most occurrences, then the earliest. */
+static void densestRun(const Occurrence *occ, int n, const char *const *words, int *first, int *end) {
+    int bestWords = 0, bestCount = 0, j = 0;
+    *first = *end = 0;
+    for (int i = 0; i < n; i++) {
+        if (j < i) j = i;
+        uint64_t limit = (uint64_t)occ[i].offset + SNIPPET_BYTES;
+        while (j < n && occ[j].offset + strlen(words[occ[j].word]) <= limit) j++;
+        if (j == i) j = i + 1;      /* a word longer than the window still gets one */
+        uint64_t seen = 0;
+        for (int k = i; k < j; k++) seen |= 1ULL << (occ[k].word & 63);
+        int w = __builtin_popcountll(seen), count = j - i;
+        if (w > bestWords || (w == bestWords && count > bestCount)) {
+            bestWords = w;
+            bestCount = count;
+            *first = i;
+            *end = j;
+        }
+    }
+}
+
+/* Length of the token starting at text[at] (up to whitespace or len, less
+   trailing punctuation), or 0 if it doesn't normalize to word: the file
+   may have changed since it was indexed. */
+static size_t markLength(const unsigned char *text, size_t at, size_t len, const char *word) {
+    size_t e = at;
+    while (e < len && !isSpace(text[e])) e++;
+    while (e > at && !isWordByte(text[e - 1])) e--;
+    const char *w = word;
+    for (size_t i = at; i < e; i++) {
+        if (!isWordByte(text[i])) continue;
+        if (*w++ != (char)(text[i] | (text[i] >= 'A' && text[i] <= 'Z' ? 0x20 : 0))) return 0;
+    }
+    return *w ? 0 : e - at;
+}
+
+/* Cut the snippet of the file at path from its sorted occurrences occ[0..n). */
+static void cutSnippet(const char *path, Occurrence *occ, int n, const char *const *words, Snippet *s) {
+    int first, end;
+    memset(s, 0, sizeof(*s));
+    densestRun(occ, n, words, &first, &end);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return; }
+    uint64_t size = (uint64_t)st.st_size;
+
+    /* the run, with a third of the room left over before it */
+    uint64_t from = 0, to = SNIPPET_BYTES;
+    if (end > first && occ[first].offset < size) {
+        uint64_t lo = occ[first].offset, hi = occ[end - 1].offset + strlen(words[occ[end - 1].word]);
+        uint64_t room = hi - lo < SNIPPET_BYTES ? (SNIPPET_BYTES - (hi - lo)) / 3 : 0;
+        from = lo > room ? lo - room : 0;
+        to = from + SNIPPET_BYTES;
+        if (to > size) from = size > SNIPPET_BYTES ? size - SNIPPET_BYTES : 0;
+    }
+    if (to > size) to = size;
+
+    /* read the window, plus the bytes on either side of it */
+    uint64_t readFrom = from ? from - 1 : 0, readTo = to < size ? to + 1 : size;
+    ssize_t got = readTo > readFrom ? pread(fd, s->buf, readTo - readFrom, (off_t)readFrom) : 0;
+    close(fd);
+    if (got != (ssize_t)(readTo - readFrom)) {
+        s->text = got < 0 ? NULL : "";
+        return;
+    }
+    const unsigned char *t = (const unsigned char *)s->buf + (from - readFrom);
+    size_t a = 0, b = to - from;
+
+    /* move the edges in to whitespace, without cutting into a match */
+    size_t firstMark = end > first && occ[first].offset >= from ? occ[first].offset - from : b;
+    if (from > 0 && !isSpace(t[-1])) {
+        for (size_t k = 0; k < SNAP_BYTES && k < firstMark; k++)
+            if (isSpace(t[k])) { a = k + 1; break; }
+        while (a < b && (t[a] & 0xc0) == 0x80) a++;     /* nor into a UTF-8 sequence */
+    }
+    if (to < size && !isSpace(t[b])) {
+        size_t lastMark = end > first ? occ[end - 1].offset - from + strlen(words[occ[end - 1].word]) : a;
+        for (size_t k = b; k > a && k > lastMark && b - k < SNAP_BYTES; k--)
+            if (isSpace(t[k - 1])) { b = k - 1; break; }
+        while (b > a && (t[b] & 0xc0) == 0x80) b--;
+    }
+    while (a < b && isSpace(t[a])) a++;
+    while (b > a && isSpace(t[b - 1])) b--;
+
+    s->text = (const char *)t + a;
+    s->len = b - a;
+    s->cutStart = from > 0;
+    s->cutEnd = to < size;
+    for (int i = first; i < end && s->marks < SNIPPET_MARKS; i++) {
+        if (occ[i].offset < from + a || occ[i].offset >= from + b) continue;
+        size_t at = occ[i].offset - from - a;
+        size_t len = markLength((const unsigned char *)s->text, at, s->len, words[occ[i].word]);
+        if (len == 0) continue;
+        s->mark[s->marks].start = (uint32_t)at;
+        s->mark[s->marks].len = (uint32_t)len;
+        s->marks++;
+    }
+}
+
+void makeSnippets(const Index *idx, const int *docIds, const char *const *paths, int n,
+                  const char *const *words, int wordCount, Snippet *const *out) {
+    /* one cursor per distinct word that the index holds */
+    PostingCursor *cursors = malloc(sizeof(PostingCursor) * (wordCount ? wordCount : 1));
+    int *cursorWord = malloc(sizeof(int) * (wordCount ? wordCount : 1));
+    if (!cursors || !cursorWord) { perror("malloc"); exit(1); }
+    int nc = 0;
+    for (int i = 0; i < wordCount && indexHasPositions(idx); i++) {
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++) seen = strcmp(words[i], words[j]) == 0;
+        const TermRecord *t = seen ? NULL : findTermRecord(idx, words[i]);
+        if (!t) continue;
+        openPostings(idx, t, &cursors[nc]);
+        cursorWord[nc++] = i;
+    }
+    /* hits in docId order, so the cursors only move forward */
+    int order[n ? n : 1];
+    for (int i = 0; i < n; i++) {
+        int j = i;
+        while (j > 0 && docIds[order[j - 1]] > docIds[i]) { order[j] = order[j - 1]; j--; }
+        order[j] = i;
+    }
+    int share = nc ? SNIPPET_OCCURRENCES / nc : 0;
+    Occurrence occ[SNIPPET_OCCURRENCES];
+    for (int h = 0; h < n; h++) {
+        int doc = docIds[order[h]], k = 0;
+        for (int c = 0; c < nc; c++) {
+            if (!advancePosting(&cursors[c], doc) || cursors[c].docId != doc) continue;
+            const uint32_t *offs = postingOffsets(&cursors[c]);
+            for (int p = 0; p < cursors[c].frequency && p < share; p++) {
+                occ[k].offset = offs[p];
+                occ[k].word = cursorWord[c];
+                k++;
+            }
+        }
+        qsort(occ, k, sizeof(Occurrence), cmpOccurrence);
+        cutSnippet(paths[order[h]], occ, k, words, out[order[h]]);
+    }
+    for (int c = 0; c < nc; c++) closePostings(&cursors[c]);
+    free(cursors);
+    free(cursorWord);
+}
+
+/* ---------------- Rendering ---------------- */
+
+typedef void (*PutFn)(void *ctx, const char *p, size_t len);
+
+/* Walk the text in runs of plain bytes, calling put for each run and for
+   what replaces the rest: a space for each whitespace run, open and close
+   around marks, and escape(c) for bytes it returns a string for. */
+static void renderSnippet(const Snippet *s, PutFn put, void *ctx, const char *open, const char *close,
+                          const char *(*escape)(unsigned char c, char *buf)) {
+    const unsigned char *t = (const unsigned char *)s->text;
+    size_t run = 0, i = 0;
+    int m = 0, inMark = 0;
+    char buf[8];
+    if (s->cutStart) put(ctx, "...", 3);
+    while (i < s->len) {
+        const char *rep;
+        size_t skip = 1;
+        if (!inMark && m < s->marks && i == s->mark[m].start) {
+            rep = open;
+            skip = 0;
+            inMark = 1;
+        } else if (inMark && i == s->mark[m].start + s->mark[m].len) {
+            rep = close;
+            skip = 0;
+            inMark = 0;
+            m++;
+        } else if (isSpace(t[i])) {
+            rep = " ";
+            while (i + skip < s->len && isSpace(t[i + skip])) skip++;
+        } else if (!(rep = escape(t[i], buf))) {
+            i++;
+            continue;
+        }
+        if (i > run) put(ctx, s->text + run, i - run);
+        put(ctx, rep, strlen(rep));
+        i += skip;
+        run = i;
+    }
+    if (i > run) put(ctx, s->text + run, i - run);
+    if (inMark) put(ctx, close, strlen(close));
+    if (s->cutEnd) put(ctx, "...", 3);
+}
+
+static const char *escapeHtmlJson(unsigned char c, char *buf) {
+    switch (c) {
+    case '<': return "&lt;";
+    case '>': return "&gt;";
+    case '&': return "&amp;";
+    case '"': return "\\\"";
+    case '\\': return "\\\\";
+    }
+    if (c >= 0x20) return NULL;
+    snprintf(buf, 8, "\\u%04x", c);
+    return buf;
+}
+
+static const char *escapeTerminal(unsigned char c, char *buf) {
+    (void)buf;
+    return c < 0x20 || c == 0x7f ? "?" : NULL;
+}
+
+static void putText(void *ctx, const char *p, size_t len) {
+    textPut(ctx, p, len);
+}
+
+static void putFile(void *ctx, const char *p, size_t len) {
+    fwrite(p, 1, len, ctx);
+}
+
+void snippetJson(TextBuf *b, const Snippet *s) {
+    textPut(b, "\"", 1);
+    if (s->text) renderSnippet(s, putText, b, "<b>", "</b>", escapeHtmlJson);
+    textPut(b, "\"", 1);
+}
+
+void printSnippet(FILE *out, const Snippet *s, const char *open, const char *close) {
+    if (s->text) renderSnippet(s, putFile, out, open, close, escapeTerminal);
+}
@@ -0,0 +1,51 @@
+#ifndef SNIPPET_H
+#define SNIPPET_H
+
+#include <stdio.h>
+#include "store.h"
+#include "textbuf.h"
+
+/* ---------------- Snippets ----------------
+   A hit's snippet is a window of at most SNIPPET_BYTES of its source file
+   around the densest cluster of query words. The window is chosen from
+   the byte offsets the index keeps for every posting, so the document is
+   never re-tokenized, and only the window's bytes are read, with one
+   pread() into the snippet itself. (Mapping the pages instead costs about
+   four times as much per hit in mmap and munmap, and every munmap stalls
+   the other query threads on the address space.) The matches are marks of
+   (start, length) into the text. An index without positions has no
+   offsets, and its snippets are the start of the file, unmarked. */
+
+#define SNIPPET_BYTES 200
+#define SNIPPET_MARKS 32
+
+typedef struct SnippetMark {
+    uint32_t start;         /* into text */
+    uint32_t len;
+} SnippetMark;
+
+typedef struct Snippet {
+    const char *text;       /* NULL: the file couldn't be read (no snippet) */
+    size_t len;
+    int cutStart;           /* text starts after the start of the file */
+    int cutEnd;             /* and ends before its end */
+    int marks;              /* in text order */
+    SnippetMark mark[SNIPPET_MARKS];
+    char buf[SNIPPET_BYTES + 2];    /* the window and the byte either side; text points into it */
+} Snippet;
+
+/* Snippets of docIds[0..n) (local to idx) from their files paths[0..n)
+   into *out[0..n), marking the occurrences of words[0..wordCount)
+   (duplicates allowed). Each word's postings are walked once, through the
+   docs in docId order. A doc whose file can't be read gets text NULL. A
+   snippet's text points into itself, so it isn't copied around. */
+void makeSnippets(const Index *idx, const int *docIds, const char *const *paths, int n,
+                  const char *const *words, int wordCount, Snippet *const *out);
+
+/* s as a quoted JSON string of HTML: text escaped, matches in <b></b>,
+   whitespace runs as one space, and "..." where the file goes on */
+void snippetJson(TextBuf *b, const Snippet *s);
+/* s on one line with matches between open and close */
+void printSnippet(FILE *out, const Snippet *s, const char *open, const char *close);
+
+#endif
@@ -0,0 +1,354 @@
+#include "spimi.h"
+#include "store.h"
+
+#define MERGE_FANIN 32              /* runs merged at once */
+#define RUN_BUFFER (256 * 1024)     /* stdio buffer per open run */
+
+static size_t memLimit;
+
+void setBuildMemLimit(size_t bytes) {
+    memLimit = bytes;
+}
+
+size_t buildMemLimit(void) {
+    return memLimit;
+}
+
+/* ---------------- Run files ---------------- */
+
+static void putRunVarint(FILE *f, uint32_t v) {
+    while (v >= 0x80) {
+        putc_unlocked((int)((v | 0x80) & 0xff), f);
+        v >>= 7;
+    }
+    putc_unlocked((int)v, f);
+}
+
+static void putRunTerm(FILE *f, const char *word, size_t len, uint32_t df, double maxImpact) {
+    putRunVarint(f, (uint32_t)len);
+    fwrite(word, 1, len, f);
+    putRunVarint(f, df);
+    fwrite(&maxImpact, sizeof(maxImpact), 1, f);
+}
+
+/* prev: the docId of the term's previous posting in this run (0 before the first) */
+static void putRunPosting(FILE *f, uint32_t *prev, int docId, int frequency, const int *positions,
+                          const uint32_t *offsets, int posCount) {
+    putRunVarint(f, (uint32_t)docId - *prev);
+    *prev = (uint32_t)docId;
+    putRunVarint(f, (uint32_t)frequency);
+    int last = 0;
+    for (int k = 0; k < posCount; k++) {
+        putRunVarint(f, (uint32_t)(positions[k] - last));
+        last = positions[k];
+    }
+    uint32_t lastOff = 0;
+    for (int k = 0; k < posCount; k++) {
+        putRunVarint(f, offsets[k] - lastOff);
+        lastOff = offsets[k];
+    }
+}
+
+/* A run being read: the current term's header, its postings next in f. */
+typedef struct Run {
+    FILE *f;
+    const char *path;
+    int order;              /* runs cover increasing docIds in this order */
+    int failed;             /* truncated or unreadable */
+    char *word;
+    size_t cap;
+    uint32_t df;
+    double maxImpact;
+} Run;
+
+static uint32_t getRunVarint(Run *r) {
+    uint32_t v = 0;
+    int shift = 0, c;
+    do {
+        c = getc_unlocked(r->f);
+        if (c == EOF) { r->failed = 1; return 0; }
+        v |= (uint32_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return v;
+}
+
+/* Read the next term's header. Returns 0 at the end of the run. */
+static int nextRunTerm(Run *r) {
+    int c = getc_unlocked(r->f);
+    if (c == EOF) return 0;
+    ungetc(c, r->f);
+    uint32_t len = getRunVarint(r);
+    if (len + 1 > r->cap) {
+        r->cap = len + 1 > 64 ? len + 1 : 64;
+        r->word = realloc(r->word, r->cap);
+        if (!r->word) { perror("realloc"); exit(1); }
+    }
+    if (fread(r->word, 1, len, r->f) != len) r->failed = 1;
+    r->word[len] = '\0';
+    r->df = getRunVarint(r);
+    if (fread(&r->maxImpact, sizeof(r->maxImpact), 1, r->f) != 1) r->failed = 1;
+    return !r->failed;
+}
+
+/* ---------------- Building ---------------- */
+
+typedef struct SpimiBuild {
+    const char *path;
+    char **runs;            /* run file names, in docId order */
+    int nruns;
+    int runCap;
+    int named;              /* run files named so far */
+    double avgDocTerms;
+} SpimiBuild;
+
+static char *newRunName(SpimiBuild *b) {
+    size_t len = strlen(b->path) + 32;
+    char *name = malloc(len);
+    if (!name) { perror("malloc"); exit(1); }
+    snprintf(name, len, "%s.run%d", b->path, b->named++);
+    return name;
+}
+
+static void addRun(SpimiBuild *b, char *name) {
+    if (b->nruns == b->runCap) {
+        b->runCap = b->runCap ? b->runCap * 2 : 16;
+        b->runs = realloc(b->runs, sizeof(char *) * b->runCap);
+        if (!b->runs) { perror("realloc"); exit(1); }
+    }
+    b->runs[b->nruns++] = name;
+}
+
+typedef struct RunTerm {
+    const char *word;
+    const WordEntry *entry;
+} RunTerm;
+
+static int cmpRunTerm(const void *a, const void *b) {
+    return strcmp(((const RunTerm *)a)->word, ((const RunTerm *)b)->word);
+}
+
+/* Write the table out as the next run, sorted by term, and empty it.
+   0 on success. */
+static int flushRun(TermTable *table, void *ctx) {
+    SpimiBuild *b = ctx;
+    if (table->termCount == 0) return 0;
+    size_t bytes = termTableBytes(table);
+    char *name = newRunName(b);
+    FILE *f = fopen(name, "wb");
+    if (!f) { perror(name); free(name); return -1; }
+    setvbuf(f, NULL, _IOFBF, RUN_BUFFER);
+
+    RunTerm *terms = malloc(sizeof(RunTerm) * table->termCount);
+    if (!terms) { perror("malloc"); exit(1); }
+    for (uint32_t t = 0; t < table->termCount; t++) {
+        terms[t].entry = &table->entries[t];
+        terms[t].word = entryWord(table, &table->entries[t]);
+    }
+    qsort(terms, table->termCount, sizeof(RunTerm), cmpRunTerm);
+    ScoringModel model = indexBuildScoring();
+    for (uint32_t t = 0; t < table->termCount; t++) {
+        const WordEntry *e = terms[t].entry;
+        double maxImpact = 0.0;
+        for (const DocNode *d = e->docList; d; d = d->next) {
+            double v = scoringImpact(model, b->avgDocTerms, d->frequency, documents[d->docId].totalTerms);
+            if (v > maxImpact) maxImpact = v;
+        }
+        putRunTerm(f, terms[t].word, e->wordLen, (uint32_t)e->docFrequency, maxImpact);
+        uint32_t prev = 0;
+        for (const DocNode *d = e->docList; d; d = d->next)
+            putRunPosting(f, &prev, d->docId, d->frequency, d->positions, docNodeOffsets(d), d->posCount);
+    }
+    printf("Wrote run %d: %u terms from %zu MB\n", b->nruns + 1, table->termCount, bytes >> 20);
+    free(terms);
+    clearTermTable(table);
+
+    addRun(b, name);
+    if (ferror(f) | fclose(f)) { perror(name); return -1; }
+    return 0;
+}
+
+/* min-heap of runs by (current term, order): equal terms pop in run order */
+static int runBefore(const Run *a, const Run *b) {
+    int c = strcmp(a->word, b->word);
+    return c < 0 || (c == 0 && a->order < b->order);
+}
+
+static void siftDown(Run **heap, int n, int i) {
+    for (;;) {
+        int l = 2 * i + 1, m = i;
+        if (l < n && runBefore(heap[l], heap[m])) m = l;
+        if (l + 1 < n && runBefore(heap[l + 1], heap[m])) m = l + 1;
+        if (m == i) return;
+        Run *t = heap[i]; heap[i] = heap[m]; heap[m] = t;
+        i = m;
+    }
+}
+
+static void siftUp(Run **heap, int i) {
+    while (i > 0 && runBefore(heap[i], heap[(i - 1) / 2])) {
+        Run *t = heap[i]; heap[i] = heap[(i - 1) / 2]; heap[(i - 1) / 2] = t;
+        i = (i - 1) / 2;
+    }
+}
+
+/* Merge runs[0..k) term by term into another run (toRun) or the index
+   (toIndex). Returns 0, or -1 if a run couldn't be read. */
+static int mergeRuns(Run *runs, int k, FILE *toRun, IndexWriter *toIndex) {
+    Run **heap = malloc(sizeof(Run *) * (k ? k : 1)), **same = malloc(sizeof(Run *) * (k ? k : 1));
+    if (!heap || !same) { perror("malloc"); exit(1); }
+    int n = 0, keep = keepPositions(), failed = 0;
+    for (int i = 0; i < k; i++) {
+        if (nextRunTerm(&runs[i])) heap[n++] = &runs[i];
+        else if (runs[i].failed) failed = 1;
+    }
+    for (int i = n / 2 - 1; i >= 0; i--) siftDown(heap, n, i);
+    int *pos = NULL, posCap = 0;
+    uint32_t *offs = NULL;
+
+    while (n > 0 && !failed) {
+        int m = 0;
+        do {
+            same[m++] = heap[0];
+            heap[0] = heap[--n];
+            siftDown(heap, n, 0);
+        } while (n > 0 && strcmp(heap[0]->word, same[0]->word) == 0);
+
+        uint32_t df = 0;
+        double maxImpact = 0.0;
+        for (int j = 0; j < m; j++) {
+            df += same[j]->df;
+            if (same[j]->maxImpact > maxImpact) maxImpact = same[j]->maxImpact;
+        }
+        if (toIndex) writeTerm(toIndex, same[0]->word, df, maxImpact);
+        else putRunTerm(toRun, same[0]->word, strlen(same[0]->word), df, maxImpact);
+        uint32_t prevOut = 0;
+        for (int j = 0; j < m; j++) {
+            Run *r = same[j];
+            uint32_t docId = 0;
+            for (uint32_t p = 0; p < r->df && !r->failed; p++) {
+                docId += getRunVarint(r);
+                int freq = (int)getRunVarint(r), posCount = keep ? freq : 0;
+                if (posCount > posCap) {
+                    posCap = posCount < 16 ? 16 : posCount;
+                    pos = realloc(pos, sizeof(int) * posCap);
+                    offs = realloc(offs, sizeof(uint32_t) * posCap);
+                    if (!pos || !offs) { perror("realloc"); exit(1); }
+                }
+                int last = 0;
+                for (int q = 0; q < posCount; q++) {
+                    last += (int)getRunVarint(r);
+                    pos[q] = last;
+                }
+                uint32_t lastOff = 0;
+                for (int q = 0; q < posCount; q++) {
+                    lastOff += getRunVarint(r);
+                    offs[q] = lastOff;
+                }
+                if (toIndex) writePosting(toIndex, (int)docId, freq, pos, offs, posCount);
+                else putRunPosting(toRun, &prevOut, (int)docId, freq, pos, offs, posCount);
+            }
+        }
+        for (int j = 0; j < m; j++) {
+            if (same[j]->failed) failed = 1;
+            else if (nextRunTerm(same[j])) { heap[n] = same[j]; siftUp(heap, n++); }
+            else if (same[j]->failed) failed = 1;
+        }
+    }
+    free(pos);
+    free(offs);
+    free(heap);
+    free(same);
+    return failed ? -1 : 0;
+}
+
+/* Open the run files names[0..k) for reading; -1 if one can't be. */
+static int openRuns(char *const *names, int k, Run *runs) {
+    memset(runs, 0, sizeof(Run) * k);
+    for (int i = 0; i < k; i++) {
+        runs[i].path = names[i];
+        runs[i].order = i;
+        runs[i].f = fopen(runs[i].path, "rb");
+        if (!runs[i].f) { perror(runs[i].path); return -1; }
+        setvbuf(runs[i].f, NULL, _IOFBF, RUN_BUFFER);
+    }
+    return 0;
+}
+
+/* Close the runs and delete their files. */
+static void closeRuns(Run *runs, int k) {
+    for (int i = 0; i < k; i++) {
+        if (runs[i].f) fclose(runs[i].f);
+        if (runs[i].path) remove(runs[i].path);
+        free(runs[i].word);
+    }
+}
+
+/* Merge groups of MERGE_FANIN runs into single runs until at most
+   MERGE_FANIN are left. */
+static int reduceRuns(SpimiBuild *b, Run *runs) {
+    while (b->nruns > MERGE_FANIN) {
+        char **from = b->runs;
+        int total = b->nruns;
+        b->runs = NULL;
+        b->nruns = b->runCap = 0;
+        for (int g = 0; g < total; g += MERGE_FANIN) {
+            int k = total - g < MERGE_FANIN ? total - g : MERGE_FANIN;
+            if (k == 1) { addRun(b, from[g]); from[g] = NULL; continue; }
+            char *name = newRunName(b);
+            FILE *f = fopen(name, "wb");
+            int rc = f ? openRuns(from + g, k, runs) : -1;
+            if (!f) perror(name);
+            else setvbuf(f, NULL, _IOFBF, RUN_BUFFER);
+            if (rc == 0) rc = mergeRuns(runs, k, f, NULL);
+            closeRuns(runs, k);
+            if (f && (ferror(f) | fclose(f)) && rc == 0) { perror(name); rc = -1; }
+            addRun(b, name);
+            if (rc != 0) {
+                for (int i = g + k; i < total; i++) addRun(b, from[i]);
+                for (int i = g; i < g + k; i++) free(from[i]);
+                free(from);
+                return -1;
+            }
+        }
+        for (int i = 0; i < total; i++) free(from[i]);
+        free(from);
+    }
+    return 0;
+}
+
+int buildIndexFile(char *const *paths, int n, const char *path, int jobs, size_t *size) {
+    SpimiBuild b = { .path = path };
+    /* BM25 impacts in a run need the average doc length of documents not
+       yet read */
+    double avg = indexBuildAvgDocTerms();
+    int ownAvg = avg <= 0 && indexBuildScoring() == SCORE_BM25;
+    if (ownAvg) setIndexAvgDocTerms(avg = averageDocTerms(paths, n));
+    b.avgDocTerms = avg;
+
+    TermTable *table = createTermTable();
+    int rc = indexFileListBounded(table, paths, n, jobs, memLimit ? memLimit : SIZE_MAX, flushRun, &b);
+    if (rc == 0) rc = flushRun(table, &b);
+    freeTermTable(table);
+
+    Run *runs = malloc(sizeof(Run) * MERGE_FANIN);
+    if (!runs) { perror("malloc"); exit(1); }
+    if (rc == 0) rc = reduceRuns(&b, runs);
+    if (rc == 0) {
+        printf("Merging %d run(s)...\n", b.nruns);
+        IndexWriter *w = openIndexWriter(path);
+        rc = w ? openRuns(b.runs, b.nruns, runs) : -1;
+        if (rc == 0) rc = mergeRuns(runs, b.nruns, NULL, w);
+        closeRuns(runs, w ? b.nruns : 0);
+        if (rc == 0) rc = closeIndexWriter(w, size);
+        else if (w) discardIndexWriter(w);
+    }
+    for (int i = 0; i < b.nruns; i++) {
+        remove(b.runs[i]);
+        free(b.runs[i]);
+    }
+    free(b.runs);
+    free(runs);
+    if (ownAvg) setIndexAvgDocTerms(0);
+    return rc;
+}
@@ -0,0 +1,35 @@
+#ifndef SPIMI_H
+#define SPIMI_H
+
+#include <stddef.h>
+
+/* ---------------- Memory-bounded builds ----------------
+   With a memory limit, a build doesn't hold the whole corpus's postings
+   (single-pass in-memory indexing, SPIMI). Documents are tokenized into a
+   term table as usual, but whenever the table reaches the limit it is
+   written out as a sorted run and emptied. A run file is, term by term in
+   sorted order:
+
+     varint length, term bytes, varint df, double maxImpact,
+     then per posting: varint docId delta, varint tf,
+                       [tf varint position deltas, tf varint byte offset deltas]
+
+   Runs hold consecutive docId ranges, so a term's postings are in docId
+   order when its runs are read one after another. The runs are merged
+   k ways (MERGE_FANIN at a time, in extra passes if there are more) into
+   the index through an IndexWriter, reading and writing sequentially. What
+   stays in memory besides the table is the document table, and for the
+   final merge the term records and dictionary. BM25 impacts need the
+   collection's average doc length before the first run is written, which
+   a counting pass over the files finds first. The image is the same as an
+   in-memory build's. */
+
+/* flush the postings table at this many bytes (0, the default: build in memory) */
+void setBuildMemLimit(size_t bytes);
+size_t buildMemLimit(void);
+/* Index files (in docId order) into an index file at path, in runs of at
+   most buildMemLimit() bytes. documents[] is left filled in. 0 on success,
+   with the file's size in *size. */
+int buildIndexFile(char *const *paths, int n, const char *path, int jobs, size_t *size);
+
+#endif
@@ -0,0 +1,238 @@
+#include "stats.h"
+#include "docset.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* value v goes to bucket 64 - clz(v): bucket 0 holds 0, bucket b holds
+   [2^(b-1), 2^b - 1] */
+#define HIST_BUCKETS 48
+#define BAR_WIDTH 40
+
+typedef struct Histogram {
+    uint64_t count, sum, max;
+    uint64_t buckets[HIST_BUCKETS];
+} Histogram;
+
+int queryTracing;
+
+static Histogram stageHist[STAGE_COUNT], totalHist, postingsHist;
+static uint64_t cachedQueries;
+
+static const char *const stageNames[STAGE_COUNT] = { "parse", "cache", "match", "score", "sort" };
+
+void setQueryTracing(int on) {
+    queryTracing = on;
+}
+
+static int log2Bucket(uint64_t v) {
+    int b = v ? 64 - __builtin_clzll(v) : 0;
+    return b < HIST_BUCKETS ? b : HIST_BUCKETS - 1;
+}
+
+static uint64_t bucketLow(int b) {
+    return b ? (uint64_t)1 << (b - 1) : 0;
+}
+
+static uint64_t bucketHigh(int b) {
+    return b ? ((uint64_t)1 << b) - 1 : 0;
+}
+
+/* histograms are shared by every query thread: relaxed atomics only */
+static void histAdd(Histogram *h, uint64_t v) {
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum, v, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->buckets[log2Bucket(v)], 1, __ATOMIC_RELAXED);
+    uint64_t m = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while (v > m && !__atomic_compare_exchange_n(&h->max, &m, v, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+static void histSnapshot(const Histogram *h, Histogram *out) {
+    out->count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+    out->sum = __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+    out->max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    for (int b = 0; b < HIST_BUCKETS; b++) out->buckets[b] = __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+}
+
+/* upper bound of the bucket holding the p-th value, capped at the max */
+static uint64_t histPercentile(const Histogram *h, double p) {
+    uint64_t want = (uint64_t)(p * (double)h->count), seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen > want) return bucketHigh(b) < h->max ? bucketHigh(b) : h->max;
+    }
+    return h->max;
+}
+
+void recordQueryTrace(const QueryTrace *t) {
+    for (int s = 0; s < STAGE_COUNT; s++) histAdd(&stageHist[s], t->ns[s]);
+    histAdd(&totalHist, t->totalNs);
+    histAdd(&postingsHist, t->postingsMatched + t->postingsScored);
+    if (t->cached) __atomic_fetch_add(&cachedQueries, 1, __ATOMIC_RELAXED);
+}
+
+void printQueryTrace(const QueryTrace *t, FILE *out) {
+    fprintf(out, "  trace:");
+    for (int s = 0; s < STAGE_COUNT; s++) fprintf(out, " %s %.1fus", stageNames[s], t->ns[s] / 1e3);
+    fprintf(out, " = %.1fus", t->totalNs / 1e3);
+    if (t->cached) fprintf(out, " (result cache hit)\n");
+    else fprintf(out, "; postings %llu matched + %llu scored, %llu docs matched\n",
+                 (unsigned long long)t->postingsMatched, (unsigned long long)t->postingsScored,
+                 (unsigned long long)t->docsMatched);
+}
+
+static void printBar(FILE *out, uint64_t n, uint64_t most) {
+    int w = most ? (int)((n * BAR_WIDTH + most - 1) / most) : 0;
+    for (int i = 0; i < w; i++) fputc('#', out);
+}
+
+static void printTimingRow(FILE *out, const char *name, const Histogram *h) {
+    fprintf(out, "  %-6s %10.1f %10.1f %10.1f %10.1f %10.1f\n", name,
+            h->count ? h->sum / 1e3 / h->count : 0.0, histPercentile(h, 0.50) / 1e3,
+            histPercentile(h, 0.90) / 1e3, histPercentile(h, 0.99) / 1e3, h->max / 1e3);
+}
+
+void printTraceHistograms(FILE *out) {
+    Histogram total, h;
+    histSnapshot(&totalHist, &total);
+    if (total.count == 0) {
+        fprintf(out, queryTracing ? "no traced queries yet\n" : "query tracing is off (--trace)\n");
+        return;
+    }
+    fprintf(out, "%llu traced queries, %llu from the result cache (percentiles are log2 bucket bounds)\n",
+            (unsigned long long)total.count,
+            (unsigned long long)__atomic_load_n(&cachedQueries, __ATOMIC_RELAXED));
+    fprintf(out, "  %-6s %10s %10s %10s %10s %10s\n", "stage", "mean_us", "p50_us", "p90_us", "p99_us", "max_us");
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        histSnapshot(&stageHist[s], &h);
+        printTimingRow(out, stageNames[s], &h);
+    }
+    printTimingRow(out, "total", &total);
+
+    histSnapshot(&postingsHist, &h);
+    fprintf(out, "postings decoded per query: mean %.1f p50 %llu p99 %llu max %llu\n",
+            (double)h.sum / h.count, (unsigned long long)histPercentile(&h, 0.50),
+            (unsigned long long)histPercentile(&h, 0.99), (unsigned long long)h.max);
+
+    uint64_t most = 0;
+    int lo = HIST_BUCKETS, hi = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        if (!total.buckets[b]) continue;
+        if (total.buckets[b] > most) most = total.buckets[b];
+        if (b < lo) lo = b;
+        hi = b;
+    }
+    fprintf(out, "total latency:\n");
+    for (int b = lo; b <= hi; b++) {
+        fprintf(out, "  < %9.1f us %10llu ", (bucketHigh(b) + 1) / 1e3, (unsigned long long)total.buckets[b]);
+        printBar(out, total.buckets[b], most);
+        fputc('\n', out);
+    }
+}
+
+/* ---------------- Index statistics ---------------- */
+
+static int cmpU32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* rows "lo-hi  count (share of weight)" for the non-empty buckets */
+static void printCountBuckets(FILE *out, const char *unit, const uint64_t *counts,
+                              const uint64_t *weight, uint64_t weightTotal) {
+    uint64_t most = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) if (counts[b] > most) most = counts[b];
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        if (!counts[b]) continue;
+        char range[48];
+        if (bucketLow(b) == bucketHigh(b)) snprintf(range, sizeof(range), "%llu", (unsigned long long)bucketLow(b));
+        else snprintf(range, sizeof(range), "%llu-%llu", (unsigned long long)bucketLow(b),
+                      (unsigned long long)bucketHigh(b));
+        fprintf(out, "  %-15s %10llu %s", range, (unsigned long long)counts[b], unit);
+        if (weight) fprintf(out, " %5.1f%%", weightTotal ? 100.0 * weight[b] / weightTotal : 0.0);
+        fputc(' ', out);
+        printBar(out, counts[b], most);
+        fputc('\n', out);
+    }
+}
+
+static void printShare(FILE *out, const char *name, uint64_t bytes, uint64_t total) {
+    fprintf(out, "  %-10s %14llu bytes %5.1f%%\n", name, (unsigned long long)bytes,
+            total ? 100.0 * bytes / total : 0.0);
+}
+
+void printIndexStats(const Index *idx, FILE *out) {
+    const IndexHeader *h = idx->hdr;
+    fprintf(out, "docs=%u terms=%u image=%zu bytes scoring=%s impacts=%u-bit\n", h->docCount, h->termCount,
+            idx->size, h->scoring == SCORE_BM25 ? "bm25" : "tfidf", h->impactBits);
+
+    /* term table: probes a successful lookup takes */
+    uint64_t probes[HIST_BUCKETS] = { 0 }, probeSum = 0, probeMax = 0;
+    for (uint32_t b = 0; b < h->bucketCount; b++) {
+        if (!idx->buckets[b]) continue;
+        uint32_t p = termProbeLength(idx, b);
+        probes[log2Bucket(p)]++;
+        probeSum += p;
+        if (p > probeMax) probeMax = p;
+    }
+    fprintf(out, "term table: %u slots, load %.2f, probes per lookup mean %.2f max %llu\n",
+            h->bucketCount, (double)h->termCount / h->bucketCount,
+            h->termCount ? (double)probeSum / h->termCount : 0.0, (unsigned long long)probeMax);
+    printCountBuckets(out, "terms", probes, NULL, 0);
+
+    /* dictionary: front-coded against the terms as plain strings */
+    uint64_t plain = 0;
+    TermCursor term;
+    openTerms(idx, &term);
+    while (nextTerm(&term)) plain += term.len + 1;
+    closeTerms(&term);
+    fprintf(out, "dictionary: %llu bytes front-coded in blocks of %d (%llu as strings)\n",
+            (unsigned long long)(h->postingsOff - h->dictOff), DICT_BLOCK, (unsigned long long)plain);
+
+    /* posting lists: how many terms have how many docs, and their share of all postings */
+    uint64_t lists[HIST_BUCKETS] = { 0 }, listPostings[HIST_BUCKETS] = { 0 }, postings = 0;
+    PostingBytes bytes = { 0, 0, 0, 0, 0, 0 };
+    uint32_t dense = 0;
+    for (uint32_t t = 0; t < h->termCount; t++) {
+        const TermRecord *rec = &idx->terms[t];
+        int b = log2Bucket(rec->docFrequency);
+        lists[b]++;
+        listPostings[b] += rec->docFrequency;
+        postings += rec->docFrequency;
+        dense += termIsDense(idx, rec);
+        measurePostings(idx, rec, &bytes);
+    }
+    fprintf(out, "posting lists: %llu postings, docs per term (with share of postings):\n",
+            (unsigned long long)postings);
+    printCountBuckets(out, "terms", lists, listPostings, postings);
+    uint64_t postingBytes = bytes.skips + bytes.docIds + bytes.freqs + bytes.impacts + bytes.positions
+                            + bytes.offsets;
+    fprintf(out, "postings bytes: %llu (%.2f per posting)\n", (unsigned long long)postingBytes,
+            postings ? (double)postingBytes / postings : 0.0);
+    printShare(out, "skips", bytes.skips, postingBytes);
+    printShare(out, "docIds", bytes.docIds, postingBytes);
+    printShare(out, "freqs", bytes.freqs, postingBytes);
+    printShare(out, "impacts", bytes.impacts, postingBytes);
+    printShare(out, "positions", bytes.positions, postingBytes);
+    printShare(out, "offsets", bytes.offsets, postingBytes);
+    int built;
+    size_t setBytes = termSetBytes(idx, &built);
+    fprintf(out, "dense terms: %u, docId sets built for %d (%zu bytes)\n", dense, built, setBytes);
+
+    /* document lengths (totalTerms) */
+    if (h->docCount == 0) return;
+    uint32_t *lens = malloc(sizeof(uint32_t) * h->docCount);
+    if (!lens) { perror("malloc"); return; }
+    uint64_t docLens[HIST_BUCKETS] = { 0 }, tokens = 0;
+    for (uint32_t d = 0; d < h->docCount; d++) {
+        lens[d] = idx->docs[d].totalTerms;
+        docLens[log2Bucket(lens[d])]++;
+        tokens += lens[d];
+    }
+    qsort(lens, h->docCount, sizeof(uint32_t), cmpU32);
+    fprintf(out, "doc lengths (tokens): min %u mean %.1f p50 %u p90 %u p99 %u max %u\n",
+            lens[0], (double)tokens / h->docCount, lens[h->docCount / 2],
+            lens[(uint64_t)h->docCount * 9 / 10], lens[(uint64_t)h->docCount * 99 / 100],
+            lens[h->docCount - 1]);
+    printCountBuckets(out, "docs", docLens, NULL, 0);
+    free(lens);
+}
@@ -0,0 +1,65 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "store.h"
+
+/* ---------------- Instrumentation ----------------
+   Query tracing splits each query into stages, timed with the monotonic
+   clock, and counts the postings it decoded. It is compiled in but off
+   until setQueryTracing(1): with tracing off a span is one branch. Traced
+   queries also feed process-wide log2 histograms, one per stage, that can
+   be printed at any time.
+
+   printIndexStats() reports on one index image: term table probe lengths,
+   posting-list lengths, where the postings bytes go (skips, docIds,
+   frequencies, impacts, positions, offsets), and document lengths. */
+
+typedef enum QueryStage {
+    STAGE_PARSE,            /* compile the plan in every segment, cache key */
+    STAGE_CACHE,            /* result cache lookup */
+    STAGE_MATCH,            /* boolean plan: posting decode and set operations */
+    STAGE_SCORE,            /* idf, TF-IDF over the matches, or WAND */
+    STAGE_SORT,             /* order the top K, resolve names */
+    STAGE_COUNT
+} QueryStage;
+
+typedef struct QueryTrace {
+    uint64_t ns[STAGE_COUNT];
+    uint64_t totalNs;
+    uint64_t postingsMatched;   /* decoded by the boolean plan */
+    uint64_t postingsScored;    /* decoded while scoring (TF-IDF or WAND) */
+    uint64_t docsMatched;       /* live docs the plan produced */
+    int cached;                 /* served from the result cache */
+} QueryTrace;
+
+extern int queryTracing;
+
+void setQueryTracing(int on);
+
+static inline uint64_t traceClock(void) {
+    if (!queryTracing) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* charge the time since *mark to stage, and move the mark to now */
+static inline void traceSpan(QueryTrace *t, QueryStage stage, uint64_t *mark) {
+    if (!queryTracing) return;
+    uint64_t now = traceClock();
+    t->ns[stage] += now - *mark;
+    *mark = now;
+}
+
+/* add a finished query to the histograms; safe from several threads */
+void recordQueryTrace(const QueryTrace *t);
+/* one line: time per stage and postings touched */
+void printQueryTrace(const QueryTrace *t, FILE *out);
+void printTraceHistograms(FILE *out);
+
+void printIndexStats(const Index *idx, FILE *out);
+
+#endif
@@ -0,0 +1,193 @@
+#include "stopwords.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define STOP_MAX_LEN 255
+#define STOP_MAX_TRIES 64
+
+typedef struct StopWord {
+    const char *word;
+    size_t len;
+    uint64_t hash;
+} StopWord;
+
+/* Split and normalize list into out (lowercase letters/digits, one word
+   per line, duplicates dropped). Returns the word count. */
+static size_t normalizeList(const char *list, size_t len, char *out, size_t *outLen) {
+    /* open-addressed set of words seen so far: (offset + 1, length) */
+    size_t seenCap = 16;
+    while (seenCap < len + 1) seenCap <<= 1;
+    uint32_t (*seen)[2] = calloc(seenCap, sizeof(*seen));
+    if (!seen) { perror("calloc"); exit(1); }
+
+    size_t n = 0, o = 0, i = 0;
+    while (i < len) {
+        if (list[i] == '#') {
+            while (i < len && list[i] != '\n') i++;
+            continue;
+        }
+        if (list[i] == ' ' || (list[i] >= '\t' && list[i] <= '\r')) { i++; continue; }
+        size_t start = o;
+        while (i < len && list[i] != '#' && list[i] != ' ' && !(list[i] >= '\t' && list[i] <= '\r')) {
+            unsigned char c = (unsigned char)list[i++];
+            if (c >= 'A' && c <= 'Z') out[o++] = (char)(c | 0x20);
+            else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) out[o++] = (char)c;
+        }
+        size_t wl = o - start;
+        if (wl == 0 || wl > STOP_MAX_LEN) { o = start; continue; }
+        size_t k = (size_t)stopHash(out + start, wl, 0) & (seenCap - 1);
+        int dup = 0;
+        while (seen[k][0]) {
+            if (seen[k][1] == wl && memcmp(out + seen[k][0] - 1, out + start, wl) == 0) { dup = 1; break; }
+            k = (k + 1) & (seenCap - 1);
+        }
+        if (dup) { o = start; continue; }
+        seen[k][0] = (uint32_t)start + 1;
+        seen[k][1] = (uint32_t)wl;
+        out[o++] = '\n';
+        n++;
+    }
+    free(seen);
+    if (o) o--;             /* no trailing newline */
+    *outLen = o;
+    return n;
+}
+
+static int cmpBucketSize(const void *a, const void *b, void *arg) {
+    const uint32_t *size = arg;
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    if (size[x] != size[y]) return size[x] < size[y] ? 1 : -1;
+    return x < y ? -1 : x > y;
+}
+
+/* Try to place every word under one seed. Buckets are filled largest
+   first, each searching for a displacement that lands all of its words on
+   free slots. */
+static int placeWords(StopWord *w, size_t n, uint64_t seed, uint32_t bits, uint32_t bucketMask,
+                      uint32_t *disp, const char **slots, unsigned char *lens) {
+    uint32_t nb = bucketMask + 1, nslots = 1u << bits;
+    uint32_t *size = calloc(nb, sizeof(uint32_t));
+    uint32_t *order = malloc(sizeof(uint32_t) * nb);
+    uint32_t *members = malloc(sizeof(uint32_t) * (n ? n : 1));
+    uint32_t *start = calloc(nb + 1, sizeof(uint32_t));
+    uint32_t *tmpSlot = malloc(sizeof(uint32_t) * (n ? n : 1));
+    if (!size || !order || !members || !start || !tmpSlot) { perror("malloc"); exit(1); }
+
+    for (size_t i = 0; i < n; i++) {
+        w[i].hash = stopHash(w[i].word, w[i].len, seed);
+        size[(uint32_t)w[i].hash & bucketMask]++;
+    }
+    for (uint32_t b = 0; b < nb; b++) { start[b + 1] = start[b] + size[b]; order[b] = b; }
+    {
+        uint32_t *fill = calloc(nb, sizeof(uint32_t));
+        if (!fill) { perror("calloc"); exit(1); }
+        for (size_t i = 0; i < n; i++) {
+            uint32_t b = (uint32_t)w[i].hash & bucketMask;
+            members[start[b] + fill[b]++] = (uint32_t)i;
+        }
+        free(fill);
+    }
+    qsort_r(order, nb, sizeof(uint32_t), cmpBucketSize, size);
+
+    memset(slots, 0, sizeof(char *) * nslots);
+    memset(lens, 0, nslots);
+    memset(disp, 0, sizeof(uint32_t) * nb);
+    int ok = 1;
+    for (uint32_t k = 0; ok && k < nb && size[order[k]]; k++) {
+        uint32_t b = order[k];
+        uint32_t d;
+        for (d = 0; d < nslots * 64u; d++) {
+            uint32_t m;
+            for (m = 0; m < size[b]; m++) {
+                StopWord *sw = &w[members[start[b] + m]];
+                uint32_t slot = stopMix((uint32_t)(sw->hash >> 32) ^ d) >> (32 - bits);
+                if (slots[slot]) break;
+                uint32_t p;
+                for (p = 0; p < m && tmpSlot[p] != slot; p++) ;
+                if (p < m) break;
+                tmpSlot[m] = slot;
+            }
+            if (m == size[b]) break;
+        }
+        if (d == nslots * 64u) { ok = 0; break; }
+        disp[b] = d;
+        for (uint32_t m = 0; m < size[b]; m++) {
+            StopWord *sw = &w[members[start[b] + m]];
+            slots[tmpSlot[m]] = sw->word;
+            lens[tmpSlot[m]] = (unsigned char)sw->len;
+        }
+    }
+    free(size); free(order); free(members); free(start); free(tmpSlot);
+    return ok ? 0 : -1;
+}
+
+int buildStopSet(StopSet *s, const char *list, size_t len) {
+    memset(s, 0, sizeof(*s));
+    char *text = malloc(len + 1);
+    if (!text) { perror("malloc"); exit(1); }
+    size_t textLen;
+    size_t n = normalizeList(list, len, text, &textLen);
+    text[textLen] = '\0';
+
+    /* ~80% load in a power-of-two table, about four words per bucket */
+    uint32_t bits = 1;
+    while ((1u << bits) < n + n / 4) bits++;
+    uint32_t nb = 1;
+    while (nb * 4 < n) nb <<= 1;
+
+    StopWord *w = malloc(sizeof(StopWord) * (n ? n : 1));
+    if (!w) { perror("malloc"); exit(1); }
+    s->minLen = 1;
+    s->maxLen = 0;
+    for (size_t i = 0, p = 0; i < n; i++) {
+        size_t q = p;
+        while (q < textLen && text[q] != '\n') q++;
+        w[i].word = text + p;
+        w[i].len = q - p;
+        if (i == 0 || w[i].len < s->minLen) s->minLen = (uint32_t)w[i].len;
+        if (w[i].len > s->maxLen) s->maxLen = (uint32_t)w[i].len;
+        p = q + 1;
+    }
+
+    /* slots point into text, which the set keeps; text words are
+       '\n'-terminated, which is fine since compares use lens[] */
+    size_t nslots = (size_t)1 << bits;
+    size_t memSize = sizeof(char *) * nslots + sizeof(uint32_t) * nb + nslots;
+    unsigned char *mem = malloc(memSize);
+    if (!mem) { perror("malloc"); exit(1); }
+    const char **slots = (const char **)mem;
+    uint32_t *disp = (uint32_t *)(mem + sizeof(char *) * nslots);
+    unsigned char *lens = mem + sizeof(char *) * nslots + sizeof(uint32_t) * nb;
+
+    uint64_t seed = 0x9e3779b97f4a7c15ULL;
+    int tries;
+    for (tries = 0; tries < STOP_MAX_TRIES; tries++) {
+        if (placeWords(w, n, seed, bits, nb - 1, disp, slots, lens) == 0) break;
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    free(w);
+    if (tries == STOP_MAX_TRIES) {
+        free(mem);
+        free(text);
+        return -1;
+    }
+
+    s->seed = seed;
+    s->shift = 32 - bits;
+    s->bucketMask = nb - 1;
+    s->count = (uint32_t)n;
+    s->slots = slots;
+    s->lens = lens;
+    s->disp = disp;
+    s->text = text;
+    s->textLen = textLen;
+    s->mem = mem;
+    return 0;
+}
+
+void freeStopSet(StopSet *s) {
+    if (!s->mem) return;
+    free(s->mem);
+    free((void *)s->text);
+    memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,57 @@
+#ifndef STOPWORDS_H
+#define STOPWORDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* ---------------- Stop-word sets ----------------
+   A stop-word set is a minimal-probe perfect hash (hash and displace):
+   one pass over the word picks a bucket, the bucket's displacement picks
+   the slot, and the slot is compared once. No word ever probes twice.
+
+   The default set is generated at build time from stopwords.txt by
+   tools/gen_stopwords; custom lists are built at runtime with the same
+   code (buildStopSet), so both answer through stopSetHas(). */
+
+typedef struct StopSet {
+    uint64_t seed;
+    uint32_t shift;                 /* slot = mix(...) >> shift */
+    uint32_t bucketMask;
+    uint32_t minLen, maxLen;        /* quick reject; minLen > maxLen when empty */
+    uint32_t count;
+    const char *const *slots;       /* NULL = empty slot */
+    const unsigned char *lens;
+    const uint32_t *disp;           /* per-bucket displacement */
+    const char *text;               /* the words, '\n'-separated, in list order */
+    size_t textLen;
+    void *mem;                      /* owned storage for runtime-built sets */
+} StopSet;
+
+static inline uint64_t stopHash(const char *w, size_t len, uint64_t seed) {
+    uint64_t h = seed ^ 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) h = (h ^ (unsigned char)w[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+static inline uint32_t stopMix(uint32_t x) {
+    x ^= x >> 16; x *= 0x85ebca6bu;
+    x ^= x >> 13; x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x;
+}
+
+static inline int stopSetHas(const StopSet *s, const char *w, size_t len) {
+    if (len < s->minLen || len > s->maxLen) return 0;
+    uint64_t h = stopHash(w, len, s->seed);
+    uint32_t i = stopMix((uint32_t)(h >> 32) ^ s->disp[(uint32_t)h & s->bucketMask]) >> s->shift;
+    return s->lens[i] == len && memcmp(s->slots[i], w, len) == 0;
+}
+
+/* Build a set from a word list: words are separated by whitespace, '#'
+   starts a comment, and each word is normalized the way the tokenizer
+   normalizes text. Returns 0, or -1 if no perfect layout was found. */
+int buildStopSet(StopSet *s, const char *list, size_t len);
+void freeStopSet(StopSet *s);
+
+#endif
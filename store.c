@@ -0,0 +1,970 @@
+#include "store.h"
+#include "docset.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+/* djb2 over the full word; the on-disk bucket array is masked, not mod HASH_SIZE */
+static uint64_t termHash(const char *str) {
+    uint64_t hash = 5381;
+    int c;
+    while ((c = (unsigned char)*str++))
+        hash = ((hash << 5) + hash) + c;
+    return hash;
+}
+
+typedef struct SortedTerm {
+    const char *word;
+    const WordEntry *entry;
+} SortedTerm;
+
+static int cmpSortedTerm(const void *a, const void *b) {
+    return strcmp(((const SortedTerm *)a)->word, ((const SortedTerm *)b)->word);
+}
+
+static atomic_uint_fast64_t nextGeneration = 1;
+
+/* Process-unique tag for anything that results can be cached against. */
+uint64_t newIndexGeneration(void) {
+    return atomic_fetch_add(&nextGeneration, 1);
+}
+
+/* Bind the section pointers of an image (heap or mapped). Returns 0 if valid. */
+static int bindImage(Index *idx) {
+    if (idx->size < sizeof(IndexHeader)) return -1;
+    const IndexHeader *h = (const IndexHeader *)idx->base;
+    if (memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) != 0) return -1;
+    if (h->version != INDEX_VERSION) return -1;
+    if (h->fileSize != idx->size) return -1;
+    if (h->stringsOff > idx->size || h->offsetsOff > h->stringsOff || h->positionsOff > h->offsetsOff
+        || h->postingsOff > h->positionsOff
+        || h->dictOff > h->postingsOff) return -1;
+    if (h->docsOff < sizeof(IndexHeader) || h->termsOff < h->docsOff || h->bucketsOff < h->termsOff
+        || h->dictOff < h->bucketsOff) return -1;
+    if (h->docsOff + sizeof(DocRecord) * (uint64_t)h->docCount > h->termsOff
+        || h->termsOff + sizeof(TermRecord) * (uint64_t)h->termCount > h->bucketsOff
+        || h->bucketsOff + sizeof(uint32_t) * (uint64_t)h->bucketCount > h->dictOff) return -1;
+    if (h->bucketCount == 0 || (h->bucketCount & (h->bucketCount - 1)) != 0) return -1;
+    if (h->dictOff + sizeof(uint32_t) * (((uint64_t)h->termCount + DICT_BLOCK - 1) / DICT_BLOCK) > h->postingsOff) return -1;
+    if ((uint64_t)h->stopwordsOff + h->stopwordsLen > idx->size - h->stringsOff) return -1;
+    if (h->scoring > SCORE_BM25 || (h->impactBits != 8 && h->impactBits != 16)) return -1;
+    idx->hdr = h;
+    idx->docs = (const DocRecord *)(idx->base + h->docsOff);
+    idx->terms = (const TermRecord *)(idx->base + h->termsOff);
+    idx->buckets = (const uint32_t *)(idx->base + h->bucketsOff);
+    idx->dictBlocks = (const uint32_t *)(idx->base + h->dictOff);
+    idx->dict = (const unsigned char *)(idx->dictBlocks + (h->termCount + DICT_BLOCK - 1) / DICT_BLOCK);
+    idx->postings = idx->base + h->postingsOff;
+    idx->positions = idx->base + h->positionsOff;
+    idx->offsets = idx->base + h->offsetsOff;
+    idx->strings = (const char *)(idx->base + h->stringsOff);
+    idx->termSets = newTermSets(h->termCount);
+    idx->generation = newIndexGeneration();
+    return 0;
+}
+
+/* growable byte buffer used while encoding postings */
+typedef struct ByteBuf {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+} ByteBuf;
+
+static void reserveBytes(ByteBuf *b, size_t extra) {
+    if (b->len + extra <= b->cap) return;
+    size_t nc = b->cap ? b->cap * 2 : 4096;
+    while (nc < b->len + extra) nc *= 2;
+    b->data = realloc(b->data, nc);
+    if (!b->data) { perror("realloc"); exit(1); }
+    b->cap = nc;
+}
+
+static void putVarint(ByteBuf *b, uint32_t v) {
+    reserveBytes(b, 5);
+    while (v >= 0x80) {
+        b->data[b->len++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    b->data[b->len++] = (unsigned char)v;
+}
+
+static inline uint32_t getVarint(const unsigned char **pp) {
+    const unsigned char *p = *pp;
+    uint32_t v = *p & 0x7f;
+    int shift = 7;
+    while (*p++ & 0x80) {
+        v |= (uint32_t)(*p & 0x7f) << shift;
+        shift += 7;
+    }
+    *pp = p;
+    return v;
+}
+
+static inline void skipVarint(const unsigned char **pp) {
+    while (*(*pp)++ & 0x80) {}
+}
+
+static ScoringModel buildScoring = SCORE_TFIDF;
+static int buildImpactBits = 8;
+static double buildAvgDocTerms;         /* 0: the average of the documents being built */
+
+int setIndexScoring(ScoringModel model, int impactBits) {
+    if (impactBits != 8 && impactBits != 16) return -1;
+    buildScoring = model;
+    buildImpactBits = impactBits;
+    return 0;
+}
+
+ScoringModel indexBuildScoring(void) {
+    return buildScoring;
+}
+
+void setIndexAvgDocTerms(double avg) {
+    buildAvgDocTerms = avg;
+}
+
+double indexBuildAvgDocTerms(void) {
+    return buildAvgDocTerms;
+}
+
+/* The BM25 normalization of an image built now from documents[]. */
+static double imageAvgDocTerms(void) {
+    if (buildAvgDocTerms > 0) return buildAvgDocTerms;
+    uint64_t tokens = 0;
+    for (int d = 0; d < docCount; d++) tokens += (uint64_t)documents[d].totalTerms;
+    return docCount ? (double)tokens / docCount : 0.0;
+}
+
+/* Where encoded bytes go: a buffer for an image built in memory, or a file
+   for a streamed one. total counts the bytes written so far. */
+typedef struct ByteOut {
+    ByteBuf *buf;
+    FILE *file;             /* write errors are picked up with ferror() */
+    uint64_t total;
+} ByteOut;
+
+static void putBytes(ByteOut *o, const void *data, size_t len) {
+    if (o->file) {
+        fwrite(data, 1, len, o->file);
+    } else {
+        reserveBytes(o->buf, len);
+        memcpy(o->buf->data + o->buf->len, data, len);
+        o->buf->len += len;
+    }
+    o->total += len;
+}
+
+static void padTo(ByteOut *o, uint64_t total) {
+    static const unsigned char zeros[64];
+    while (o->total < total)
+        putBytes(o, zeros, total - o->total < sizeof(zeros) ? (size_t)(total - o->total) : sizeof(zeros));
+}
+
+/* Encodes one term's postings, fed in docId order. A block goes out as
+   soon as it fills and the skip table follows the last one, so a term is
+   never held whole; positions and offsets go to outputs of their own. */
+typedef struct PostingWriter {
+    ByteOut *out;
+    ByteOut *pos;
+    ByteOut *offs;
+    double avgDocTerms;
+    TermRecord *rec;        /* term being written */
+    SkipEntry *skips;
+    uint32_t skipCap;
+    uint32_t blocks;        /* blocks written so far */
+    uint32_t prev;          /* last docId written */
+    uint32_t blockPos;      /* posOffset of the block being filled */
+    uint32_t blockOff;      /* and its offOffset */
+    int n;                  /* postings in it */
+    uint32_t docIds[POSTING_BLOCK];
+    int freqs[POSTING_BLOCK];
+    uint16_t impacts[POSTING_BLOCK];
+    ByteBuf scratch;
+} PostingWriter;
+
+/* maxImpact: the largest impact over the term's postings, which the
+   others are quantized against */
+static void beginPostings(PostingWriter *w, TermRecord *rec, uint32_t docFrequency, double maxImpact) {
+    w->rec = rec;
+    rec->docFrequency = docFrequency;
+    rec->blockCount = (docFrequency + POSTING_BLOCK - 1) / POSTING_BLOCK;
+    /* round up so the stored bound never undercuts a real score */
+    rec->maxImpact = nextafterf((float)maxImpact, INFINITY);
+    rec->postingsOff = w->out->total;
+    rec->positionsOff = w->pos->total;
+    rec->offsetsOff = w->offs->total;
+    if (rec->blockCount > w->skipCap) {
+        w->skipCap = rec->blockCount;
+        w->skips = realloc(w->skips, sizeof(SkipEntry) * w->skipCap);
+        if (!w->skips) { perror("realloc"); exit(1); }
+    }
+    w->blocks = 0;
+    w->prev = 0;
+    w->n = 0;
+}
+
+static void flushBlock(PostingWriter *w) {
+    ByteBuf *b = &w->scratch;
+    SkipEntry *se = &w->skips[w->blocks++];
+    se->lastDocId = w->docIds[w->n - 1];
+    se->offset = (uint32_t)(w->out->total - w->rec->postingsOff);
+    se->posOffset = w->blockPos;
+    se->offOffset = w->blockOff;
+    b->len = 0;
+    for (int i = 0; i < w->n; i++) {
+        putVarint(b, w->docIds[i] - w->prev);
+        w->prev = w->docIds[i];
+    }
+    for (int i = 0; i < w->n; i++) putVarint(b, (uint32_t)w->freqs[i]);
+    reserveBytes(b, (size_t)w->n * 2);
+    for (int i = 0; i < w->n; i++) {
+        b->data[b->len++] = (unsigned char)w->impacts[i];
+        if (buildImpactBits == 16) b->data[b->len++] = (unsigned char)(w->impacts[i] >> 8);
+    }
+    putBytes(w->out, b->data, b->len);
+    w->n = 0;
+}
+
+static void putDeltas(PostingWriter *w, ByteOut *o, const uint32_t *v, int n) {
+    ByteBuf *b = &w->scratch;
+    uint32_t last = 0;
+    b->len = 0;
+    for (int k = 0; k < n; k++) {
+        putVarint(b, v[k] - last);
+        last = v[k];
+    }
+    putBytes(o, b->data, b->len);
+}
+
+static void addPosting(PostingWriter *w, int docId, int frequency, const int *positions,
+                       const uint32_t *offsets, int posCount) {
+    if (w->n == 0) {
+        w->blockPos = (uint32_t)(w->pos->total - w->rec->positionsOff);
+        w->blockOff = (uint32_t)(w->offs->total - w->rec->offsetsOff);
+    }
+    int qMax = (1 << buildImpactBits) - 1;
+    double impact = scoringImpact(buildScoring, w->avgDocTerms, frequency, documents[docId].totalTerms);
+    long q = lround(impact / w->rec->maxImpact * qMax);
+    w->docIds[w->n] = (uint32_t)docId;
+    w->freqs[w->n] = frequency;
+    w->impacts[w->n] = (uint16_t)(q < 1 ? 1 : q > qMax ? qMax : q);
+    if (posCount) {
+        putDeltas(w, w->pos, (const uint32_t *)positions, posCount);
+        putDeltas(w, w->offs, offsets, posCount);
+    }
+    if (++w->n == POSTING_BLOCK) flushBlock(w);
+}
+
+static void endPostings(PostingWriter *w) {
+    if (w->n) flushBlock(w);
+    padTo(w->out, (w->out->total + 3) & ~(uint64_t)3);
+    putBytes(w->out, w->skips, sizeof(SkipEntry) * w->blocks);
+    w->rec->postingsLen = w->out->total - w->rec->postingsOff;
+}
+
+static void freePostingWriter(PostingWriter *w) {
+    free(w->skips);
+    free(w->scratch.data);
+}
+
+/* Add term t (sorted order; prev is term t - 1) to the front-coded
+   dictionary, noting its block's offset if it opens one. */
+static void putDictTerm(ByteBuf *blocks, ByteBuf *entries, size_t t, const char *prev, const char *w, size_t len) {
+    size_t shared = 0;
+    if (t % DICT_BLOCK == 0) {
+        uint32_t off = (uint32_t)entries->len;
+        reserveBytes(blocks, sizeof(off));
+        memcpy(blocks->data + blocks->len, &off, sizeof(off));
+        blocks->len += sizeof(off);
+    } else {
+        while (shared < len && prev[shared] == w[shared]) shared++;
+        putVarint(entries, (uint32_t)shared);
+    }
+    putVarint(entries, (uint32_t)(len - shared));
+    reserveBytes(entries, len - shared);
+    memcpy(entries->data + entries->len, w + shared, len - shared);
+    entries->len += len - shared;
+}
+
+static uint64_t docNamesBytes(void) {
+    uint64_t bytes = 0;
+    for (int d = 0; d < docCount; d++) bytes += strlen(documents[d].filename) + 1;
+    return bytes;
+}
+
+/* Header for an image of documents[] and termCount terms with sections of
+   the given sizes, laid out in order and 8-byte aligned. */
+static void layoutImage(IndexHeader *h, size_t termCount, double avgDocTerms, uint64_t dictLen,
+                        uint64_t postingsLen, uint64_t positionsLen, uint64_t offsetsLen, size_t stopLen) {
+    uint32_t bucketCount = 16;
+    while (bucketCount < termCount * 2) bucketCount <<= 1;
+    uint64_t namesLen = docNamesBytes();
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, INDEX_MAGIC, sizeof(h->magic));
+    h->version = INDEX_VERSION;
+    h->docCount = (uint32_t)docCount;
+    h->termCount = (uint32_t)termCount;
+    h->bucketCount = bucketCount;
+    h->stopwordsOff = (uint32_t)namesLen;
+    h->stopwordsLen = (uint32_t)stopLen;
+    h->scoring = (uint32_t)buildScoring;
+    h->impactBits = (uint32_t)buildImpactBits;
+    h->hasPositions = (uint32_t)keepPositions();
+    h->avgDocTerms = avgDocTerms;
+    h->docsOff = ALIGN8(sizeof(IndexHeader));
+    h->termsOff = ALIGN8(h->docsOff + sizeof(DocRecord) * (uint64_t)docCount);
+    h->bucketsOff = ALIGN8(h->termsOff + sizeof(TermRecord) * (uint64_t)termCount);
+    h->dictOff = ALIGN8(h->bucketsOff + sizeof(uint32_t) * (uint64_t)bucketCount);
+    h->postingsOff = ALIGN8(h->dictOff + dictLen);
+    h->positionsOff = ALIGN8(h->postingsOff + postingsLen);
+    h->offsetsOff = ALIGN8(h->positionsOff + positionsLen);
+    h->stringsOff = ALIGN8(h->offsetsOff + offsetsLen);
+    h->fileSize = ALIGN8(h->stringsOff + namesLen + stopLen + 1);
+}
+
+static void fillBuckets(uint32_t *buckets, uint32_t bucketCount, const TermRecord *recs, size_t termCount) {
+    for (size_t t = 0; t < termCount; t++) {
+        uint32_t b = recs[t].hash & (bucketCount - 1);
+        while (buckets[b]) b = (b + 1) & (bucketCount - 1);
+        buckets[b] = (uint32_t)t + 1;
+    }
+}
+
+/* Flatten the in-memory term table and documents[] into an index image. */
+Index *buildIndexImage(TermTable *table) {
+    /* gather terms in lexicographic order so the image does not depend on hash layout */
+    size_t termCount = table->termCount;
+    SortedTerm *terms = malloc(sizeof(SortedTerm) * (termCount ? termCount : 1));
+    if (!terms) { perror("malloc"); exit(1); }
+    for (size_t t = 0; t < termCount; t++) {
+        terms[t].entry = &table->entries[t];
+        terms[t].word = entryWord(table, &table->entries[t]);
+    }
+    qsort(terms, termCount, sizeof(SortedTerm), cmpSortedTerm);
+
+    TermRecord *recTmp = calloc(termCount ? termCount : 1, sizeof(TermRecord));
+    if (!recTmp) { perror("calloc"); exit(1); }
+    double avgDocTerms = imageAvgDocTerms();
+    ByteBuf postings = {0}, positions = {0}, offsets = {0}, dictBlocks = {0}, dict = {0};
+    ByteOut postingsOut = { &postings, NULL, 0 }, positionsOut = { &positions, NULL, 0 };
+    ByteOut offsetsOut = { &offsets, NULL, 0 };
+    PostingWriter pw = { .out = &postingsOut, .pos = &positionsOut, .offs = &offsetsOut,
+                         .avgDocTerms = avgDocTerms };
+    for (size_t t = 0; t < termCount; t++) {
+        const WordEntry *e = terms[t].entry;
+        double maxImpact = 0.0;
+        for (const DocNode *d = e->docList; d; d = d->next) {
+            double v = scoringImpact(buildScoring, avgDocTerms, d->frequency, documents[d->docId].totalTerms);
+            if (v > maxImpact) maxImpact = v;
+        }
+        beginPostings(&pw, &recTmp[t], (uint32_t)e->docFrequency, maxImpact);
+        for (const DocNode *d = e->docList; d; d = d->next)
+            addPosting(&pw, d->docId, d->frequency, d->positions, docNodeOffsets(d), d->posCount);
+        endPostings(&pw);
+        recTmp[t].hash = (uint32_t)termHash(terms[t].word);
+        putDictTerm(&dictBlocks, &dict, t, t ? terms[t - 1].word : NULL, terms[t].word, e->wordLen);
+    }
+    freePostingWriter(&pw);
+    free(terms);
+    size_t stopLen;
+    const char *stopText = stopWordsText(&stopLen);
+
+    IndexHeader h;
+    layoutImage(&h, termCount, avgDocTerms, dictBlocks.len + dict.len, postings.len, positions.len,
+                offsets.len, stopLen);
+    unsigned char *buf = calloc(1, h.fileSize);
+    if (!buf) { perror("calloc"); exit(1); }
+    memcpy(buf, &h, sizeof(h));
+
+    DocRecord *docs = (DocRecord *)(buf + h.docsOff);
+    char *strings = (char *)(buf + h.stringsOff);
+    uint64_t so = 0;
+    for (int d = 0; d < docCount; d++) {
+        size_t len = strlen(documents[d].filename) + 1;
+        docs[d].nameOff = (uint32_t)so;
+        docs[d].totalTerms = (uint32_t)documents[d].totalTerms;
+        memcpy(strings + so, documents[d].filename, len);
+        so += len;
+    }
+    memcpy(strings + so, stopText, stopLen);
+
+    if (termCount) memcpy(buf + h.termsOff, recTmp, sizeof(TermRecord) * termCount);
+    fillBuckets((uint32_t *)(buf + h.bucketsOff), h.bucketCount, recTmp, termCount);
+    free(recTmp);
+    if (dictBlocks.len) memcpy(buf + h.dictOff, dictBlocks.data, dictBlocks.len);
+    if (dict.len) memcpy(buf + h.dictOff + dictBlocks.len, dict.data, dict.len);
+    if (postings.len) memcpy(buf + h.postingsOff, postings.data, postings.len);
+    if (positions.len) memcpy(buf + h.positionsOff, positions.data, positions.len);
+    if (offsets.len) memcpy(buf + h.offsetsOff, offsets.data, offsets.len);
+    free(dictBlocks.data);
+    free(dict.data);
+    free(postings.data);
+    free(positions.data);
+    free(offsets.data);
+
+    Index *idx = calloc(1, sizeof(Index));
+    if (!idx) { perror("calloc"); exit(1); }
+    idx->base = buf;
+    idx->size = h.fileSize;
+    idx->mapped = 0;
+    bindImage(idx);
+    return idx;
+}
+
+/* ---------------- Streamed build ---------------- */
+
+struct IndexWriter {
+    char path[1024];
+    char postingsPath[1100];
+    char positionsPath[1100];
+    char offsetsPath[1100];
+    ByteOut postings;       /* to temporary files, copied into the image at the end */
+    ByteOut positions;
+    ByteOut offsets;
+    PostingWriter pw;
+    double avgDocTerms;
+    TermRecord *recs;
+    size_t termCount;
+    size_t recCap;
+    ByteBuf dictBlocks;
+    ByteBuf dict;
+    char *prev;             /* last term written */
+    size_t prevCap;
+};
+
+IndexWriter *openIndexWriter(const char *path) {
+    IndexWriter *w = calloc(1, sizeof(IndexWriter));
+    if (!w) { perror("calloc"); exit(1); }
+    snprintf(w->path, sizeof(w->path), "%s", path);
+    snprintf(w->postingsPath, sizeof(w->postingsPath), "%s.postings.tmp", path);
+    snprintf(w->positionsPath, sizeof(w->positionsPath), "%s.positions.tmp", path);
+    snprintf(w->offsetsPath, sizeof(w->offsetsPath), "%s.offsets.tmp", path);
+    const char *failed = NULL;
+    if (!(w->postings.file = fopen(w->postingsPath, "w+b"))) failed = w->postingsPath;
+    else if (!(w->positions.file = fopen(w->positionsPath, "w+b"))) failed = w->positionsPath;
+    else if (!(w->offsets.file = fopen(w->offsetsPath, "w+b"))) failed = w->offsetsPath;
+    if (failed) {
+        perror(failed);
+        if (w->positions.file) { fclose(w->positions.file); remove(w->positionsPath); }
+        if (w->postings.file) { fclose(w->postings.file); remove(w->postingsPath); }
+        free(w);
+        return NULL;
+    }
+    w->avgDocTerms = imageAvgDocTerms();
+    w->pw.out = &w->postings;
+    w->pw.pos = &w->positions;
+    w->pw.offs = &w->offsets;
+    w->pw.avgDocTerms = w->avgDocTerms;
+    return w;
+}
+
+void writeTerm(IndexWriter *w, const char *word, uint32_t docFrequency, double maxImpact) {
+    if (w->termCount) endPostings(&w->pw);
+    if (w->termCount == w->recCap) {
+        w->recCap = w->recCap ? w->recCap * 2 : 1024;
+        w->recs = realloc(w->recs, sizeof(TermRecord) * w->recCap);
+        if (!w->recs) { perror("realloc"); exit(1); }
+    }
+    TermRecord *rec = &w->recs[w->termCount];
+    size_t len = strlen(word);
+    memset(rec, 0, sizeof(*rec));
+    rec->hash = (uint32_t)termHash(word);
+    putDictTerm(&w->dictBlocks, &w->dict, w->termCount, w->prev, word, len);
+    if (len + 1 > w->prevCap) {
+        w->prevCap = len + 1 > 64 ? len + 1 : 64;
+        w->prev = realloc(w->prev, w->prevCap);
+        if (!w->prev) { perror("realloc"); exit(1); }
+    }
+    memcpy(w->prev, word, len + 1);
+    beginPostings(&w->pw, rec, docFrequency, maxImpact);
+    w->termCount++;
+}
+
+void writePosting(IndexWriter *w, int docId, int frequency, const int *positions,
+                  const uint32_t *offsets, int posCount) {
+    addPosting(&w->pw, docId, frequency, positions, offsets, posCount);
+}
+
+/* Append the whole of a temporary file to o. */
+static int copyFile(ByteOut *o, FILE *src, const char *name) {
+    static unsigned char buf[1 << 20];
+    size_t r;
+    if (fflush(src) != 0 || fseek(src, 0, SEEK_SET) != 0) { perror(name); return -1; }
+    while ((r = fread(buf, 1, sizeof(buf), src)) > 0) putBytes(o, buf, r);
+    if (ferror(src)) { perror(name); return -1; }
+    return 0;
+}
+
+void discardIndexWriter(IndexWriter *w) {
+    fclose(w->postings.file);
+    fclose(w->positions.file);
+    fclose(w->offsets.file);
+    remove(w->postingsPath);
+    remove(w->positionsPath);
+    remove(w->offsetsPath);
+    freePostingWriter(&w->pw);
+    free(w->recs);
+    free(w->dictBlocks.data);
+    free(w->dict.data);
+    free(w->prev);
+    free(w);
+}
+
+int closeIndexWriter(IndexWriter *w, size_t *size) {
+    if (w->termCount) endPostings(&w->pw);
+    size_t stopLen;
+    const char *stopText = stopWordsText(&stopLen);
+    IndexHeader h;
+    layoutImage(&h, w->termCount, w->avgDocTerms, w->dictBlocks.len + w->dict.len,
+                w->postings.total, w->positions.total, w->offsets.total, stopLen);
+
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", w->path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) { perror(tmp); discardIndexWriter(w); return -1; }
+    ByteOut o = { NULL, f, 0 };
+    putBytes(&o, &h, sizeof(h));
+    padTo(&o, h.docsOff);
+    uint32_t nameOff = 0;
+    for (int d = 0; d < docCount; d++) {
+        DocRecord r = { nameOff, (uint32_t)documents[d].totalTerms };
+        putBytes(&o, &r, sizeof(r));
+        nameOff += (uint32_t)strlen(documents[d].filename) + 1;
+    }
+    padTo(&o, h.termsOff);
+    putBytes(&o, w->recs, sizeof(TermRecord) * w->termCount);
+    padTo(&o, h.bucketsOff);
+    uint32_t *buckets = calloc(h.bucketCount, sizeof(uint32_t));
+    if (!buckets) { perror("calloc"); exit(1); }
+    fillBuckets(buckets, h.bucketCount, w->recs, w->termCount);
+    putBytes(&o, buckets, sizeof(uint32_t) * h.bucketCount);
+    free(buckets);
+    padTo(&o, h.dictOff);
+    putBytes(&o, w->dictBlocks.data, w->dictBlocks.len);
+    putBytes(&o, w->dict.data, w->dict.len);
+    padTo(&o, h.postingsOff);
+    int rc = copyFile(&o, w->postings.file, w->postingsPath);
+    padTo(&o, h.positionsOff);
+    if (rc == 0) rc = copyFile(&o, w->positions.file, w->positionsPath);
+    padTo(&o, h.offsetsOff);
+    if (rc == 0) rc = copyFile(&o, w->offsets.file, w->offsetsPath);
+    padTo(&o, h.stringsOff);
+    for (int d = 0; d < docCount; d++) putBytes(&o, documents[d].filename, strlen(documents[d].filename) + 1);
+    putBytes(&o, stopText, stopLen);
+    padTo(&o, h.fileSize);
+    char path[1024];
+    memcpy(path, w->path, sizeof(path));
+    discardIndexWriter(w);
+
+    if (rc == 0 && ferror(f)) { perror(tmp); rc = -1; }
+    if (fclose(f) != 0 && rc == 0) { perror(tmp); rc = -1; }
+    if (rc == 0 && rename(tmp, path) != 0) { perror(path); rc = -1; }
+    if (rc != 0) remove(tmp);
+    else if (size) *size = (size_t)h.fileSize;
+    return rc;
+}
+
+/* Write the image to path atomically (tmp file + rename). */
+int saveIndex(const Index *idx, const char *path) {
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) { perror(tmp); return -1; }
+    if (fwrite(idx->base, 1, idx->size, f) != idx->size) {
+        perror(tmp); fclose(f); remove(tmp); return -1;
+    }
+    if (fclose(f) != 0) { perror(tmp); remove(tmp); return -1; }
+    if (rename(tmp, path) != 0) { perror(path); remove(tmp); return -1; }
+    return 0;
+}
+
+/* Map an index file read-only. Pages are shared with every other process
+   that maps the same file, and nothing is parsed up front. */
+Index *openIndex(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { perror(path); return NULL; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { perror(path); close(fd); return NULL; }
+    if ((size_t)st.st_size < sizeof(IndexHeader)) {
+        fprintf(stderr, "%s: not an index file\n", path);
+        close(fd);
+        return NULL;
+    }
+    void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) { perror("mmap"); return NULL; }
+
+    Index *idx = calloc(1, sizeof(Index));
+    if (!idx) { perror("calloc"); exit(1); }
+    idx->base = m;
+    idx->size = (size_t)st.st_size;
+    idx->mapped = 1;
+    if (bindImage(idx) != 0) {
+        fprintf(stderr, "%s: bad magic, version or size\n", path);
+        munmap(m, (size_t)st.st_size);
+        free(idx);
+        return NULL;
+    }
+    return idx;
+}
+
+void useIndexSettings(const Index *idx) {
+    /* queries must drop the same words the index did */
+    if (setStopWords(idx->strings + idx->hdr->stopwordsOff, idx->hdr->stopwordsLen) != 0)
+        fprintf(stderr, "bad stop-word list in the index, keeping the current one\n");
+    setIndexScoring((ScoringModel)idx->hdr->scoring, (int)idx->hdr->impactBits);
+    setKeepPositions(indexHasPositions(idx));
+}
+
+Index *loadIndex(const char *path) {
+    Index *idx = openIndex(path);
+    if (idx) useIndexSettings(idx);
+    return idx;
+}
+
+void freeIndex(Index *idx) {
+    if (!idx) return;
+    if (idx->mapped) munmap((void *)idx->base, idx->size);
+    else free((void *)idx->base);
+    freeTermSets(idx->termSets);
+    free(idx);
+}
+
+static size_t commonPrefix(const unsigned char *a, size_t alen, const char *b, size_t blen) {
+    size_t n = alen < blen ? alen : blen, i = 0;
+    while (i < n && a[i] == (unsigned char)b[i]) i++;
+    return i;
+}
+
+/* 1 if term t is word. Walks t's block keeping only how much of word the
+   current term matches, so nothing is copied: a term that keeps at least
+   that much of the previous one can only extend the match. */
+static int termIs(const Index *idx, uint32_t t, const char *word, size_t len) {
+    const unsigned char *p = idx->dict + idx->dictBlocks[t / DICT_BLOCK];
+    size_t cur = getVarint(&p);
+    size_t match = commonPrefix(p, cur, word, len);
+    p += cur;
+    for (uint32_t i = t % DICT_BLOCK; i > 0; i--) {
+        size_t shared = getVarint(&p), rest = getVarint(&p);
+        if (shared <= match) match = shared + commonPrefix(p, rest, word + shared, len - shared);
+        cur = shared + rest;
+        p += rest;
+    }
+    return match == len && cur == len;
+}
+
+const TermRecord *findTermRecord(const Index *idx, const char *word) {
+    uint32_t mask = idx->hdr->bucketCount - 1;
+    uint64_t hash = termHash(word);
+    size_t len = strlen(word);
+    uint32_t b = (uint32_t)(hash & mask);
+    while (idx->buckets[b]) {
+        uint32_t t = idx->buckets[b] - 1;
+        if (idx->terms[t].hash == (uint32_t)hash && termIs(idx, t, word, len)) return &idx->terms[t];
+        b = (b + 1) & mask;
+    }
+    return NULL;
+}
+
+/* ---------------- Dictionary ---------------- */
+
+void openTerms(const Index *idx, TermCursor *c) {
+    c->idx = idx;
+    c->term = 0;
+    c->p = NULL;
+    c->word = NULL;
+    c->len = 0;
+    c->cap = 0;
+}
+
+/* Replace all but the first `shared` bytes of the current term with the
+   next `rest` bytes of the dictionary. */
+static void takeSuffix(TermCursor *c, size_t shared, size_t rest) {
+    if (shared + rest + 1 > c->cap) {
+        c->cap = shared + rest + 1 < 64 ? 64 : (shared + rest + 1) * 2;
+        c->word = realloc(c->word, c->cap);
+        if (!c->word) { perror("realloc"); exit(1); }
+    }
+    memcpy(c->word + shared, c->p, rest);
+    c->p += rest;
+    c->len = shared + rest;
+    c->word[c->len] = '\0';
+}
+
+/* Decode term t from the start of its block. */
+static int loadTerm(TermCursor *c, uint32_t t) {
+    uint32_t count = c->idx->hdr->termCount;
+    if (t >= count) {
+        c->term = count;
+        return 0;
+    }
+    c->p = c->idx->dict + c->idx->dictBlocks[t / DICT_BLOCK];
+    size_t first = getVarint(&c->p);
+    takeSuffix(c, 0, first);
+    for (uint32_t i = t % DICT_BLOCK; i > 0; i--) {
+        size_t shared = getVarint(&c->p);
+        size_t rest = getVarint(&c->p);
+        takeSuffix(c, shared, rest);
+    }
+    c->term = t;
+    return 1;
+}
+
+int nextTerm(TermCursor *c) {
+    if (!c->p) return loadTerm(c, c->term);
+    uint32_t t = c->term + 1;
+    if (t >= c->idx->hdr->termCount) {
+        c->term = c->idx->hdr->termCount;
+        return 0;
+    }
+    if (t % DICT_BLOCK == 0) return loadTerm(c, t);
+    size_t shared = getVarint(&c->p);
+    size_t rest = getVarint(&c->p);
+    takeSuffix(c, shared, rest);
+    c->term = t;
+    return 1;
+}
+
+/* <0, 0, >0 as block b's first term sorts before, equal to or after word */
+static int cmpBlockStart(const Index *idx, uint32_t b, const char *word, size_t len) {
+    const unsigned char *p = idx->dict + idx->dictBlocks[b];
+    size_t n = getVarint(&p);
+    int r = memcmp(p, word, n < len ? n : len);
+    if (r) return r;
+    return (n > len) - (n < len);
+}
+
+int seekTerm(TermCursor *c, const char *word, size_t len) {
+    const Index *idx = c->idx;
+    uint32_t blocks = (idx->hdr->termCount + DICT_BLOCK - 1) / DICT_BLOCK;
+    /* the last block starting at or before word holds the first term >= it */
+    uint32_t lo = 0, hi = blocks;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (cmpBlockStart(idx, mid, word, len) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    if (!loadTerm(c, lo > 0 ? (lo - 1) * DICT_BLOCK : 0)) return 0;
+    for (;;) {
+        int r = memcmp(c->word, word, c->len < len ? c->len : len);
+        if (r > 0 || (r == 0 && c->len >= len)) return 1;
+        if (!nextTerm(c)) return 0;
+    }
+}
+
+void closeTerms(TermCursor *c) {
+    free(c->word);
+    c->word = NULL;
+    c->cap = 0;
+}
+
+const char *indexDocName(const Index *idx, int docId) {
+    return idx->strings + idx->docs[docId].nameOff;
+}
+
+int indexDocTerms(const Index *idx, int docId) {
+    return (int)idx->docs[docId].totalTerms;
+}
+
+int indexDocCount(const Index *idx) {
+    return (int)idx->hdr->docCount;
+}
+
+/* the skip table closes the term's postings */
+static const SkipEntry *termSkips(const Index *idx, const TermRecord *t) {
+    return (const SkipEntry *)(idx->postings + t->postingsOff + t->postingsLen) - t->blockCount;
+}
+
+void openPostings(const Index *idx, const TermRecord *t, PostingCursor *c) {
+    c->blocks = idx->postings + t->postingsOff;
+    c->skips = termSkips(idx, t);
+    c->positions = indexHasPositions(idx) ? idx->positions + t->positionsOff : NULL;
+    c->offsets = indexHasPositions(idx) ? idx->offsets + t->offsetsOff : NULL;
+    c->blockCount = t->blockCount;
+    c->docFrequency = t->docFrequency;
+    c->impactBytes = idx->hdr->impactBits / 8;
+    c->block = 0;
+    c->count = 0;
+    c->cur = -1;
+    c->posPtr = NULL;
+    c->posAt = 0;
+    c->posBuf = NULL;
+    c->posCap = 0;
+    c->offPtr = NULL;
+    c->offAt = 0;
+    c->offBuf = NULL;
+    c->offCap = 0;
+    c->arena = NULL;
+    c->docId = -1;
+    c->frequency = 0;
+    c->impact = 0;
+    c->decoded = 0;
+}
+
+/* Decode docIds, frequencies and impacts of block b; positions and offsets aren't touched. */
+static void decodeBlock(PostingCursor *c, uint32_t b) {
+    const unsigned char *p = c->blocks + c->skips[b].offset;
+    uint32_t prev = b > 0 ? c->skips[b - 1].lastDocId : 0;
+    int n = b + 1 < c->blockCount ? POSTING_BLOCK
+                                  : (int)(c->docFrequency - b * POSTING_BLOCK);
+    for (int i = 0; i < n; i++) {
+        prev += getVarint(&p);
+        c->docIds[i] = (int)prev;
+    }
+    for (int i = 0; i < n; i++) c->freqs[i] = (int)getVarint(&p);
+    if (c->impactBytes == 1) {
+        for (int i = 0; i < n; i++) c->impacts[i] = p[i];
+    } else {
+        for (int i = 0; i < n; i++) c->impacts[i] = (uint16_t)(p[2 * i] | p[2 * i + 1] << 8);
+    }
+    c->block = b;
+    c->count = n;
+    c->decoded += (uint64_t)n;
+    c->cur = 0;
+    c->posPtr = c->positions ? c->positions + c->skips[b].posOffset : NULL;
+    c->posAt = 0;
+    c->offPtr = c->offsets ? c->offsets + c->skips[b].offOffset : NULL;
+    c->offAt = 0;
+}
+
+static int settle(PostingCursor *c) {
+    c->docId = c->docIds[c->cur];
+    c->frequency = c->freqs[c->cur];
+    c->impact = c->impacts[c->cur];
+    return 1;
+}
+
+static int exhaust(PostingCursor *c) {
+    c->docId = -1;
+    c->frequency = 0;
+    c->block = c->blockCount;
+    return 0;
+}
+
+/* Step to the next posting. Returns 0 when the list is exhausted. */
+int nextPosting(PostingCursor *c) {
+    if (c->cur < 0) {
+        if (c->blockCount == 0) return exhaust(c);
+        decodeBlock(c, 0);
+        return settle(c);
+    }
+    if (c->block >= c->blockCount) return 0;
+    if (++c->cur < c->count) return settle(c);
+    if (c->block + 1 >= c->blockCount) return exhaust(c);
+    decodeBlock(c, c->block + 1);
+    return settle(c);
+}
+
+/* Move to the first posting with docId >= target, skipping whole blocks via
+   the skip table. Never moves backwards. Returns 0 when exhausted. */
+int advancePosting(PostingCursor *c, int target) {
+    if (c->docId >= target) return 1;
+    if (c->cur >= 0 && c->block >= c->blockCount) return 0;
+    uint32_t b = c->cur < 0 ? 0 : c->block;
+    if (b >= c->blockCount) return exhaust(c);
+    if ((int)c->skips[b].lastDocId < target) {
+        /* binary search for the first block whose last docId reaches target */
+        uint32_t lo = b + 1, hi = c->blockCount;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if ((int)c->skips[mid].lastDocId < target) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo >= c->blockCount) return exhaust(c);
+        decodeBlock(c, lo);
+    } else if (c->cur < 0) {
+        decodeBlock(c, 0);
+    }
+    while (c->docIds[c->cur] < target) c->cur++;
+    return settle(c);
+}
+
+/* Decode the current posting's deltas from a position or offset stream
+   into buf (4-byte values), growing it as needed. *ptr and *at track the
+   posting the stream is at within the block. */
+static void *decodeDeltas(PostingCursor *c, const unsigned char **ptr, int *at, void *buf, int *cap) {
+    while (*at < c->cur) {
+        for (int k = 0; k < c->freqs[*at]; k++) skipVarint(ptr);
+        (*at)++;
+    }
+    if (c->frequency > *cap) {
+        *cap = c->frequency < 16 ? 16 : c->frequency;
+        if (c->arena) {
+            buf = arenaAlloc(c->arena, sizeof(uint32_t) * *cap);
+        } else {
+            buf = realloc(buf, sizeof(uint32_t) * *cap);
+            if (!buf) { perror("realloc"); exit(1); }
+        }
+    }
+    const unsigned char *p = *ptr;
+    uint32_t *out = buf, last = 0;
+    for (int k = 0; k < c->frequency; k++) {
+        last += getVarint(&p);
+        out[k] = last;
+    }
+    return buf;
+}
+
+/* Positions of the current posting, decoded into a cursor-owned buffer
+   (valid until the next call). */
+const int *postingPositions(PostingCursor *c) {
+    if (c->docId < 0 || !c->posPtr) return NULL;
+    c->posBuf = decodeDeltas(c, &c->posPtr, &c->posAt, c->posBuf, &c->posCap);
+    return c->posBuf;
+}
+
+/* The same for byte offsets, from their own section. */
+const uint32_t *postingOffsets(PostingCursor *c) {
+    if (c->docId < 0 || !c->offPtr) return NULL;
+    c->offBuf = decodeDeltas(c, &c->offPtr, &c->offAt, c->offBuf, &c->offCap);
+    return c->offBuf;
+}
+
+void closePostings(PostingCursor *c) {
+    if (!c->arena) {
+        free(c->posBuf);
+        free(c->offBuf);
+    }
+    c->posBuf = NULL;
+    c->posCap = 0;
+    c->offBuf = NULL;
+    c->offCap = 0;
+}
+
+/* ---------------- Statistics ---------------- */
+
+uint32_t termProbeLength(const Index *idx, uint32_t bucket) {
+    uint32_t mask = idx->hdr->bucketCount - 1;
+    const TermRecord *t = &idx->terms[idx->buckets[bucket] - 1];
+    uint32_t home = t->hash & mask;
+    return ((bucket - home) & mask) + 1;
+}
+
+void measurePostings(const Index *idx, const TermRecord *t, PostingBytes *out) {
+    const SkipEntry *skips = termSkips(idx, t);
+    const unsigned char *blocks = idx->postings + t->postingsOff;
+    out->skips += sizeof(SkipEntry) * t->blockCount;
+    for (uint32_t b = 0; b < t->blockCount; b++) {
+        const unsigned char *p = blocks + skips[b].offset, *mark = p;
+        int n = b + 1 < t->blockCount ? POSTING_BLOCK : (int)(t->docFrequency - b * POSTING_BLOCK);
+        for (int i = 0; i < n; i++) skipVarint(&p);
+        out->docIds += (uint64_t)(p - mark);
+        mark = p;
+        uint64_t positions = 0;
+        for (int i = 0; i < n; i++) positions += getVarint(&p);
+        out->freqs += (uint64_t)(p - mark);
+        out->impacts += (uint64_t)n * (idx->hdr->impactBits / 8);
+        if (!indexHasPositions(idx)) continue;
+        p = mark = idx->positions + t->positionsOff + skips[b].posOffset;
+        for (uint64_t k = 0; k < positions; k++) skipVarint(&p);
+        out->positions += (uint64_t)(p - mark);
+        p = mark = idx->offsets + t->offsetsOff + skips[b].offOffset;
+        for (uint64_t k = 0; k < positions; k++) skipVarint(&p);
+        out->offsets += (uint64_t)(p - mark);
+    }
+}
@@ -0,0 +1,261 @@
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdint.h>
+#include "indexer.h"
+
+/* ---------------- On-disk index format ----------------
+   A built index is one flat, position-independent image:
+
+     IndexHeader
+     DocRecord   docs[docCount]
+     TermRecord  terms[termCount]
+     uint32_t    buckets[bucketCount]   open-addressed term lookup (termIndex + 1, 0 = empty)
+     dictionary  the terms in order, front-coded (below)
+     postings    per term: compressed blocks, then SkipEntry[blockCount] (4-byte aligned)
+     positions   per term: every posting's varint position deltas
+     offsets     per term: every posting's varint byte offset deltas
+     strings     NUL-terminated filenames, then the stop-word list
+
+   The same image is used whether it was just built in memory or mmap'd
+   from disk, so queries never care where the bytes came from. */
+
+#define INDEX_MAGIC "MSEIDX\0"
+#define INDEX_VERSION 9
+
+/* Postings are cut into blocks of POSTING_BLOCK docIds. Each block stores
+   varint docId deltas, then varint frequencies, then one fixed-width
+   impact per posting. A term's skip table (one entry per block) lets a
+   cursor jump straight to the block that may hold a target docId. It
+   comes after the blocks, so a streamed build can write each block as it
+   fills and the table once the term is done.
+   Positions, which only phrases read, are kept apart in a section of
+   their own, so ranking and boolean queries never page them in; each skip
+   entry points at its block's first position. Each position's byte offset
+   in the source file, which only snippets read, follows the same layout in
+   a section after them. An index built without positions has both
+   sections empty. */
+#define POSTING_BLOCK 128
+
+/* Terms are sorted, and the dictionary cuts them into blocks of
+   DICT_BLOCK. A block starts with a whole term (varint length, bytes);
+   every later term is the varint length of the prefix it shares with the
+   one before, then the varint length and bytes of the rest. The section
+   starts with uint32_t offsets of the blocks (relative to the end of the
+   offsets). A term is decoded from its block's start, and a prefix is
+   found by binary search over the blocks' first terms. */
+#define DICT_BLOCK 16
+
+/* ---------------- Scoring ----------------
+   A posting's impact is the document-dependent part of its score: tf/len
+   for TF-IDF, or BM25's saturated, length-normalized tf. It is computed at
+   build time and quantized to impactBits (8 or 16) relative to the term's
+   maxImpact, so a stored q stands for q / (2^impactBits - 1) * maxImpact.
+   idf is left to query time, where it is taken over every segment. */
+typedef enum ScoringModel {
+    SCORE_TFIDF,
+    SCORE_BM25
+} ScoringModel;
+
+#define BM25_K1 1.2
+#define BM25_B 0.75
+
+static inline double scoringImpact(ScoringModel model, double avgDocTerms, int tf, int len) {
+    if (len < 1) len = 1;
+    if (model == SCORE_TFIDF) return (double)tf / len;
+    double norm = avgDocTerms > 0 ? len / avgDocTerms : 1.0;
+    return tf * (BM25_K1 + 1) / (tf + BM25_K1 * (1 - BM25_B + BM25_B * norm));
+}
+
+static inline double scoringIdf(ScoringModel model, double docCount, double df) {
+    if (df <= 0) return 0.0;
+    if (model == SCORE_TFIDF) return log(docCount / df);
+    return log(1.0 + (docCount - df + 0.5) / (df + 0.5));
+}
+
+typedef struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t docCount;
+    uint32_t termCount;
+    uint32_t bucketCount;   /* power of two */
+    uint32_t stopwordsOff;  /* offset into strings of the '\n'-separated stop words used at build time */
+    uint32_t stopwordsLen;
+    uint32_t scoring;       /* ScoringModel the impacts were computed with */
+    uint32_t impactBits;    /* 8 or 16 */
+    uint32_t hasPositions;  /* 0: built without positions (and offsets) */
+    double avgDocTerms;     /* BM25 length normalization */
+    uint64_t docsOff;
+    uint64_t termsOff;
+    uint64_t bucketsOff;
+    uint64_t dictOff;
+    uint64_t postingsOff;
+    uint64_t positionsOff;
+    uint64_t offsetsOff;
+    uint64_t stringsOff;
+    uint64_t fileSize;
+} IndexHeader;
+
+typedef struct DocRecord {
+    uint32_t nameOff;       /* offset into strings */
+    uint32_t totalTerms;
+} DocRecord;
+
+typedef struct TermRecord {
+    uint32_t hash;          /* of the term, so lookups decode only a likely match */
+    uint32_t docFrequency;
+    uint32_t blockCount;
+    float maxImpact;        /* largest impact over postings (rounded up); times idf bounds the term's score */
+    uint64_t postingsOff;   /* offset into postings (blocks first) */
+    uint64_t postingsLen;   /* bytes, skip table included */
+    uint64_t positionsOff;  /* offset into positions */
+    uint64_t offsetsOff;    /* offset into offsets */
+} TermRecord;
+
+typedef struct SkipEntry {
+    uint32_t lastDocId;     /* largest docId in the block */
+    uint32_t offset;        /* block start, relative to the term's postingsOff */
+    uint32_t posOffset;     /* block's first position, relative to the term's positions */
+    uint32_t offOffset;     /* block's first byte offset, relative to the term's offsets */
+} SkipEntry;
+
+typedef struct Index {
+    const unsigned char *base;
+    size_t size;
+    int mapped;             /* 1 = mmap'd file, 0 = heap image */
+    const IndexHeader *hdr;
+    const DocRecord *docs;
+    const TermRecord *terms;
+    const uint32_t *buckets;
+    const uint32_t *dictBlocks;
+    const unsigned char *dict;  /* entries, after the block offsets */
+    const unsigned char *postings;
+    const unsigned char *positions;
+    const unsigned char *offsets;
+    const char *strings;
+    uint64_t generation;    /* unique per bound image; results cached against it go stale with it */
+    struct TermSets *termSets;  /* docId sets of dense terms, built on demand (docset.h) */
+} Index;
+
+/* Iterates one term's postings in docId order, decoding one block at a time. */
+typedef struct PostingCursor {
+    const SkipEntry *skips;
+    const unsigned char *blocks;
+    const unsigned char *positions;     /* the term's position stream; NULL without positions */
+    const unsigned char *offsets;       /* its byte offset stream, likewise */
+    uint32_t blockCount;
+    uint32_t docFrequency;
+    uint32_t block;         /* block currently decoded */
+    int count;              /* postings in the decoded block */
+    int cur;                /* index of the current posting in the block */
+    int impactBytes;        /* 1 or 2 */
+    int docIds[POSTING_BLOCK];
+    int freqs[POSTING_BLOCK];
+    uint16_t impacts[POSTING_BLOCK];
+    const unsigned char *posPtr;    /* positions of posting posAt */
+    int posAt;
+    int *posBuf;
+    int posCap;
+    const unsigned char *offPtr;    /* byte offsets of posting offAt */
+    int offAt;
+    uint32_t *offBuf;
+    int offCap;
+    Arena *arena;           /* if set, position and offset buffers come from here instead of the heap */
+    int docId;              /* -1 before the first posting and once exhausted */
+    int frequency;
+    int impact;             /* quantized */
+    uint64_t decoded;       /* postings decoded so far (blocks skipped via the skip table don't count) */
+} PostingCursor;
+
+/* Walks the dictionary in term order. The current term is terms[term]. */
+typedef struct TermCursor {
+    const Index *idx;
+    uint32_t term;          /* termCount once exhausted */
+    const unsigned char *p; /* next entry of the current block; NULL before the first term */
+    char *word;             /* current term, NUL-terminated (heap) */
+    size_t len;
+    size_t cap;
+} TermCursor;
+
+/* build / persist */
+/* model and impact width for images built from now on (TF-IDF, 8 bits by
+   default); loading an index switches to its settings, positions included
+   (setKeepPositions) */
+int setIndexScoring(ScoringModel model, int impactBits);
+ScoringModel indexBuildScoring(void);
+/* BM25 length normalization for images built from now on: the collection's
+   average doc length when building one part of it (0, the default: the
+   average of the documents being built) */
+void setIndexAvgDocTerms(double avg);
+double indexBuildAvgDocTerms(void);
+Index *buildIndexImage(TermTable *table);
+int saveIndex(const Index *idx, const char *path);
+
+/* Streamed build, for postings that don't fit in memory: terms arrive in
+   sorted order, each followed by its postings in docId order, and go
+   straight out to temporary files next to path. Closing the writer
+   assembles the image at path from them and documents[] (which must be
+   complete when the writer is opened) with sequential I/O. Only the term
+   records and the dictionary are held in memory. maxImpact is the largest
+   impact over the term's postings. */
+typedef struct IndexWriter IndexWriter;
+IndexWriter *openIndexWriter(const char *path);
+void writeTerm(IndexWriter *w, const char *word, uint32_t docFrequency, double maxImpact);
+void writePosting(IndexWriter *w, int docId, int frequency, const int *positions,
+                  const uint32_t *offsets, int posCount);
+/* 0 on success, with the image's size in *size; frees w either way */
+int closeIndexWriter(IndexWriter *w, size_t *size);
+/* give up on the build, removing its temporary files */
+void discardIndexWriter(IndexWriter *w);
+/* map an image without touching anything process-wide */
+Index *openIndex(const char *path);
+/* take on the stop words and build settings idx was built with */
+void useIndexSettings(const Index *idx);
+/* openIndex, then useIndexSettings */
+Index *loadIndex(const char *path);
+void freeIndex(Index *idx);
+uint64_t newIndexGeneration(void);
+
+/* lookup */
+const TermRecord *findTermRecord(const Index *idx, const char *word);
+const char *indexDocName(const Index *idx, int docId);
+int indexDocTerms(const Index *idx, int docId);
+int indexDocCount(const Index *idx);
+static inline int indexHasPositions(const Index *idx) {
+    return idx->hdr->hasPositions != 0;
+}
+/* largest quantized impact: 255 or 65535 */
+static inline int indexImpactMax(const Index *idx) {
+    return (1 << idx->hdr->impactBits) - 1;
+}
+
+/* dictionary */
+void openTerms(const Index *idx, TermCursor *c);
+/* Step to the next term. Returns 0 past the last one. */
+int nextTerm(TermCursor *c);
+/* Move to the first term >= word (anywhere, forwards or back). Returns 0
+   if there is none. */
+int seekTerm(TermCursor *c, const char *word, size_t len);
+void closeTerms(TermCursor *c);
+
+/* postings */
+void openPostings(const Index *idx, const TermRecord *t, PostingCursor *c);
+int nextPosting(PostingCursor *c);
+int advancePosting(PostingCursor *c, int target);
+/* NULL if the index has no positions */
+const int *postingPositions(PostingCursor *c);
+/* byte offsets in the document of the current posting's positions, in
+   the same order; NULL if the index has no positions */
+const uint32_t *postingOffsets(PostingCursor *c);
+void closePostings(PostingCursor *c);
+
+/* statistics: where a term's postings bytes go, and how far from its home
+   slot the term in a (non-empty) bucket sits (1 = found on the first probe) */
+typedef struct PostingBytes {
+    uint64_t skips, docIds, freqs, impacts, positions, offsets;
+} PostingBytes;
+
+void measurePostings(const Index *idx, const TermRecord *t, PostingBytes *out);
+uint32_t termProbeLength(const Index *idx, uint32_t bucket);
+
+#endif
@@ -0,0 +1,38 @@
+#include "textbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void textPut(TextBuf *b, const char *s, size_t len) {
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 512;
+        while (cap < b->len + len) cap *= 2;
+        b->s = realloc(b->s, cap);
+        if (!b->s) { perror("realloc"); exit(1); }
+        b->cap = cap;
+    }
+    memcpy(b->s + b->len, s, len);
+    b->len += len;
+}
+
+void textStr(TextBuf *b, const char *s) {
+    textPut(b, s, strlen(s));
+}
+
+void textJsonString(TextBuf *b, const char *s) {
+    textPut(b, "\"", 1);
+    for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+        char esc[8];
+        if (*p == '"' || *p == '\\') {
+            esc[0] = '\\';
+            esc[1] = (char)*p;
+            textPut(b, esc, 2);
+        } else if (*p < 0x20) {
+            snprintf(esc, sizeof(esc), "\\u%04x", *p);
+            textPut(b, esc, 6);
+        } else {
+            textPut(b, (const char *)p, 1);
+        }
+    }
+    textPut(b, "\"", 1);
+}
@@ -0,0 +1,18 @@
+#ifndef TEXTBUF_H
+#define TEXTBUF_H
+
+#include <stddef.h>
+
+/* Growable heap buffer for output lines (server replies, batch results).
+   s is not NUL-terminated; the caller owns it and frees it. */
+typedef struct TextBuf {
+    char *s;
+    size_t len, cap;
+} TextBuf;
+
+void textPut(TextBuf *b, const char *s, size_t len);
+void textStr(TextBuf *b, const char *s);
+/* s as a quoted JSON string */
+void textJsonString(TextBuf *b, const char *s);
+
+#endif
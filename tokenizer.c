@@ -0,0 +1,289 @@
+#include "tokenizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Build with -DTOKENIZER_SCALAR to force the portable classifier. */
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(TOKENIZER_SCALAR)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+/* ---------------- Byte classification ----------------
+   Input is processed in 64-byte blocks. For each block we build two bit
+   masks (bit i = byte i): "sep" marks whitespace, "dirty" marks any byte
+   that is neither whitespace nor already a lowercase letter or digit, i.e.
+   bytes that force a token to be normalized instead of handed out as-is. */
+
+#ifndef HAVE_X86
+static void classifyScalar(const unsigned char *p, uint64_t *sep, uint64_t *dirty) {
+    uint64_t s = 0, d = 0;
+    for (int i = 0; i < 64; i++) {
+        unsigned char c = p[i];
+        int isSep = c == ' ' || (c >= '\t' && c <= '\r');
+        int isClean = (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+        s |= (uint64_t)isSep << i;
+        d |= (uint64_t)(!isSep && !isClean) << i;
+    }
+    *sep = s;
+    *dirty = d;
+}
+#else
+/* unsigned range test lo <= x <= hi, via a bias into signed space */
+#define SSE_IN_RANGE(x, lo, hi) \
+    _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8((char)((lo) - 1 - 128))), \
+                  _mm_cmplt_epi8(x, _mm_set1_epi8((char)((hi) + 1 - 128))))
+
+static void classifySSE2(const unsigned char *p, uint64_t *sep, uint64_t *dirty) {
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    uint64_t s = 0, d = 0;
+    for (int k = 0; k < 4; k++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * k));
+        __m128i x = _mm_xor_si128(v, bias);
+        __m128i isSep = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                     SSE_IN_RANGE(x, '\t', '\r'));
+        __m128i isClean = _mm_or_si128(SSE_IN_RANGE(x, 'a', 'z'), SSE_IN_RANGE(x, '0', '9'));
+        uint64_t ms = (uint32_t)_mm_movemask_epi8(isSep);
+        uint64_t mc = (uint32_t)_mm_movemask_epi8(isClean);
+        s |= ms << (16 * k);
+        d |= (~(ms | mc) & 0xffff) << (16 * k);
+    }
+    *sep = s;
+    *dirty = d;
+}
+
+#define AVX_IN_RANGE(x, lo, hi) \
+    _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8((char)((lo) - 1 - 128))), \
+                     _mm256_cmpgt_epi8(_mm256_set1_epi8((char)((hi) + 1 - 128)), x))
+
+__attribute__((target("avx2")))
+static void classifyAVX2(const unsigned char *p, uint64_t *sep, uint64_t *dirty) {
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    uint64_t s = 0, d = 0;
+    for (int k = 0; k < 2; k++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + 32 * k));
+        __m256i x = _mm256_xor_si256(v, bias);
+        __m256i isSep = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                        AVX_IN_RANGE(x, '\t', '\r'));
+        __m256i isClean = _mm256_or_si256(AVX_IN_RANGE(x, 'a', 'z'), AVX_IN_RANGE(x, '0', '9'));
+        uint64_t ms = (uint32_t)_mm256_movemask_epi8(isSep);
+        uint64_t mc = (uint32_t)_mm256_movemask_epi8(isClean);
+        s |= ms << (32 * k);
+        d |= (~(ms | mc) & 0xffffffffULL) << (32 * k);
+    }
+    *sep = s;
+    *dirty = d;
+}
+
+/* Normalize a token of at most 16 bytes with at least 16 bytes of input
+   from its start (the window is loaded whole). Handles the common shapes without a byte loop: punctuation only at
+   the ends is trimmed in place (no copy), and uppercase is folded with one
+   vector store. *skip is the punctuation trimmed off the front. Returns 0
+   when the token has punctuation inside it and the caller must compact it
+   byte by byte. */
+static int foldShort(const char *tok, size_t len, char *out, const char **res, size_t *resLen, size_t *skip) {
+    __m128i v = _mm_loadu_si128((const __m128i *)tok);
+    __m128i x = _mm_xor_si128(v, _mm_set1_epi8((char)0x80));
+    __m128i upper = SSE_IN_RANGE(x, 'A', 'Z');
+    __m128i keep = _mm_or_si128(_mm_or_si128(upper, SSE_IN_RANGE(x, 'a', 'z')),
+                                SSE_IN_RANGE(x, '0', '9'));
+    uint32_t valid = (1u << len) - 1;
+    uint32_t k = (uint32_t)_mm_movemask_epi8(keep) & valid;
+    if (k == 0) { *resLen = 0; return 1; }
+    int lead = __builtin_ctz(k), last = 31 - __builtin_clz(k);
+    uint32_t span = ((2u << last) - 1) & ~((1u << lead) - 1);
+    if ((k & span) != span) return 0;
+    *resLen = (size_t)(last - lead + 1);
+    *skip = (size_t)lead;
+    if (((uint32_t)_mm_movemask_epi8(upper) & span) == 0) {
+        *res = tok + lead;
+        return 1;
+    }
+    _mm_storeu_si128((__m128i *)out, _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20))));
+    *res = out + lead;
+    return 1;
+}
+#endif
+
+typedef void (*ClassifyFn)(const unsigned char *, uint64_t *, uint64_t *);
+
+static ClassifyFn classify;
+
+static ClassifyFn pickClassifier(void) {
+#ifdef HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return classifyAVX2;
+    return classifySSE2;
+#else
+    return classifyScalar;
+#endif
+}
+
+/* ---------------- Token assembly ---------------- */
+
+/* byte -> normalized byte, 0 for anything that is dropped */
+static unsigned char foldTable[256];
+
+static pthread_once_t tokenizerOnce = PTHREAD_ONCE_INIT;
+
+static void initTokenizer(void) {
+    for (int c = 0; c < 256; c++) {
+        if (c >= 'A' && c <= 'Z') foldTable[c] = (unsigned char)(c | 0x20);
+        else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) foldTable[c] = (unsigned char)c;
+    }
+    classify = pickClassifier();
+}
+
+typedef struct TokState {
+    TokenFn fn;
+    void *ctx;
+    const char *data;       /* start of the input, for offsets */
+    const char *end;        /* one past its last byte */
+    char *norm;             /* buffer for tokens that need normalizing */
+    size_t normCap;
+    size_t count;
+} TokState;
+
+static void emitToken(TokState *st, const char *tok, size_t len, int dirty) {
+    size_t offset = (size_t)(tok - st->data);
+    if (dirty) {
+#ifdef HAVE_X86
+        /* foldShort loads 16 bytes: only where they are all input */
+        if (len <= 16 && (size_t)(st->end - tok) >= 16) {
+            size_t n, skip;
+            if (foldShort(tok, len, st->norm, &tok, &n, &skip)) {
+                if (n == 0) return;
+                st->fn(tok, n, offset + skip, st->ctx);
+                st->count++;
+                return;
+            }
+        }
+#endif
+        if (len > st->normCap) {
+            st->normCap = len;
+            st->norm = realloc(st->norm, st->normCap);
+            if (!st->norm) { perror("realloc"); exit(1); }
+        }
+        const unsigned char *in = (const unsigned char *)tok;
+        size_t k = 0, i = 0;
+        while (i < len && !foldTable[in[i]]) i++;
+        offset += i;
+        for (; i < len; i++) {
+            unsigned char c = foldTable[in[i]];
+            st->norm[k] = (char)c;
+            k += c != 0;
+        }
+        if (k == 0) return;     /* pure punctuation: not a token at all */
+        tok = st->norm;
+        len = k;
+    }
+    st->fn(tok, len, offset, st->ctx);
+    st->count++;
+}
+
+static inline uint64_t bitsBelow(int i) {
+    return i >= 64 ? ~0ULL : (1ULL << i) - 1;
+}
+
+size_t tokenizeBuffer(const char *data, size_t len, TokenFn fn, void *ctx) {
+    pthread_once(&tokenizerOnce, initTokenizer);
+
+    TokState st = { fn, ctx, data, data + len, malloc(256), 256, 0 };
+    if (!st.norm) { perror("malloc"); exit(1); }
+    const unsigned char *p = (const unsigned char *)data;
+    int inToken = 0, tokDirty = 0;
+    size_t tokStart = 0;
+    uint64_t prevSep = 1;   /* start of input behaves like a separator */
+    unsigned char tail[64];
+
+    for (size_t base = 0; base < len; base += 64) {
+        uint64_t S, D;
+        if (len - base >= 64) {
+            classify(p + base, &S, &D);
+        } else {
+            /* pad the last partial block with separators */
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, p + base, len - base);
+            classify(tail, &S, &D);
+        }
+        /* bit i set where byte i differs in class from byte i-1 */
+        uint64_t edges = S ^ ((S << 1) | prevSep);
+        int segStart = 0;
+        while (edges) {
+            int i = __builtin_ctzll(edges);
+            edges &= edges - 1;
+            if (!((S >> i) & 1)) {
+                inToken = 1;
+                tokStart = base + i;
+                tokDirty = 0;
+                segStart = i;
+            } else {
+                tokDirty |= (D & bitsBelow(i) & ~bitsBelow(segStart)) != 0;
+                emitToken(&st, data + tokStart, base + i - tokStart, tokDirty);
+                inToken = 0;
+            }
+        }
+        if (inToken) {
+            tokDirty |= (D & ~bitsBelow(segStart)) != 0;
+        }
+        prevSep = S >> 63;
+    }
+    if (inToken) emitToken(&st, data + tokStart, len - tokStart, tokDirty);
+    free(st.norm);
+    return st.count;
+}
+
+/* Read fd (len bytes by fstat, but it may have changed since) whole and
+   tokenize it. Closes fd. */
+static long readAndTokenize(int fd, size_t len, TokenFn fn, void *ctx) {
+    size_t cap = len ? len : 65536, got = 0;
+    char *buf = malloc(cap);
+    if (!buf) { perror("malloc"); exit(1); }
+    ssize_t r;
+    while ((r = read(fd, buf + got, cap - got)) > 0) {
+        got += (size_t)r;
+        if (got == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+            if (!buf) { perror("realloc"); exit(1); }
+        }
+    }
+    close(fd);
+    size_t n = tokenizeBuffer(buf, got, fn, ctx);
+    free(buf);
+    return (long)n;
+}
+
+static long tokenizePath(const char *path, int map, TokenFn fn, void *ctx) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { perror(path); return -1; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { perror(path); close(fd); return -1; }
+    size_t len = (size_t)st.st_size;
+    if (len == 0 && map) { close(fd); return 0; }
+
+    void *m = map ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (m != MAP_FAILED) {
+        close(fd);
+        madvise(m, len, MADV_SEQUENTIAL);
+        size_t n = tokenizeBuffer(m, len, fn, ctx);
+        munmap(m, len);
+        return (long)n;
+    }
+    /* not mappable (e.g. a FIFO), or not to be mapped: read it whole instead */
+    return readAndTokenize(fd, len, fn, ctx);
+}
+
+long tokenizeFile(const char *path, TokenFn fn, void *ctx) {
+    return tokenizePath(path, 1, fn, ctx);
+}
+
+long tokenizeFileCopy(const char *path, TokenFn fn, void *ctx) {
+    return tokenizePath(path, 0, fn, ctx);
+}
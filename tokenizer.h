@@ -0,0 +1,25 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stddef.h>
+
+/* Called once per token, in document order. tok is lowercase ASCII
+   letters/digits only and is NOT NUL-terminated. Clean tokens point
+   straight into the mapped file; the rest point into a scratch buffer
+   that is only valid for the duration of the call. offset is where the
+   token's first kept byte lies in the input. */
+typedef void (*TokenFn)(const char *tok, size_t len, size_t offset, void *ctx);
+
+/* Split data the same way the indexer always has: separators are
+   whitespace, each token is lowercased and stripped of everything but
+   ASCII letters and digits, and tokens that end up empty are dropped.
+   Returns the number of tokens delivered. */
+size_t tokenizeBuffer(const char *data, size_t len, TokenFn fn, void *ctx);
+
+/* mmap path and tokenize it. Returns -1 if the file cannot be read. */
+long tokenizeFile(const char *path, TokenFn fn, void *ctx);
+/* The same from a private copy read with read(): for files that may be
+   truncated while they are tokenized, which would SIGBUS a mapping. */
+long tokenizeFileCopy(const char *path, TokenFn fn, void *ctx);
+
+#endif
@@ -0,0 +1,76 @@
+/* Build step: compile a stop-word list into a perfect-hash StopSet and
+   print it as a C header (stopwords_gen.h) defining defaultStopSet.
+
+   usage: gen_stopwords <word-list> > stopwords_gen.h */
+#include "../stopwords.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void printCString(const char *s, size_t len) {
+    putchar('"');
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '\n') fputs("\\n", stdout);
+        else putchar(s[i]);
+    }
+    putchar('"');
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <word-list>\n", argv[0]);
+        return 1;
+    }
+    FILE *f = fopen(argv[1], "rb");
+    if (!f) { perror(argv[1]); return 1; }
+    size_t cap = 4096, len = 0, r;
+    char *list = malloc(cap);
+    while (list && (r = fread(list + len, 1, cap - len, f)) > 0) {
+        len += r;
+        if (len == cap) list = realloc(list, cap *= 2);
+    }
+    fclose(f);
+    if (!list) { perror("malloc"); return 1; }
+
+    StopSet s;
+    if (buildStopSet(&s, list, len) != 0) {
+        fprintf(stderr, "%s: no perfect hash found\n", argv[1]);
+        return 1;
+    }
+    uint32_t nslots = 1u << (32 - s.shift);
+
+    printf("/* Generated by tools/gen_stopwords from %s. Do not edit. */\n\n", argv[1]);
+    printf("static const char *const defaultStopSlots[%u] = {\n", nslots);
+    for (uint32_t i = 0; i < nslots; i++) {
+        fputs("    ", stdout);
+        if (s.slots[i]) printCString(s.slots[i], s.lens[i]);
+        else fputs("NULL", stdout);
+        puts(",");
+    }
+    puts("};\n");
+    printf("static const unsigned char defaultStopLens[%u] = {", nslots);
+    for (uint32_t i = 0; i < nslots; i++) printf("%s%s%u", i ? "," : "", i % 16 ? " " : "\n    ", s.lens[i]);
+    puts("\n};\n");
+    printf("static const uint32_t defaultStopDisp[%u] = {", s.bucketMask + 1);
+    for (uint32_t i = 0; i <= s.bucketMask; i++) printf("%s%s%u", i ? "," : "", i % 8 ? " " : "\n    ", s.disp[i]);
+    puts("\n};\n");
+    puts("static const StopSet defaultStopSet = {");
+    printf("    .seed = 0x%016llxULL,\n", (unsigned long long)s.seed);
+    printf("    .shift = %u,\n", s.shift);
+    printf("    .bucketMask = %u,\n", s.bucketMask);
+    printf("    .minLen = %u,\n", s.minLen);
+    printf("    .maxLen = %u,\n", s.maxLen);
+    printf("    .count = %u,\n", s.count);
+    puts("    .slots = defaultStopSlots,");
+    puts("    .lens = defaultStopLens,");
+    puts("    .disp = defaultStopDisp,");
+    fputs("    .text = ", stdout);
+    printCString(s.text, s.textLen);
+    puts(",");
+    printf("    .textLen = %zu,\n", s.textLen);
+    puts("    .mem = NULL,");
+    puts("};");
+
+    freeStopSet(&s);
+    free(list);
+    return 0;
+}